@@ -15,7 +15,7 @@
 namespace ve {
 
 App::App()
-    : m_modelLoader{m_device} {
+    : m_modelLoader{m_device, m_threadPool, m_fileSystem, m_uploadContext} {
   KeyInput::init(m_window.window());
   MouseInput::init(m_window.window());
 
@@ -26,12 +26,29 @@ App::App()
 App::~App() {}
 
 void App::run() {
-  SimpleRenderSystem simpleRenderSystem{m_device, m_modelLoader, m_renderer.getSwapchainRenderPass()};
+  SimpleRenderSystem simpleRenderSystem{
+      m_device,
+      m_fileSystem,
+      m_modelLoader,
+      m_threadPool,
+      m_renderer.getSwapchainRenderPass()};
 
+  float statsElapsed = 0.0f;
+  uint32_t statsFrames = 0;
+  UploadContext::Stats lastUploadStats = m_uploadContext.stats();
+  bool lodKeyWasDown = false;
   while (!m_window.shouldClose()) {
     glfwPollEvents();
     m_timer.update();
 
+    // toggling lods and watching the stats below shows what they save
+    bool lodKeyDown = m_keyInput.isKeyDown('L');
+    if (lodKeyDown && !lodKeyWasDown) {
+      simpleRenderSystem.setLodEnabled(!simpleRenderSystem.lodEnabled());
+      std::cout << "lods " << (simpleRenderSystem.lodEnabled() ? "enabled" : "disabled") << std::endl;
+    }
+    lodKeyWasDown = lodKeyDown;
+
     m_camera.update(m_timer.dt());
     float aspect = m_renderer.getAspectRatio();
     if (glm::abs(m_camera.aspect() - aspect) > glm::epsilon<float>()) {
@@ -40,11 +57,47 @@ void App::run() {
     }
 
     if (auto cmd = m_renderer.beginFrame()) {
+      // culling may record a compute pass, which can't happen inside the render pass
+      simpleRenderSystem.prepareFrame(
+          cmd,
+          m_camera,
+          static_cast<uint32_t>(m_renderer.getCurrentFrameIndex()),
+          m_renderer.getPreviousDepthImageView(),
+          m_renderer.getSwapchainExtent());
       m_renderer.beginSwapchainRenderPass(cmd);
       simpleRenderSystem.renderGameObjects(cmd, m_gameObjects, m_camera);
       m_renderer.endSwapchainRenderPass(cmd);
       m_renderer.endFrame();
     }
+
+    statsElapsed += m_timer.frameTime();
+    statsFrames++;
+    if (statsElapsed >= 1.0f) {
+      float frameMilliseconds = statsElapsed * 1000.0f / static_cast<float>(statsFrames);
+      if (simpleRenderSystem.gpuCulling()) {
+        const SimpleRenderSystem::GpuCullStats &stats = simpleRenderSystem.gpuCullStats();
+        std::cout << "culling: " << stats.visible << " visible, " << stats.frustumCulled << " outside the frustum, "
+                  << stats.occlusionCulled << " occluded, " << stats.triangles << " triangles, "
+                  << frameMilliseconds << " ms per frame" << std::endl;
+      } else {
+        const Scene::CullStats &stats = simpleRenderSystem.cullStats();
+        std::cout << "culling: " << stats.visible << " visible, " << stats.culled << " culled, " << stats.triangles
+                  << " triangles, " << frameMilliseconds << " ms per frame" << std::endl;
+      }
+      const RangeAllocator::Stats vertices = m_modelLoader.geometryStats().vertices;
+      std::cout << "geometry: " << vertices.used << " of " << vertices.capacity << " vertices used, "
+                << vertices.holes << " free ones in holes, " << m_modelLoader.pageCount() << " pages" << std::endl;
+      // how fast assets stream in while loading, and whether the staging ring is big enough for it
+      const UploadContext::Stats &uploads = m_uploadContext.stats();
+      if (uploads.bytes != lastUploadStats.bytes) {
+        double megabytes = static_cast<double>(uploads.bytes - lastUploadStats.bytes) / (1024.0 * 1024.0);
+        std::cout << "uploads: " << megabytes / statsElapsed << " MB/s in " << uploads.batches - lastUploadStats.batches
+                  << " batches, " << uploads.waits - lastUploadStats.waits << " waits for staging space" << std::endl;
+      }
+      lastUploadStats = uploads;
+      statsElapsed = 0.0f;
+      statsFrames = 0;
+    }
   }
 
   vkDeviceWaitIdle(m_device.device());
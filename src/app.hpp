@@ -2,11 +2,15 @@
 
 #include "ve_camera.hpp"
 #include "ve_device.hpp"
+#include "ve_file_system.hpp"
 #include "ve_game_object.hpp"
+#include "ve_input.hpp"
 #include "ve_mesh_loader.hpp"
 #include "ve_renderer.hpp"
 #include "ve_texture_loader.hpp"
+#include "ve_thread_pool.hpp"
 #include "ve_timer.hpp"
+#include "ve_upload_context.hpp"
 #include "ve_window.hpp"
 
 #include <memory>
@@ -33,10 +37,15 @@ private:
   Window m_window{WIDTH, HEIGHT, "First App"};
   Device m_device{m_window};
   Renderer m_renderer{m_window, m_device};
+  ThreadPool m_threadPool{};
+  // assets are read from loose files when they exist, out of the archive otherwise
+  FileSystem m_fileSystem{{"assets.pak"}};
+  UploadContext m_uploadContext{m_device};
   MeshLoader m_modelLoader;
 
   Camera m_camera{};
   Timer m_timer{};
+  KeyInput m_keyInput{{'L'}};
 
   std::vector<GameObject> m_gameObjects;
 };
@@ -30,7 +30,9 @@ layout(set = 0, binding = 1) buffer Objects{
 } objectData;
 
 struct Primitive {
+  vec3 positionOffset;
   uint parentObject;
+  vec3 positionScale;
   int material;
 };
 
@@ -1,10 +1,14 @@
 #version 450
 
+// the vertex layout picked in ve_mesh.hpp decides how these are stored.
+// positions may be quantized, the primitive says how to get them back, and
+// normals may be folded onto an octahedron, in which case only xy is set
 layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 color;
-layout(location = 2) in vec3 normal;
-layout(location = 3) in vec2 uv0;
-layout(location = 4) in vec2 uv1;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 uv0;
+layout(location = 3) in vec2 uv1;
+
+layout(constant_id = 0) const bool OCTAHEDRAL_NORMALS = false;
 
 layout(location = 0) out vec3 fragPosition;
 layout(location = 1) out vec3 fragColor;
@@ -30,7 +34,9 @@ layout(set = 0, binding = 1) buffer Objects{
 } objectData;
 
 struct Primitive {
+  vec3 positionOffset;
   uint parentObject;
+  vec3 positionScale;
   int material;
 };
 
@@ -53,19 +59,36 @@ layout(set = 0, binding = 3) buffer Lights{
   PointLight light[];
 } lightData;
 
+// instance slots of everything that survived culling, draw calls index this
+// with gl_InstanceIndex instead of the primitive buffer directly
+layout(set = 0, binding = 4) buffer Visible{
+  uint instance[];
+} visibleData;
+
+vec3 unfoldNormal(vec2 folded) {
+  vec3 n = vec3(folded, 1.0 - abs(folded.x) - abs(folded.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+
 void main() {
-  Primitive primitive = primitiveData.primitive[gl_InstanceIndex];
+  uint slot = visibleData.instance[gl_InstanceIndex];
+  Primitive primitive = primitiveData.primitive[slot];
   Object parentObject = objectData.object[primitive.parentObject];
+  vec3 localPosition = position * primitive.positionScale + primitive.positionOffset;
+  vec3 localNormal = OCTAHEDRAL_NORMALS ? unfoldNormal(normal.xy) : normal;
   gl_Position = camera.viewproj * parentObject.model *
-                vec4(position, 1.0f);
+                vec4(localPosition, 1.0f);
 
   fragPosition =
-      (parentObject.model * vec4(position, 1.0f)).xyz;
-  fragColor = color;
+      (parentObject.model * vec4(localPosition, 1.0f)).xyz;
+  fragColor = vec3(1.0f);
   fragNormal =
-      (parentObject.normalRotation * vec4(normal, 0.0f))
+      (parentObject.normalRotation * vec4(localNormal, 0.0f))
           .xyz;
   fragUV0 = uv0;
   fragUV1 = uv1;
-  primitiveIndex = gl_InstanceIndex;
+  primitiveIndex = int(slot);
 }
\ No newline at end of file
@@ -11,8 +11,10 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 
 namespace ve {
@@ -26,17 +28,56 @@ struct PerObjectData {
   glm::mat4 normalRotation;
 };
 
-struct ObjectData {
-  PerObjectData objects[SimpleRenderSystem::MAX_INSTANCE_COUNT];
-};
-
+// laid out the way the Primitive struct in the shaders expects it
 struct PerPrimitiveData {
+  glm::vec3 positionOffset;
   uint32_t parentObject;
+  glm::vec3 positionScale;
   int32_t material;
 };
+static_assert(sizeof(PerPrimitiveData) == 32, "PerPrimitiveData has to match the Primitive struct in the shaders");
+
+struct BatchLodData {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;
+  uint32_t pad;
+};
 
-struct PrimitiveData {
-  PerPrimitiveData primitives[SimpleRenderSystem::MAX_INSTANCE_COUNT];
+// one per draw call, the draw command plus the local bounds and lods of its
+// primitive, laid out the way cull.comp expects it
+struct BatchData {
+  DrawCall command;
+  uint32_t lodCount;
+  uint32_t indexBuffer;
+  uint32_t pad;
+  glm::vec4 boundsMin;
+  glm::vec4 boundsMax;
+  BatchLodData lods[Mesh::MAX_LOD_COUNT];
+};
+static_assert(sizeof(BatchData) == 128, "BatchData has to match the Batch struct in cull.comp");
+
+struct CullPushConstants {
+  glm::vec4 planes[6];
+  uint32_t slotCount;
+  uint32_t batchCount;
+  uint32_t pass;
+  uint32_t compact;
+  uint32_t frame;
+  uint32_t drawsPerBatch;
+  uint32_t drawsPerIndexBuffer;
+  uint32_t indexBufferCount;
+};
+static_assert(sizeof(CullPushConstants) <= 128, "Push constants past 128 bytes aren't supported everywhere");
+
+// the camera the depth pyramid was rendered with, and the current one for picking lods
+struct OcclusionData {
+  glm::mat4 viewProjection;
+  glm::vec2 pyramidSize;
+  uint32_t levelCount;
+  uint32_t enabled;
+  glm::vec3 cameraPosition;
+  float lodScale;
 };
 
 struct UniformData {
@@ -56,29 +97,60 @@ struct MaterialData {
   Material material[SimpleRenderSystem::MAX_MATERIAL_COUNT];
 };
 
+// recreates a persistently mapped storage buffer with room for `size`
+// bytes, keeping the first `keep` bytes of what it held
+void resizeMappedBuffer(Buffer &buffer, VkDeviceSize size, VkDeviceSize keep) {
+  const uint8_t *data = static_cast<const uint8_t *>(buffer.data());
+  std::vector<uint8_t> contents(data, data + keep);
+  buffer.destroy();
+  buffer.create(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  buffer.mapMemory();
+  std::memcpy(buffer.data(), contents.data(), contents.size());
+}
+
 void loadScene(Scene &scene) {
   // scene.addGameObject(glm::vec3(-1.0f, 0.0f, -2.5f), glm::vec3(0.0f), glm::vec3(0.5f), "smooth-monkey.glb");
   // scene.addGameObject(glm::vec3(1.0f, 0.0f, -2.5f), glm::vec3(0.0f), glm::vec3(0.5f), "cube.gltf");
   // scene.addGameObject(glm::vec3(0.0f, -2.0f, -2.5f), glm::vec3(0.0f), glm::vec3(0.5f), "tile-sphere.gltf");
   // scene.addGameObject(glm::vec3(0.0f, 2.0f, -2.5f), glm::vec3(0.0f), glm::vec3(0.5f), "tile-sphere-packed.gltf");
 
-  scene.addGameObject(glm::vec3(-1.0f, 0.0f, -2.5f), glm::vec3(0.0f), glm::vec3(0.5f), "smooth-monkey.glb");
-  scene.addGameObject(glm::vec3(1.0f, 0.0f, -2.5f), glm::vec3(0.0f), glm::vec3(0.5f), "tile-sphere.gltf");
-  scene.addGameObject(glm::vec3(0.0f, -2.0f, -2.5f), glm::vec3(0.0f), glm::vec3(0.5f), "gold-ring.gltf");
+  // imported in parallel, and committed together once all of them are read
+  scene.addGameObjects({
+      {glm::vec3(-1.0f, 0.0f, -2.5f), glm::vec3(0.0f), glm::vec3(0.5f), "smooth-monkey.glb"},
+      {glm::vec3(1.0f, 0.0f, -2.5f), glm::vec3(0.0f), glm::vec3(0.5f), "tile-sphere.gltf"},
+      {glm::vec3(0.0f, -2.0f, -2.5f), glm::vec3(0.0f), glm::vec3(0.5f), "gold-ring.gltf"},
+  });
 
   scene.addLight({glm::vec3(2.0f, 0.0f, -1.5f), glm::vec3(0.8f, 0.8f, 0.8f), 1.0f, glm::vec3(1.0f, 1.0f, 1.0f), 0.3f});
   scene.addLight({glm::vec3(-2.0f, 0.0f, -1.5f), glm::vec3(0.8f, 0.8f, 0.8f), 1.0f, glm::vec3(1.0f, 1.0f, 1.0f), 0.3f});
   scene.addLight({glm::vec3(0.0f, 1.0f, -1.5f), glm::vec3(0.4f, 0.4f, 0.4f), 1.0f, glm::vec3(1.0f, 1.0f, 1.0f), 0.3f});
 }
 
-SimpleRenderSystem::SimpleRenderSystem(Device &device, MeshLoader &modelLoader, VkRenderPass renderPass)
+SimpleRenderSystem::SimpleRenderSystem(
+    Device &device,
+    FileSystem &fileSystem,
+    MeshLoader &modelLoader,
+    ThreadPool &threadPool,
+    VkRenderPass renderPass)
     : m_device{device}
+    , m_fileSystem{fileSystem}
     , m_modelLoader{modelLoader}
+    , m_threadPool{threadPool}
     , m_uniformBuffer{m_device.getAllocator()}
     , m_objectBuffer{m_device.getAllocator()}
     , m_primitiveBuffer{m_device.getAllocator()}
+    , m_visibleBuffer{m_device.getAllocator()}
     , m_lightBuffer{m_device.getAllocator()}
     , m_materialBuffer{m_device.getAllocator()}
+    , m_batchBuffer{m_device.getAllocator()}
+    , m_slotBatchBuffer{m_device.getAllocator()}
+    , m_slotLodBuffer{m_device.getAllocator()}
+    , m_batchCountBuffer{m_device.getAllocator()}
+    , m_indirectBuffer{m_device.getAllocator()}
+    , m_drawCountBuffer{m_device.getAllocator()}
+    , m_occlusionBuffer{m_device.getAllocator()}
+    , m_cullStatsBuffer{m_device.getAllocator()}
+    , m_cullDescriptorAllocator{device.device()}
     , m_descriptorCache{device.device()}
     , m_descriptorAllocator{device.device()}
     , m_scene{modelLoader} {
@@ -92,16 +164,21 @@ SimpleRenderSystem::SimpleRenderSystem(Device &device, MeshLoader &modelLoader,
   m_uniformBuffer.create(uniformBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 0, VMA_MEMORY_USAGE_CPU_TO_GPU);
   m_uniformBuffer.mapMemory();
 
-  VkDeviceSize objectBufferSize = MAX_INSTANCE_COUNT * sizeof(PerObjectData);
+  VkDeviceSize objectBufferSize = m_objectCapacity * sizeof(PerObjectData);
   std::cout << "Using an object buffer of size " << objectBufferSize << std::endl;
   m_objectBuffer.create(objectBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, VMA_MEMORY_USAGE_CPU_TO_GPU);
   m_objectBuffer.mapMemory();
 
-  VkDeviceSize primitiveBufferSize = MAX_INSTANCE_COUNT * sizeof(PerPrimitiveData);
+  VkDeviceSize primitiveBufferSize = m_instanceCapacity * sizeof(PerPrimitiveData);
   std::cout << "Using a primitive buffer of size " << primitiveBufferSize << std::endl;
   m_primitiveBuffer.create(primitiveBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, VMA_MEMORY_USAGE_CPU_TO_GPU);
   m_primitiveBuffer.mapMemory();
 
+  VkDeviceSize visibleBufferSize = m_instanceCapacity * sizeof(uint32_t);
+  std::cout << "Using a visible instance buffer of size " << visibleBufferSize << std::endl;
+  m_visibleBuffer.create(visibleBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  m_visibleBuffer.mapMemory();
+
   VkDeviceSize lightBufferSize = sizeof(uint32_t) + MAX_LIGHT_COUNT * sizeof(PointLight);
   std::cout << "Using a light buffer of size " << lightBufferSize << std::endl;
   m_lightBuffer.create(lightBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, VMA_MEMORY_USAGE_CPU_TO_GPU);
@@ -112,6 +189,130 @@ SimpleRenderSystem::SimpleRenderSystem(Device &device, MeshLoader &modelLoader,
   m_materialBuffer.create(materialBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, VMA_MEMORY_USAGE_CPU_TO_GPU);
   m_materialBuffer.mapMemory();
 
+  writeDescriptorSets();
+
+  m_gpuCulling = m_device.supportsDrawIndirectFirstInstance();
+  createCullPipeline();
+}
+
+SimpleRenderSystem::~SimpleRenderSystem() {
+  m_uniformBuffer.unmapMemory();
+  m_objectBuffer.unmapMemory();
+  m_primitiveBuffer.unmapMemory();
+  m_visibleBuffer.unmapMemory();
+  m_lightBuffer.unmapMemory();
+  m_materialBuffer.unmapMemory();
+  m_batchBuffer.unmapMemory();
+  m_slotBatchBuffer.unmapMemory();
+  m_occlusionBuffer.unmapMemory();
+  m_cullStatsBuffer.unmapMemory();
+}
+
+void SimpleRenderSystem::createPipelineLayout() {
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(SimplePushConstantData);
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 0;
+  pipelineLayoutInfo.pSetLayouts = nullptr;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create pipeline layout");
+  }
+}
+
+void SimpleRenderSystem::createPipeline(VkRenderPass renderPass) {
+
+  auto vertShader =
+      std::make_shared<ShaderStage>(m_device, m_fileSystem, "shaders/simple.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+  auto fragShader =
+      std::make_shared<ShaderStage>(m_device, m_fileSystem, "shaders/pbr.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+
+  PipelineBuilder builder(m_device);
+
+  m_pipeline = builder.addShaderStage(vertShader)
+                   .addShaderStage(fragShader)
+                   .setSampleCount(m_device.getSampleCount())
+                   .reflectLayout()
+                   .setRenderPass(renderPass)
+                   .setVertexInput(Mesh::Layout::getBindingDescriptions(), Mesh::Layout::getAttributeDescriptions())
+                   .setSpecializationConstant(0, Mesh::Layout::octahedralNormals)
+                   .build();
+}
+
+void SimpleRenderSystem::createCullPipeline() {
+  VkDeviceSize batchBufferSize = m_drawCapacity * sizeof(BatchData);
+  std::cout << "Using a batch buffer of size " << batchBufferSize << std::endl;
+  m_batchBuffer.create(batchBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  m_batchBuffer.mapMemory();
+
+  // every slot starts out belonging to no batch, so the shader skips it
+  VkDeviceSize slotBatchBufferSize = m_instanceCapacity * sizeof(uint32_t);
+  m_slotBatchBuffer.create(slotBatchBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, VMA_MEMORY_USAGE_CPU_TO_GPU);
+  m_slotBatchBuffer.mapMemory();
+  std::fill_n(static_cast<uint32_t *>(m_slotBatchBuffer.data()), m_instanceCapacity, 0xffffffff);
+
+  // only ever touched by the gpu, counts and draws are per batch and lod
+  m_batchCountBuffer.create(
+      m_drawCapacity * Mesh::MAX_LOD_COUNT * sizeof(uint32_t),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      0,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+  m_slotLodBuffer.create(
+      m_instanceCapacity * sizeof(uint32_t),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      0,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+  // one range of draws per index buffer, and one draw count each
+  m_indirectBuffer.create(
+      Mesh::INDEX_BUFFER_COUNT * m_drawCapacity * Mesh::MAX_LOD_COUNT * sizeof(DrawCall),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      0,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+  m_drawCountBuffer.create(
+      Mesh::INDEX_BUFFER_COUNT * sizeof(uint32_t),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      0,
+      VMA_MEMORY_USAGE_GPU_ONLY);
+
+  m_occlusionBuffer.create(
+      m_device.padUniformBufferSize(sizeof(OcclusionData)),
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      0,
+      VMA_MEMORY_USAGE_CPU_TO_GPU);
+  m_occlusionBuffer.mapMemory();
+
+  // read back on the cpu, one entry per frame in flight so a finished frame's
+  // counts can be read while the next one is still running
+  VkDeviceSize cullStatsBufferSize = Swapchain::MAX_FRAMES_IN_FLIGHT * sizeof(GpuCullStats);
+  m_cullStatsBuffer.create(
+      cullStatsBufferSize,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      0,
+      VMA_MEMORY_USAGE_GPU_TO_CPU);
+  m_cullStatsBuffer.mapMemory();
+  std::memset(m_cullStatsBuffer.data(), 0, cullStatsBufferSize);
+
+  m_depthPyramid =
+      std::make_unique<DepthPyramid>(m_device, m_fileSystem, m_descriptorCache, Swapchain::MAX_FRAMES_IN_FLIGHT);
+  writeCullDescriptorSet();
+
+  auto cullShader =
+      std::make_shared<ShaderStage>(m_device, m_fileSystem, "shaders/cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+
+  PipelineBuilder pipelineBuilder(m_device);
+  m_cullPipeline = pipelineBuilder.addShaderStage(cullShader).reflectLayout().buildCompute();
+}
+
+void SimpleRenderSystem::writeDescriptorSets() {
+  m_descriptorAllocator.resetPools();
+  m_descriptorSets.clear();
+
   VkDescriptorBufferInfo uniformBufferInfo{};
   uniformBufferInfo.buffer = m_uniformBuffer.buffer;
   uniformBufferInfo.offset = 0;
@@ -127,6 +328,11 @@ SimpleRenderSystem::SimpleRenderSystem(Device &device, MeshLoader &modelLoader,
   primitiveBufferInfo.offset = 0;
   primitiveBufferInfo.range = VK_WHOLE_SIZE;
 
+  VkDescriptorBufferInfo visibleBufferInfo{};
+  visibleBufferInfo.buffer = m_visibleBuffer.buffer;
+  visibleBufferInfo.offset = 0;
+  visibleBufferInfo.range = VK_WHOLE_SIZE;
+
   VkDescriptorBufferInfo lightBufferInfo{};
   lightBufferInfo.buffer = m_lightBuffer.buffer;
   lightBufferInfo.offset = 0;
@@ -160,6 +366,7 @@ SimpleRenderSystem::SimpleRenderSystem(Device &device, MeshLoader &modelLoader,
           &lightBufferInfo,
           VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
           VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT)
+      .bindBuffer(4, &visibleBufferInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
       .build(set0);
 
   DescriptorBuilder::begin(&m_descriptorCache, &m_descriptorAllocator)
@@ -175,60 +382,71 @@ SimpleRenderSystem::SimpleRenderSystem(Device &device, MeshLoader &modelLoader,
   m_descriptorSets.push_back(set1);
 }
 
-SimpleRenderSystem::~SimpleRenderSystem() {
-  m_uniformBuffer.unmapMemory();
-  m_objectBuffer.unmapMemory();
-  m_primitiveBuffer.unmapMemory();
-  m_lightBuffer.unmapMemory();
-  m_materialBuffer.unmapMemory();
-}
-
-void SimpleRenderSystem::createPipelineLayout() {
-  VkPushConstantRange pushConstantRange{};
-  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-  pushConstantRange.offset = 0;
-  pushConstantRange.size = sizeof(SimplePushConstantData);
-
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 0;
-  pipelineLayoutInfo.pSetLayouts = nullptr;
-  pipelineLayoutInfo.pushConstantRangeCount = 1;
-  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-
-  if (vkCreatePipelineLayout(m_device.device(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
-    throw std::runtime_error("Failed to create pipeline layout");
+void SimpleRenderSystem::writeCullDescriptorSet() {
+  m_cullDescriptorAllocator.resetPools();
+
+  std::array<Buffer *, 8> buffers{
+      &m_objectBuffer,
+      &m_primitiveBuffer,
+      &m_batchBuffer,
+      &m_slotBatchBuffer,
+      &m_batchCountBuffer,
+      &m_visibleBuffer,
+      &m_indirectBuffer,
+      &m_drawCountBuffer};
+  std::array<VkDescriptorBufferInfo, 8> bufferInfos{};
+  DescriptorBuilder builder = DescriptorBuilder::begin(&m_descriptorCache, &m_cullDescriptorAllocator);
+  for (uint32_t i = 0; i < buffers.size(); i++) {
+    bufferInfos[i].buffer = buffers[i]->buffer;
+    bufferInfos[i].offset = 0;
+    bufferInfos[i].range = VK_WHOLE_SIZE;
+    builder.bindBuffer(i, &bufferInfos[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
   }
-}
 
-void SimpleRenderSystem::createPipeline(VkRenderPass renderPass) {
+  VkDescriptorBufferInfo occlusionBufferInfo{};
+  occlusionBufferInfo.buffer = m_occlusionBuffer.buffer;
+  occlusionBufferInfo.offset = 0;
+  occlusionBufferInfo.range = VK_WHOLE_SIZE;
 
-  auto vertShader = std::make_shared<ShaderStage>(m_device, "shaders/simple.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-  auto fragShader = std::make_shared<ShaderStage>(m_device, "shaders/pbr.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+  VkDescriptorImageInfo pyramidInfo = m_depthPyramid->descriptorInfo();
 
-  PipelineBuilder builder(m_device);
+  VkDescriptorBufferInfo cullStatsBufferInfo{};
+  cullStatsBufferInfo.buffer = m_cullStatsBuffer.buffer;
+  cullStatsBufferInfo.offset = 0;
+  cullStatsBufferInfo.range = VK_WHOLE_SIZE;
 
-  m_pipeline = builder.addShaderStage(vertShader)
-                   .addShaderStage(fragShader)
-                   .setSampleCount(m_device.getSampleCount())
-                   .reflectLayout()
-                   .setRenderPass(renderPass)
-                   .setVertexInput(Mesh::Vertex::getBindingDescriptions(), Mesh::Vertex::getAttributeDescriptions())
-                   .build();
+  VkDescriptorBufferInfo slotLodBufferInfo{};
+  slotLodBufferInfo.buffer = m_slotLodBuffer.buffer;
+  slotLodBufferInfo.offset = 0;
+  slotLodBufferInfo.range = VK_WHOLE_SIZE;
+
+  builder.bindBuffer(8, &occlusionBufferInfo, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+      .bindImage(9, &pyramidInfo, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+      .bindBuffer(10, &cullStatsBufferInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+      .bindBuffer(11, &slotLodBufferInfo, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+      .build(m_cullDescriptorSet);
 }
 
-void SimpleRenderSystem::renderGameObjects(
+void SimpleRenderSystem::prepareFrame(
     VkCommandBuffer cmd,
-    std::vector<GameObject> &gameObjects,
-    const Camera &camera) {
+    const Camera &camera,
+    uint32_t frameIndex,
+    VkImageView previousDepth,
+    VkExtent2D depthExtent) {
   m_timer.update();
-  m_pipeline->bind(cmd);
-
-  m_modelLoader.bindBuffers(cmd);
+  // has to happen before the scene reads any primitive
+  m_modelLoader.advanceFrame();
+
+  if (m_gpuCulling) {
+    // the command buffer for this frame index has finished, so have its counts
+    VkDeviceSize offset = frameIndex * sizeof(GpuCullStats);
+    vmaInvalidateAllocation(m_device.getAllocator(), m_cullStatsBuffer.allocation, offset, sizeof(GpuCullStats));
+    std::memcpy(&m_gpuCullStats, (uint8_t *)m_cullStatsBuffer.data() + offset, sizeof(GpuCullStats));
+  }
 
-  uint32_t totalObjectCount = static_cast<uint32_t>(m_scene.gameObjects().size());
-  assert(totalObjectCount <= MAX_INSTANCE_COUNT && "Tried to draw more than the maximum number of instances");
-  uint32_t uniformDataSize = sizeof(UniformData) + sizeof(PerObjectData) * totalObjectCount;
+  ObjectStore &objects = m_scene.objects();
+  uint32_t totalObjectCount = static_cast<uint32_t>(objects.size());
+  reserve(totalObjectCount, 0, 0);
 
   UniformData *uniform = (UniformData *)m_uniformBuffer.data();
   uniform->view = camera.getView();
@@ -236,38 +454,316 @@ void SimpleRenderSystem::renderGameObjects(
   uniform->viewproj = uniform->proj * uniform->view;
   uniform->cameraPosition = camera.position();
 
-  ObjectData *data = (ObjectData *)m_objectBuffer.data();
-
-  PrimitiveData *primitiveData = (PrimitiveData *)m_primitiveBuffer.data();
+  PerObjectData *objectData = (PerObjectData *)m_objectBuffer.data();
 
-  uint32_t numberOfPrimitives = 0;
+  // the object buffer is persistently mapped, so only objects that moved
+  // since the last frame need to be written
+  const std::vector<uint32_t> &updated = objects.updateTransforms(m_threadPool);
+  m_threadPool.parallelFor(updated.size(), OBJECT_GRAIN_SIZE, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      uint32_t index = updated[i];
+      objectData[index].model = objects.worldMatrix(index);
+      objectData[index].normalRotation = objects.normalMatrix(index);
+    }
+  });
+
+  // picks up objects added, removed or re-meshed since the last frame, only
+  // the batches and instance slots they change are handed back as touched
+  m_scene.prepare(camera.position());
+  reserve(
+      totalObjectCount,
+      static_cast<uint32_t>(m_scene.instances().size()),
+      static_cast<uint32_t>(m_scene.drawCalls().size()));
+
+  PerPrimitiveData *primitiveData = (PerPrimitiveData *)m_primitiveBuffer.data();
+  BatchData *batchData = (BatchData *)m_batchBuffer.data();
+  uint32_t *slotBatchData = (uint32_t *)m_slotBatchBuffer.data();
+  const std::vector<DrawCall> &drawCalls = m_scene.drawCalls();
+  const std::vector<uint32_t> &drawPrimitives = m_scene.drawPrimitives();
+  const std::vector<uint32_t> &instances = m_scene.instances();
+  const std::vector<uint32_t> &touched = m_scene.touchedDrawCalls();
+  const std::vector<Scene::InstanceRef> &touchedInstances = m_scene.touchedInstances();
+
+  m_threadPool.parallelFor(touched.size(), DRAW_CALL_GRAIN_SIZE, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const DrawCall &dc = drawCalls[touched[i]];
+      const Mesh::Primitive &primitive = m_modelLoader.getPrimitive(drawPrimitives[touched[i]]);
+      BatchData &batch = batchData[touched[i]];
+      batch.command = dc;
+      batch.boundsMin = glm::vec4(primitive.boundsMin, 0.0f);
+      batch.boundsMax = glm::vec4(primitive.boundsMax, 0.0f);
+      batch.lodCount = primitive.lodCount;
+      batch.indexBuffer = primitive.indexBuffer();
+      for (uint32_t lod = 0; lod < primitive.lodCount; lod++) {
+        const Mesh::Lod &source = primitive.lods[lod];
+        batch.lods[lod] = {source.firstIndex, source.indexCount, source.error, 0};
+      }
+    }
+  });
+
+  m_threadPool.parallelFor(touchedInstances.size(), OBJECT_GRAIN_SIZE, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const Scene::InstanceRef &ref = touchedInstances[i];
+      const Mesh::Primitive &primitive = m_modelLoader.getPrimitive(drawPrimitives[ref.drawCall]);
+      PerPrimitiveData &data = primitiveData[ref.instance];
+      data.positionOffset = primitive.quantization.offset;
+      data.parentObject = instances[ref.instance];
+      data.positionScale = primitive.quantization.scale;
+      data.material = primitive.material;
+      slotBatchData[ref.instance] = ref.drawCall;
+    }
+  });
 
-  for (uint32_t i = 0; i < totalObjectCount; i++) {
-    GameObject obj = m_scene.gameObjects()[i];
+  // the bvh is kept up to date either way, picking and radius queries use it
+  m_scene.updateBounds(updated, m_threadPool);
+  m_scene.clearTouched();
 
-    for (uint32_t j = 0; j < obj.mesh.primitiveCount; j++) {
-      primitiveData->primitives[numberOfPrimitives].parentObject = i;
-      Mesh::Primitive currentPrimitive = m_modelLoader.getPrimitive(obj.mesh.firstPrimitive + j);
-      primitiveData->primitives[numberOfPrimitives].material = currentPrimitive.material;
+  // how many pixels one unit at a distance of 1 covers, over the error a lod is allowed
+  float lodScale = 0.0f;
+  if (m_lodEnabled) {
+    lodScale = uniform->proj[1][1] * 0.5f * static_cast<float>(depthExtent.height) / LOD_ERROR_PIXELS;
+  }
 
-      numberOfPrimitives++;
+  if (m_gpuCulling) {
+    // the depth pyramid comes from the last frame, so instances are tested
+    // against it with the camera that frame was rendered with
+    bool occlusion = previousDepth != VK_NULL_HANDLE;
+    if (occlusion) {
+      if (m_depthPyramid->resize(depthExtent)) {
+        writeCullDescriptorSet();
+      }
+      m_depthPyramid->build(cmd, frameIndex, previousDepth, m_device.getSampleCount());
     }
-
-    data->objects[i].model = obj.transform.mat4();
-    data->objects[i].normalRotation = glm::transpose(glm::inverse(data->objects[i].model));
+    recordCulling(cmd, camera, frameIndex, occlusion, lodScale);
+  } else {
+    // instances are culled against the camera on the cpu, the draw calls only
+    // cover the visible ones and look their instance slot up in the visible buffer
+    m_scene.cull(camera.frustum(), camera.position(), lodScale);
+
+    uint32_t *visibleData = (uint32_t *)m_visibleBuffer.data();
+    const std::vector<uint32_t> &visible = m_scene.visibleInstances();
+    m_threadPool.parallelFor<uint32_t>(visible.size(), VISIBLE_GRAIN_SIZE, [&](size_t begin, size_t end) {
+      std::copy(visible.begin() + begin, visible.begin() + end, visibleData + begin);
+    });
   }
 
   LightData *lightData = (LightData *)m_lightBuffer.data();
-  lightData->numLights = static_cast<uint32_t>(m_scene.lights().size());
-  for (size_t i = 0; i < m_scene.lights().size(); i++) {
-    lightData->lights[i] = m_scene.lights()[i];
-  }
+  const std::vector<PointLight> &lights = m_scene.lights();
+  lightData->numLights = static_cast<uint32_t>(lights.size());
+  m_threadPool.parallelFor<PointLight>(lights.size(), LIGHT_GRAIN_SIZE, [&](size_t begin, size_t end) {
+    std::copy(lights.begin() + begin, lights.begin() + end, lightData->lights + begin);
+  });
 
   MaterialData *materialData = (MaterialData *)m_materialBuffer.data();
-  for (size_t i = 0; i < m_modelLoader.materials.size(); i++) {
-    materialData->material[i] = m_modelLoader.materials[i];
+  const std::vector<Material> &materials = m_modelLoader.materials;
+  m_threadPool.parallelFor<Material>(materials.size(), MATERIAL_GRAIN_SIZE, [&](size_t begin, size_t end) {
+    std::copy(materials.begin() + begin, materials.begin() + end, materialData->material + begin);
+  });
+
+  m_previousViewProjection = uniform->viewproj;
+}
+
+void SimpleRenderSystem::reserve(uint32_t objectCount, uint32_t instanceCount, uint32_t drawCount) {
+  if (objectCount <= m_objectCapacity && instanceCount <= m_instanceCapacity && drawCount <= m_drawCapacity) {
+    return;
+  }
+
+  // the capacities double every time, so this only happens a handful of
+  // times, but earlier frames may still be reading the old buffers
+  vkDeviceWaitIdle(m_device.device());
+
+  if (objectCount > m_objectCapacity) {
+    uint32_t capacity = std::max(objectCount, m_objectCapacity * 2);
+    resizeMappedBuffer(m_objectBuffer, capacity * sizeof(PerObjectData), m_objectCapacity * sizeof(PerObjectData));
+    m_objectCapacity = capacity;
+  }
+
+  if (instanceCount > m_instanceCapacity) {
+    uint32_t capacity = std::max(instanceCount, m_instanceCapacity * 2);
+    resizeMappedBuffer(
+        m_primitiveBuffer,
+        capacity * sizeof(PerPrimitiveData),
+        m_instanceCapacity * sizeof(PerPrimitiveData));
+    resizeMappedBuffer(m_visibleBuffer, capacity * sizeof(uint32_t), 0);
+    // new slots belong to no batch until they're written
+    resizeMappedBuffer(m_slotBatchBuffer, capacity * sizeof(uint32_t), m_instanceCapacity * sizeof(uint32_t));
+    uint32_t *slotBatches = static_cast<uint32_t *>(m_slotBatchBuffer.data());
+    std::fill(slotBatches + m_instanceCapacity, slotBatches + capacity, 0xffffffff);
+    m_slotLodBuffer.destroy();
+    m_slotLodBuffer.create(
+        capacity * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        0,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    m_instanceCapacity = capacity;
   }
 
+  if (drawCount > m_drawCapacity) {
+    uint32_t capacity = std::max(drawCount, m_drawCapacity * 2);
+    resizeMappedBuffer(m_batchBuffer, capacity * sizeof(BatchData), m_drawCapacity * sizeof(BatchData));
+    m_batchCountBuffer.destroy();
+    m_batchCountBuffer.create(
+        capacity * Mesh::MAX_LOD_COUNT * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        0,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    m_indirectBuffer.destroy();
+    m_indirectBuffer.create(
+        Mesh::INDEX_BUFFER_COUNT * capacity * Mesh::MAX_LOD_COUNT * sizeof(DrawCall),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        0,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    m_drawCapacity = capacity;
+  }
+
+  std::cout << "SimpleRenderSystem::reserve(): room for " << m_objectCapacity << " objects, " << m_instanceCapacity
+            << " instances and " << m_drawCapacity << " draw calls" << std::endl;
+  writeDescriptorSets();
+  writeCullDescriptorSet();
+}
+
+void SimpleRenderSystem::recordCulling(
+    VkCommandBuffer cmd,
+    const Camera &camera,
+    uint32_t frameIndex,
+    bool occlusion,
+    float lodScale) {
+  uint32_t slotCount = static_cast<uint32_t>(m_scene.instances().size());
+  uint32_t batchCount = static_cast<uint32_t>(m_scene.drawCalls().size());
+  // every lod of a batch needs a draw of its own
+  uint32_t drawsPerBatch = lodScale > 0.0f ? Mesh::MAX_LOD_COUNT : 1;
+  m_drawCount = batchCount * drawsPerBatch;
+  if (batchCount == 0) {
+    return;
+  }
+
+  OcclusionData *occlusionData = (OcclusionData *)m_occlusionBuffer.data();
+  occlusionData->viewProjection = m_previousViewProjection;
+  VkExtent2D pyramidExtent = m_depthPyramid->extent();
+  occlusionData->pyramidSize =
+      glm::vec2(static_cast<float>(pyramidExtent.width), static_cast<float>(pyramidExtent.height));
+  occlusionData->levelCount = m_depthPyramid->levelCount();
+  occlusionData->enabled = occlusion ? 1 : 0;
+  occlusionData->cameraPosition = camera.position();
+  occlusionData->lodScale = lodScale;
+
+  // the previous frame may still be drawing from the buffers written here
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  vkCmdPipelineBarrier(
+      cmd,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      0,
+      nullptr,
+      0,
+      nullptr,
+      0,
+      nullptr);
+
+  vkCmdFillBuffer(cmd, m_batchCountBuffer.buffer, 0, batchCount * Mesh::MAX_LOD_COUNT * sizeof(uint32_t), 0);
+  vkCmdFillBuffer(cmd, m_drawCountBuffer.buffer, 0, Mesh::INDEX_BUFFER_COUNT * sizeof(uint32_t), 0);
+  vkCmdFillBuffer(cmd, m_cullStatsBuffer.buffer, frameIndex * sizeof(GpuCullStats), sizeof(GpuCullStats), 0);
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(
+      cmd,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+
+  CullPushConstants push{};
+  Frustum frustum = camera.frustum();
+  for (size_t i = 0; i < 6; i++) {
+    push.planes[i] = frustum.plane(i);
+  }
+  push.slotCount = slotCount;
+  push.batchCount = batchCount;
+  // without the count extension every batch gets its draws, empty or not
+  push.compact = m_device.supportsDrawIndirectCount() ? 1 : 0;
+  push.frame = frameIndex;
+  push.drawsPerBatch = drawsPerBatch;
+  push.drawsPerIndexBuffer = m_drawCount;
+  push.indexBufferCount = m_modelLoader.indexBufferCount();
+
+  m_cullPipeline->bind(cmd);
+  vkCmdBindDescriptorSets(
+      cmd,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      m_cullPipeline->layout(),
+      0,
+      1,
+      &m_cullDescriptorSet,
+      0,
+      nullptr);
+
+  push.pass = 0;
+  vkCmdPushConstants(cmd, m_cullPipeline->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+  vkCmdDispatch(cmd, (slotCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(
+      cmd,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+
+  push.pass = 1;
+  vkCmdPushConstants(cmd, m_cullPipeline->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+  vkCmdDispatch(cmd, (batchCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+  vkCmdPipelineBarrier(
+      cmd,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+
+  push.pass = 2;
+  vkCmdPushConstants(cmd, m_cullPipeline->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+  vkCmdDispatch(cmd, (slotCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(
+      cmd,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+}
+
+void SimpleRenderSystem::renderGameObjects(
+    VkCommandBuffer cmd,
+    std::vector<GameObject> &gameObjects,
+    const Camera &camera) {
+  m_pipeline->bind(cmd);
+
   vkCmdBindDescriptorSets(
       cmd,
       VK_PIPELINE_BIND_POINT_GRAPHICS,
@@ -277,7 +773,39 @@ void SimpleRenderSystem::renderGameObjects(
       m_descriptorSets.data(),
       0,
       nullptr);
-  m_scene.draw(cmd);
+
+  if (!m_gpuCulling) {
+    m_scene.draw(cmd);
+    return;
+  }
+
+  // the compute pass wrote one draw per batch and lod, or only the non empty
+  // ones and their count when the device can read the draw count from a buffer.
+  // either way every index buffer has a range of `m_drawCount` draws of its own
+  for (uint32_t indexBuffer = 0; indexBuffer < m_modelLoader.indexBufferCount(); indexBuffer++) {
+    if (!m_modelLoader.hasIndices(indexBuffer)) {
+      continue;
+    }
+    m_modelLoader.bindBuffers(cmd, indexBuffer);
+
+    VkDeviceSize offset = indexBuffer * m_drawCount * sizeof(DrawCall);
+    if (m_device.supportsDrawIndirectCount()) {
+      m_device.cmdDrawIndexedIndirectCount(
+          cmd,
+          m_indirectBuffer.buffer,
+          offset,
+          m_drawCountBuffer.buffer,
+          indexBuffer * sizeof(uint32_t),
+          m_drawCount,
+          sizeof(DrawCall));
+    } else if (m_device.supportsMultiDrawIndirect()) {
+      vkCmdDrawIndexedIndirect(cmd, m_indirectBuffer.buffer, offset, m_drawCount, sizeof(DrawCall));
+    } else {
+      for (uint32_t i = 0; i < m_drawCount; i++) {
+        vkCmdDrawIndexedIndirect(cmd, m_indirectBuffer.buffer, offset + i * sizeof(DrawCall), 1, sizeof(DrawCall));
+      }
+    }
+  }
 }
 
 } // namespace ve
\ No newline at end of file
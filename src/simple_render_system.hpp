@@ -1,12 +1,16 @@
 #pragma once
 
 #include "ve_camera.hpp"
+#include "ve_depth_pyramid.hpp"
 #include "ve_descriptor_builder.hpp"
 #include "ve_device.hpp"
+#include "ve_file_system.hpp"
 #include "ve_game_object.hpp"
 #include "ve_mesh_loader.hpp"
 #include "ve_pipeline.hpp"
 #include "ve_scene.hpp"
+#include "ve_swapchain.hpp"
+#include "ve_thread_pool.hpp"
 #include "ve_timer.hpp"
 
 #include <memory>
@@ -19,21 +23,84 @@ public:
   SimpleRenderSystem(const SimpleRenderSystem &) = delete;
   SimpleRenderSystem &operator=(const SimpleRenderSystem &) = delete;
 
-  SimpleRenderSystem(Device &device, MeshLoader &modelLoader, VkRenderPass renderPass);
+  SimpleRenderSystem(
+      Device &device,
+      FileSystem &fileSystem,
+      MeshLoader &modelLoader,
+      ThreadPool &threadPool,
+      VkRenderPass renderPass);
   ~SimpleRenderSystem();
 
+  // fills the per-frame buffers and culls the scene, with gpu culling this
+  // records a compute pass, so it has to be called outside of the render pass.
+  // `previousDepth` is the depth buffer of the last frame, or VK_NULL_HANDLE
+  // if there isn't one, instances it hides are culled on the gpu
+  void prepareFrame(
+      VkCommandBuffer cmd,
+      const Camera &camera,
+      uint32_t frameIndex,
+      VkImageView previousDepth,
+      VkExtent2D depthExtent);
   void renderGameObjects(VkCommandBuffer cmd, std::vector<GameObject> &gameObjects, const Camera &camera);
 
-  static constexpr uint32_t MAX_INSTANCE_COUNT = 10000;
+  // culling and draw call generation happen in a compute shader if the device
+  // supports indirect draws with a first instance, otherwise on the cpu
+  bool gpuCulling() { return m_gpuCulling; }
+  void setGpuCulling(bool enabled) { m_gpuCulling = enabled && m_device.supportsDrawIndirectFirstInstance(); }
+
+  // picks a simplified lod of every instance's primitive by its size on
+  // screen, both when culling on the cpu and on the gpu
+  bool lodEnabled() { return m_lodEnabled; }
+  void setLodEnabled(bool enabled) { m_lodEnabled = enabled; }
+
+  // culling results of the last frame
+  const Scene::CullStats &cullStats() { return m_scene.lastCullStats(); }
+
+  struct GpuCullStats {
+    uint32_t visible{0};
+    uint32_t frustumCulled{0};
+    uint32_t occlusionCulled{0};
+    uint32_t triangles{0};
+  };
+  // what the compute pass found, read back from a frame that's already
+  // finished, so this lags Swapchain::MAX_FRAMES_IN_FLIGHT frames behind
+  const GpuCullStats &gpuCullStats() { return m_gpuCullStats; }
+
+  // the per object, per instance slot and per draw call buffers start out
+  // this big, and double whenever the scene outgrows them
+  static constexpr uint32_t INITIAL_INSTANCE_CAPACITY = 10000;
+  static constexpr uint32_t INITIAL_DRAW_CAPACITY = 4096;
   static constexpr uint32_t MAX_LIGHT_COUNT = 100;
   static constexpr uint32_t MAX_MATERIAL_COUNT = 1000;
+  // has to match local_size_x in cull.comp
+  static constexpr uint32_t CULL_GROUP_SIZE = 64;
+  // how far in pixels a lod's surface may stray from the full resolution one
+  static constexpr float LOD_ERROR_PIXELS = 1.0f;
+
+  // minimum number of elements handed to one thread when filling the
+  // per-frame buffers, below this the work isn't worth splitting up
+  static constexpr size_t OBJECT_GRAIN_SIZE = 512;
+  static constexpr size_t DRAW_CALL_GRAIN_SIZE = 16;
+  static constexpr size_t LIGHT_GRAIN_SIZE = 256;
+  static constexpr size_t MATERIAL_GRAIN_SIZE = 256;
+  static constexpr size_t VISIBLE_GRAIN_SIZE = 4096;
 
 private:
   void createPipelineLayout();
   void createPipeline(VkRenderPass renderPass);
+  void createCullPipeline();
+  void writeDescriptorSets();
+  void writeCullDescriptorSet();
+  // makes room for at least this many objects, instance slots and draw
+  // calls. growing waits for the device to go idle, since frames in flight
+  // still use the old buffers
+  void reserve(uint32_t objectCount, uint32_t instanceCount, uint32_t drawCount);
+  void recordCulling(VkCommandBuffer cmd, const Camera &camera, uint32_t frameIndex, bool occlusion, float lodScale);
 
   Device &m_device;
+  FileSystem &m_fileSystem;
   MeshLoader &m_modelLoader;
+  ThreadPool &m_threadPool;
   DescriptorLayoutCache m_descriptorCache;
   DescriptorAllocator m_descriptorAllocator;
   Timer m_timer{};
@@ -42,11 +109,36 @@ private:
   std::vector<VkDescriptorSet> m_descriptorSets;
   Buffer m_uniformBuffer;
   Buffer m_primitiveBuffer;
+  Buffer m_visibleBuffer;
   Buffer m_objectBuffer;
   Buffer m_lightBuffer;
   Buffer m_materialBuffer;
+  uint32_t m_objectCapacity{INITIAL_INSTANCE_CAPACITY};
+  uint32_t m_instanceCapacity{INITIAL_INSTANCE_CAPACITY};
+  uint32_t m_drawCapacity{INITIAL_DRAW_CAPACITY};
+
+  // gpu culling
+  Buffer m_batchBuffer;
+  Buffer m_slotBatchBuffer;
+  Buffer m_slotLodBuffer;
+  Buffer m_batchCountBuffer;
+  Buffer m_indirectBuffer;
+  Buffer m_drawCountBuffer;
+  Buffer m_occlusionBuffer;
+  Buffer m_cullStatsBuffer;
+  // the cull set points at the depth pyramid, so it's rewritten whenever that's resized
+  DescriptorAllocator m_cullDescriptorAllocator;
+  VkDescriptorSet m_cullDescriptorSet;
+  std::unique_ptr<DepthPyramid> m_depthPyramid;
+  glm::mat4 m_previousViewProjection{1.0f};
+  GpuCullStats m_gpuCullStats{};
+  bool m_gpuCulling{false};
+  bool m_lodEnabled{true};
+  // number of draws the last culling pass wrote at most
+  uint32_t m_drawCount{0};
 
   std::unique_ptr<Pipeline> m_pipeline;
+  std::unique_ptr<Pipeline> m_cullPipeline;
   VkPipelineLayout m_pipelineLayout;
 };
 
@@ -0,0 +1,651 @@
+// ve-bench: micro-benchmarks of the engine's hot paths on synthetic scenes,
+// so they run without any assets.
+//
+//   ve-bench [section...]
+//
+// runs every section that doesn't need a gpu when none are named, the others
+// only run when they are. every time is the best of a few runs, so it's what
+// the code costs without the noise of everything else running on the machine
+
+#include "ve_buffer.hpp"
+#include "ve_bvh.hpp"
+#include "ve_device.hpp"
+#include "ve_frustum.hpp"
+#include "ve_game_object.hpp"
+#include "ve_gltf_loader.hpp"
+#include "ve_object_store.hpp"
+#include "ve_thread_pool.hpp"
+#include "ve_upload_context.hpp"
+#include "ve_window.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int RUNS = 5;
+constexpr int COLUMN_WIDTH = 20;
+
+const std::vector<size_t> SCENE_SIZES = {1000, 10000, 100000};
+const std::vector<size_t> LARGE_SCENE_SIZES = {100000, 1000000};
+const std::vector<size_t> BVH_SCENE_SIZES = {10000, 100000, 1000000};
+constexpr size_t QUERY_COUNT = 1000;
+constexpr size_t CHURN_LIVE_COUNT = 100000;
+constexpr size_t CHURN_PER_ROUND = 1000;
+const std::vector<size_t> CHURN_REPORTS = {1, 10, 100, 1000};
+constexpr VkDeviceSize UPLOAD_BYTES = VkDeviceSize{64} << 20;
+const std::vector<VkDeviceSize> UPLOAD_PIECE_SIZES = {
+    VkDeviceSize{64} << 10,
+    VkDeviceSize{1} << 20,
+    VkDeviceSize{16} << 20};
+const std::vector<size_t> GLTF_VERTEX_COUNTS = {1000000, 4000000};
+
+// as in SimpleRenderSystem
+constexpr size_t OBJECT_GRAIN_SIZE = 512;
+
+// read by nothing, written by every benchmark so the compiler can't drop
+// work whose results are never used
+volatile float g_sink = 0.0f;
+
+// the fastest of `RUNS` calls of `fn`, in milliseconds. `setup` runs before
+// every call and isn't timed
+double bestOf(const std::function<void()> &setup, const std::function<void()> &fn) {
+  double best = 0.0;
+  for (int run = 0; run < RUNS; run++) {
+    setup();
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    best = run == 0 ? elapsed : std::min(best, elapsed);
+  }
+  return best;
+}
+
+double bestOf(const std::function<void()> &fn) {
+  return bestOf([]() {}, fn);
+}
+
+std::string format(double value, const char *unit, int precision = 3) {
+  std::ostringstream text;
+  text << std::fixed << std::setprecision(precision) << value << unit;
+  return text.str();
+}
+
+void printRow(const std::vector<std::string> &cells) {
+  for (const std::string &cell : cells) {
+    std::cout << std::setw(COLUMN_WIDTH) << cell;
+  }
+  std::cout << std::endl;
+}
+
+glm::vec3 randomVec3(std::mt19937 &random, float min, float max) {
+  std::uniform_real_distribution<float> distribution(min, max);
+  return {distribution(random), distribution(random), distribution(random)};
+}
+
+// what the object buffer holds for every object
+struct ObjectData {
+  glm::mat4 model;
+  glm::mat4 normalRotation;
+};
+
+// a frame's pass over every object, the way the render system made it over a
+// std::vector<GameObject> and the way it makes it over the object store.
+// reading is one field of every object, writing fills the object buffer,
+// which the store only does for objects that moved
+void benchObjects() {
+  std::cout << "objects: per frame, one thread" << std::endl;
+  printRow({"objects", "read, vector", "read, store", "write, vector", "write, all moved", "write, 1% moved"});
+
+  ve::ThreadPool threadPool{1};
+  for (size_t count : SCENE_SIZES) {
+    std::mt19937 random{1};
+    std::vector<ve::GameObject> gameObjects;
+    ve::ObjectStore store;
+    std::vector<ve::ObjectHandle> handles;
+    store.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      ve::GameObject object = ve::GameObject::createGameObject();
+      object.transform.translation = randomVec3(random, -100.0f, 100.0f);
+      object.transform.rotation = randomVec3(random, 0.0f, 6.0f);
+      object.transform.scale = randomVec3(random, 0.5f, 2.0f);
+      gameObjects.push_back(object);
+      handles.push_back(
+          store.create(ve::Mesh{}, object.transform.translation, object.transform.rotation, object.transform.scale));
+    }
+    std::vector<ObjectData> objectData(count);
+
+    double legacyRead = bestOf([&]() {
+      glm::vec3 sum(0.0f);
+      for (size_t i = 0; i < gameObjects.size(); i++) {
+        ve::GameObject object = gameObjects[i];
+        sum += object.transform.translation;
+      }
+      g_sink = g_sink + sum.x;
+    });
+    double storeRead = bestOf([&]() {
+      glm::vec3 sum(0.0f);
+      for (const glm::vec3 &translation : store.translations()) {
+        sum += translation;
+      }
+      g_sink = g_sink + sum.x;
+    });
+
+    double legacyWrite = bestOf([&]() {
+      for (size_t i = 0; i < gameObjects.size(); i++) {
+        ve::GameObject object = gameObjects[i];
+        objectData[i].model = object.transform.mat4();
+        objectData[i].normalRotation = glm::transpose(glm::inverse(objectData[i].model));
+      }
+    });
+
+    // moving objects is game logic, either layout pays for it the same way
+    auto move = [&](size_t step) {
+      return [&, step]() {
+        for (size_t i = 0; i < count; i += step) {
+          store.setTranslation(handles[i], store.translations()[store.indexOf(handles[i])] + glm::vec3(0.01f));
+        }
+      };
+    };
+    auto write = [&]() {
+      const std::vector<uint32_t> &updated = store.updateTransforms(threadPool);
+      for (uint32_t index : updated) {
+        objectData[index].model = store.worldMatrix(index);
+        objectData[index].normalRotation = store.normalMatrix(index);
+      }
+    };
+    double allMoved = bestOf(move(1), write);
+    double someMoved = bestOf(move(100), write);
+    g_sink = g_sink + objectData[count / 2].model[3][0];
+
+    printRow(
+        {std::to_string(count),
+         format(legacyRead, " ms"),
+         format(storeRead, " ms"),
+         format(legacyWrite, " ms"),
+         format(allMoved, " ms"),
+         format(someMoved, " ms")});
+  }
+}
+
+// 1, 2, 4 and so on up to one thread per hardware thread, and that one too
+std::vector<uint32_t> threadCounts() {
+  uint32_t hardware = std::max(std::thread::hardware_concurrency(), 1u);
+  std::vector<uint32_t> counts;
+  for (uint32_t count = 1; count < hardware; count *= 2) {
+    counts.push_back(count);
+  }
+  counts.push_back(hardware);
+  return counts;
+}
+
+// the object part of a frame with every object moving: matrices recomputed
+// by the object store and copied into the object buffer, both split over the
+// thread pool the way the render system does it
+void benchInstances() {
+  std::cout << "instances: filling the object buffer with every object moved, per frame" << std::endl;
+  printRow({"objects", "threads", "time", "speedup"});
+
+  for (size_t count : LARGE_SCENE_SIZES) {
+    std::mt19937 random{1};
+    ve::ObjectStore store;
+    std::vector<ve::ObjectHandle> handles;
+    store.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      handles.push_back(store.create(
+          ve::Mesh{},
+          randomVec3(random, -100.0f, 100.0f),
+          randomVec3(random, 0.0f, 6.0f),
+          randomVec3(random, 0.5f, 2.0f)));
+    }
+    std::vector<ObjectData> objectData(count);
+
+    double oneThread = 0.0;
+    for (uint32_t threads : threadCounts()) {
+      ve::ThreadPool threadPool{threads};
+      double time = bestOf(
+          [&]() {
+            for (ve::ObjectHandle handle : handles) {
+              store.setTranslation(handle, store.translations()[store.indexOf(handle)] + glm::vec3(0.01f));
+            }
+          },
+          [&]() {
+            const std::vector<uint32_t> &updated = store.updateTransforms(threadPool);
+            threadPool.parallelFor(updated.size(), OBJECT_GRAIN_SIZE, 1, [&](size_t begin, size_t end) {
+              for (size_t i = begin; i < end; i++) {
+                uint32_t index = updated[i];
+                objectData[index].model = store.worldMatrix(index);
+                objectData[index].normalRotation = store.normalMatrix(index);
+              }
+            });
+          });
+      g_sink = g_sink + objectData[count / 2].model[3][0];
+      oneThread = threads == 1 ? time : oneThread;
+
+      printRow({std::to_string(count), std::to_string(threads), format(time, " ms"), format(oneThread / time, "x", 2)});
+    }
+  }
+}
+
+// unit boxes spread evenly through a cube that grows with their number, so
+// a query of the same size finds about as many of them at every scene size
+ve::BoundsArray randomBoxes(size_t count, float &side, std::mt19937 &random) {
+  side = 10.0f * std::cbrt(static_cast<float>(count));
+  ve::BoundsArray bounds;
+  bounds.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    glm::vec3 center = randomVec3(random, 0.0f, side);
+    bounds.set(i, center - glm::vec3(0.5f), center + glm::vec3(0.5f));
+  }
+  return bounds;
+}
+
+// building and querying the bvh at growing scene sizes. the queries look at
+// the same amount of space every time, so what they cost should barely grow
+// with the scene, unlike testing every box against the frustum
+void benchBvh() {
+  std::cout << "bvh: build per scene, insert and queries per call, " << QUERY_COUNT << " rays and spheres"
+            << std::endl;
+  printRow({"objects", "build", "insert", "frustum, bvh", "frustum, all", "ray", "sphere"});
+
+  ve::ThreadPool threadPool;
+  for (size_t count : BVH_SCENE_SIZES) {
+    std::mt19937 random{1};
+    float side;
+    ve::BoundsArray bounds = randomBoxes(count, side, random);
+    glm::vec3 center(side * 0.5f);
+
+    ve::Bvh bvh;
+    double build = bestOf([&]() { bvh.build(bounds, threadPool); });
+
+    // the last 1% of the boxes go in one at a time, on top of a tree built from the rest
+    size_t built = count - count / 100;
+    ve::BoundsArray first;
+    first.resize(built);
+    for (size_t i = 0; i < built; i++) {
+      first.set(
+          i,
+          glm::vec3(bounds.minX[i], bounds.minY[i], bounds.minZ[i]),
+          glm::vec3(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]));
+    }
+    ve::Bvh inserted;
+    double insert = bestOf(
+        [&]() { inserted.build(first, threadPool); },
+        [&]() {
+          for (size_t i = built; i < count; i++) {
+            inserted.insert(
+                static_cast<uint32_t>(i),
+                glm::vec3(bounds.minX[i], bounds.minY[i], bounds.minZ[i]),
+                glm::vec3(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]));
+          }
+        });
+
+    // a camera in the middle of the scene that sees 50 units far
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 50.0f);
+    glm::mat4 view = glm::lookAt(center, center + glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    ve::Frustum frustum{projection * view};
+    std::vector<uint32_t> items;
+    double bvhCull = bestOf([&]() {
+      items.clear();
+      bvh.cull(frustum, items);
+    });
+    std::vector<uint8_t> visible(count);
+    double bruteCull = bestOf([&]() { g_sink = g_sink + frustum.cull(bounds, 0, count, visible.data()); });
+
+    std::vector<glm::vec3> origins;
+    std::vector<glm::vec3> directions;
+    for (size_t i = 0; i < QUERY_COUNT; i++) {
+      origins.push_back(randomVec3(random, 0.0f, side));
+      directions.push_back(randomVec3(random, -1.0f, 1.0f));
+    }
+    double ray = bestOf([&]() {
+      for (size_t i = 0; i < QUERY_COUNT; i++) {
+        float distance;
+        g_sink = g_sink + static_cast<float>(bvh.raycast(origins[i], directions[i], 50.0f, distance));
+      }
+    });
+    double sphere = bestOf([&]() {
+      for (size_t i = 0; i < QUERY_COUNT; i++) {
+        items.clear();
+        bvh.queryRadius(origins[i], 10.0f, items);
+      }
+    });
+
+    printRow(
+        {std::to_string(count),
+         format(build, " ms"),
+         format(insert * 1000.0 / (count - built), " us"),
+         format(bvhCull, " ms"),
+         format(bruteCull, " ms"),
+         format(ray * 1000.0 / QUERY_COUNT, " us"),
+         format(sphere * 1000.0 / QUERY_COUNT, " us")});
+  }
+}
+
+// destroying random objects and creating as many new ones, round after
+// round. ids get reused and the arrays stay packed, so neither the memory
+// nor what an operation costs should grow however long it goes on
+void benchChurn() {
+  std::cout << "churn: " << CHURN_LIVE_COUNT << " live objects, " << CHURN_PER_ROUND
+            << " destroyed and created per round, averaged since the previous row" << std::endl;
+  printRow({"rounds", "destroy + create", "ids", "array capacity"});
+
+  std::mt19937 random{1};
+  std::uniform_int_distribution<size_t> pick(0, CHURN_LIVE_COUNT - 1);
+  ve::ThreadPool threadPool{1};
+  ve::ObjectStore store;
+  auto spawn = [&]() {
+    return store.create(ve::Mesh{}, randomVec3(random, -100.0f, 100.0f), glm::vec3(0.0f), glm::vec3(1.0f));
+  };
+  std::vector<ve::ObjectHandle> handles;
+  for (size_t i = 0; i < CHURN_LIVE_COUNT; i++) {
+    handles.push_back(spawn());
+  }
+  store.updateTransforms(threadPool);
+
+  size_t round = 0;
+  for (size_t report : CHURN_REPORTS) {
+    double elapsed = 0.0;
+    size_t rounds = report - round;
+    for (; round < report; round++) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < CHURN_PER_ROUND; i++) {
+        size_t victim = pick(random);
+        store.destroy(handles[victim]);
+        handles[victim] = spawn();
+      }
+      elapsed += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      // what a frame does with the objects that moved in the dense arrays
+      store.updateTransforms(threadPool);
+    }
+
+    printRow(
+        {std::to_string(report),
+         format(elapsed / (rounds * CHURN_PER_ROUND), " ns", 1),
+         std::to_string(store.idCount()),
+         std::to_string(store.translations().capacity())});
+  }
+}
+
+// appends `size` bytes to the model's only buffer as a buffer view and an
+// accessor of `count` elements, tightly packed
+int addAccessor(tinygltf::Model &model, const void *data, size_t size, size_t count, int type, int componentType) {
+  tinygltf::Buffer &buffer = model.buffers[0];
+  tinygltf::BufferView view;
+  view.buffer = 0;
+  view.byteOffset = buffer.data.size();
+  view.byteLength = size;
+  buffer.data.resize(buffer.data.size() + size);
+  std::memcpy(buffer.data.data() + view.byteOffset, data, size);
+  model.bufferViews.push_back(view);
+
+  tinygltf::Accessor accessor;
+  accessor.bufferView = static_cast<int>(model.bufferViews.size()) - 1;
+  accessor.count = count;
+  accessor.type = type;
+  accessor.componentType = componentType;
+  model.accessors.push_back(accessor);
+  return static_cast<int>(model.accessors.size()) - 1;
+}
+
+// one node with one primitive of `vertexCount` vertices with positions,
+// normals and texture coordinates, and as many 32 bit indices
+tinygltf::Model syntheticModel(size_t vertexCount, std::mt19937 &random) {
+  std::vector<glm::vec3> positions(vertexCount);
+  std::vector<glm::vec3> normals(vertexCount);
+  std::vector<glm::vec2> uvs(vertexCount);
+  std::vector<uint32_t> indices(vertexCount);
+  std::uniform_int_distribution<uint32_t> pick(0, static_cast<uint32_t>(vertexCount) - 1);
+  for (size_t v = 0; v < vertexCount; v++) {
+    positions[v] = randomVec3(random, -1.0f, 1.0f);
+    normals[v] = randomVec3(random, -1.0f, 1.0f);
+    uvs[v] = glm::vec2(randomVec3(random, 0.0f, 1.0f));
+    indices[v] = pick(random);
+  }
+
+  tinygltf::Model model;
+  model.buffers.resize(1);
+  tinygltf::Primitive primitive;
+  primitive.attributes["POSITION"] = addAccessor(
+      model,
+      positions.data(),
+      vertexCount * sizeof(glm::vec3),
+      vertexCount,
+      TINYGLTF_TYPE_VEC3,
+      TINYGLTF_COMPONENT_TYPE_FLOAT);
+  model.accessors.back().minValues = {-1.0, -1.0, -1.0};
+  model.accessors.back().maxValues = {1.0, 1.0, 1.0};
+  primitive.attributes["NORMAL"] = addAccessor(
+      model,
+      normals.data(),
+      vertexCount * sizeof(glm::vec3),
+      vertexCount,
+      TINYGLTF_TYPE_VEC3,
+      TINYGLTF_COMPONENT_TYPE_FLOAT);
+  primitive.attributes["TEXCOORD_0"] = addAccessor(
+      model,
+      uvs.data(),
+      vertexCount * sizeof(glm::vec2),
+      vertexCount,
+      TINYGLTF_TYPE_VEC2,
+      TINYGLTF_COMPONENT_TYPE_FLOAT);
+  primitive.indices = addAccessor(
+      model,
+      indices.data(),
+      vertexCount * sizeof(uint32_t),
+      vertexCount,
+      TINYGLTF_TYPE_SCALAR,
+      TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT);
+
+  tinygltf::Mesh mesh;
+  mesh.primitives.push_back(primitive);
+  model.meshes.push_back(mesh);
+  tinygltf::Node node;
+  node.mesh = 0;
+  model.nodes.push_back(node);
+  return model;
+}
+
+// the primitive's vertices and indices the way glTF::Model::loadNode
+// converted them before it did it in bulk: a vertex at a time, pushed back
+void convertPerVertex(
+    const tinygltf::Model &model,
+    std::vector<ve::Mesh::IndexType> &indexBuffer,
+    std::vector<ve::Mesh::Vertex> &vertexBuffer) {
+  const tinygltf::Primitive &primitive = model.meshes[0].primitives[0];
+  auto attribute = [&](const char *name) {
+    const tinygltf::Accessor &accessor = model.accessors[primitive.attributes.at(name)];
+    const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
+    return reinterpret_cast<const float *>(&model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]);
+  };
+  const float *bufferPos = attribute("POSITION");
+  const float *bufferNormals = attribute("NORMAL");
+  const float *bufferTexCoordSet0 = attribute("TEXCOORD_0");
+  size_t vertexCount = model.accessors[primitive.attributes.at("POSITION")].count;
+  uint32_t vertexStart = static_cast<uint32_t>(vertexBuffer.size());
+  for (size_t v = 0; v < vertexCount; v++) {
+    ve::Mesh::Vertex vert{};
+    vert.position = glm::make_vec3(&bufferPos[v * 3]);
+    vert.position.y *= -1;
+    vert.normal = glm::normalize(glm::make_vec3(&bufferNormals[v * 3]));
+    vert.normal.y *= -1;
+    vert.uv0 = glm::make_vec2(&bufferTexCoordSet0[v * 2]);
+    vert.uv1 = glm::vec2(0.0f);
+    vertexBuffer.push_back(vert);
+  }
+
+  const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
+  const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
+  const uint32_t *buf =
+      reinterpret_cast<const uint32_t *>(&model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]);
+  for (size_t index = 0; index < accessor.count; index++) {
+    indexBuffer.push_back(buf[index] + vertexStart);
+  }
+}
+
+// converting a glTF primitive of a few million vertices into the engine's
+// vertex and index buffers, a vertex at a time the way it used to be done
+// and in bulk the way glTF::Model::loadNode does it now. both start from
+// empty buffers, as loading a model does. parsing the file isn't part of it,
+// the model is built in memory
+void benchGltf() {
+  std::cout << "gltf: converting one primitive with positions, normals, uvs and 32 bit indices" << std::endl;
+  printRow({"vertices", "per vertex", "bulk", "speedup", "bulk throughput"});
+
+  for (size_t vertexCount : GLTF_VERTEX_COUNTS) {
+    std::mt19937 random{1};
+    tinygltf::Model gltfModel = syntheticModel(vertexCount, random);
+
+    std::vector<ve::Mesh::IndexType> indexBuffer;
+    std::vector<ve::Mesh::Vertex> vertexBuffer;
+    double perVertex = bestOf(
+        [&]() {
+          indexBuffer = std::vector<ve::Mesh::IndexType>();
+          vertexBuffer = std::vector<ve::Mesh::Vertex>();
+        },
+        [&]() { convertPerVertex(gltfModel, indexBuffer, vertexBuffer); });
+    g_sink = g_sink + vertexBuffer[vertexCount / 2].normal.x;
+
+    // loadFromFile reserves everything before it converts, and loadNode logs every mesh
+    ve::glTF::Model model;
+    std::streambuf *out = std::cout.rdbuf(nullptr);
+    double bulk = bestOf(
+        [&]() {
+          model.indexBuffer = std::vector<ve::Mesh::IndexType>();
+          model.vertexBuffer = std::vector<ve::Mesh::Vertex>();
+          model.indexBuffer.reserve(vertexCount);
+          model.vertexBuffer.reserve(vertexCount);
+        },
+        [&]() {
+          model.loadNode(nullptr, gltfModel.nodes[0], 0, gltfModel, model.indexBuffer, model.vertexBuffer, 1.0f);
+        });
+    std::cout.rdbuf(out);
+    g_sink = g_sink + model.vertexBuffer[vertexCount / 2].normal.x;
+
+    printRow(
+        {std::to_string(vertexCount),
+         format(perVertex, " ms"),
+         format(bulk, " ms"),
+         format(perVertex / bulk, "x", 2),
+         format(vertexCount / (bulk * 1000.0), " Mvert/s", 0)});
+  }
+}
+
+// staging memory of its own and a queue round trip for every piece, the way
+// buffers were uploaded before there was an UploadContext
+void uploadOneShot(ve::Device &device, uint8_t *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset) {
+  ve::Buffer staging{device.getAllocator()};
+  staging.create(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 0);
+  staging.write(data, size);
+  device.copyBuffer(staging.buffer, dstBuffer, size, 0, dstOffset);
+}
+
+// uploading the same bytes into a gpu buffer in pieces of different sizes,
+// one piece at a time through the device and all of them in batches through
+// the staging ring, until the last one is on the gpu
+void benchUpload() {
+  std::cout << "upload: " << (UPLOAD_BYTES >> 20) << " MB into one gpu buffer" << std::endl;
+  printRow({"piece size", "pieces", "one shot", "upload context"});
+
+  ve::Window window{64, 64, "ve-bench"};
+  ve::Device device{window};
+  ve::UploadContext uploadContext{device};
+  ve::Buffer destination{device.getAllocator()};
+  destination.create(
+      UPLOAD_BYTES,
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      0,
+      VMA_MEMORY_USAGE_GPU_ONLY,
+      uploadContext.sharedQueueFamilies());
+
+  std::mt19937 random{1};
+  std::vector<uint8_t> data(UPLOAD_BYTES);
+  std::generate(data.begin(), data.end(), [&]() { return static_cast<uint8_t>(random()); });
+  auto megabytesPerSecond = [](double milliseconds) {
+    return static_cast<double>(UPLOAD_BYTES >> 20) / (milliseconds / 1000.0);
+  };
+
+  for (VkDeviceSize pieceSize : UPLOAD_PIECE_SIZES) {
+    VkDeviceSize pieces = UPLOAD_BYTES / pieceSize;
+    double oneShot = bestOf([&]() {
+      for (VkDeviceSize i = 0; i < pieces; i++) {
+        uploadOneShot(device, data.data() + i * pieceSize, pieceSize, destination.buffer, i * pieceSize);
+      }
+    });
+    double batched = bestOf([&]() {
+      for (VkDeviceSize i = 0; i < pieces; i++) {
+        uploadContext.uploadBuffer(data.data() + i * pieceSize, pieceSize, destination.buffer, i * pieceSize);
+      }
+      uploadContext.wait(uploadContext.submit());
+    });
+
+    printRow(
+        {std::to_string(pieceSize >> 10) + " KB",
+         std::to_string(pieces),
+         format(megabytesPerSecond(oneShot), " MB/s", 0),
+         format(megabytesPerSecond(batched), " MB/s", 0)});
+  }
+}
+
+struct Section {
+  const char *name;
+  void (*run)();
+  // only run when asked for by name
+  bool needsGpu;
+};
+
+const std::vector<Section> SECTIONS = {
+    {"objects", benchObjects, false},
+    {"instances", benchInstances, false},
+    {"bvh", benchBvh, false},
+    {"churn", benchChurn, false},
+    {"gltf", benchGltf, false},
+    {"upload", benchUpload, true},
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> names(argv + 1, argv + argc);
+  for (const std::string &name : names) {
+    bool known = std::any_of(SECTIONS.begin(), SECTIONS.end(), [&](const Section &section) {
+      return name == section.name;
+    });
+    if (!known) {
+      std::cout << "usage: ve-bench [section...], sections:";
+      for (const Section &section : SECTIONS) {
+        std::cout << " " << section.name << (section.needsGpu ? " (gpu)" : "");
+      }
+      std::cout << std::endl;
+      return name == "--help" || name == "-h" ? 0 : 1;
+    }
+  }
+
+  for (const Section &section : SECTIONS) {
+    bool named = std::find(names.begin(), names.end(), section.name) != names.end();
+    if (named || (names.empty() && !section.needsGpu)) {
+      try {
+        section.run();
+      } catch (const std::exception &e) {
+        std::cerr << "ve-bench: " << section.name << ": " << e.what() << std::endl;
+        return 1;
+      }
+      std::cout << std::endl;
+    }
+  }
+  return 0;
+}
@@ -35,12 +35,18 @@ void Buffer::create(
     VkDeviceSize size,
     VkBufferUsageFlags usage,
     VkMemoryPropertyFlags properties,
-    VmaMemoryUsage vmaUsage /*= VMA_MEMORY_USAGE_CPU_TO_GPU*/) {
+    VmaMemoryUsage vmaUsage /*= VMA_MEMORY_USAGE_CPU_TO_GPU*/,
+    const std::vector<uint32_t> &queueFamilies /*= {}*/) {
   VkBufferCreateInfo bufferInfo{};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
   bufferInfo.usage = usage;
   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (queueFamilies.size() > 1) {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+    bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+  }
 
   VmaAllocationCreateInfo allocInfo{};
   allocInfo.usage = vmaUsage;
@@ -49,4 +55,13 @@ void Buffer::create(
   vmaCreateBuffer(m_allocator, &bufferInfo, &allocInfo, &buffer, &allocation, nullptr);
 }
 
+void Buffer::destroy() {
+  if (m_memoryMapped) {
+    unmapMemory();
+  }
+  vmaDestroyBuffer(m_allocator, buffer, allocation);
+  buffer = VK_NULL_HANDLE;
+  allocation = VK_NULL_HANDLE;
+}
+
 } // namespace ve
\ No newline at end of file
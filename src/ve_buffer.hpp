@@ -4,6 +4,9 @@
 
 #include "vk_mem_alloc/vk_mem_alloc.h"
 
+#include <cstdint>
+#include <vector>
+
 namespace ve {
 
 class Buffer {
@@ -26,11 +29,16 @@ public:
   void *data() { return m_data; }
   void mapMemory();
   void unmapMemory();
+  // with more than one queue family the buffer is shared between them,
+  // otherwise it belongs to the family that uses it first
   void create(
       VkDeviceSize size,
       VkBufferUsageFlags usage,
       VkMemoryPropertyFlags properties,
-      VmaMemoryUsage vmaUsage = VMA_MEMORY_USAGE_CPU_TO_GPU);
+      VmaMemoryUsage vmaUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+      const std::vector<uint32_t> &queueFamilies = {});
+  // frees the buffer so `create()` can be called again
+  void destroy();
 
 private:
   VmaAllocator m_allocator;
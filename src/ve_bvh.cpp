@@ -0,0 +1,647 @@
+#include "ve_bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+
+namespace ve {
+
+namespace {
+
+constexpr size_t GRAIN_SIZE = 4096;
+constexpr float INF = std::numeric_limits<float>::infinity();
+
+float halfArea(glm::vec3 min, glm::vec3 max) {
+  glm::vec3 d = max - min;
+  return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+glm::vec3 boundsMin(const BoundsArray &bounds, size_t i) { return {bounds.minX[i], bounds.minY[i], bounds.minZ[i]}; }
+glm::vec3 boundsMax(const BoundsArray &bounds, size_t i) { return {bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]}; }
+
+// distance along the ray at which it enters the box, INF if it misses it
+float rayBox(glm::vec3 origin, glm::vec3 inverseDirection, glm::vec3 min, glm::vec3 max, float maxDistance) {
+  glm::vec3 t1 = (min - origin) * inverseDirection;
+  glm::vec3 t2 = (max - origin) * inverseDirection;
+  glm::vec3 near = glm::min(t1, t2);
+  glm::vec3 far = glm::max(t1, t2);
+
+  float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+  float exit = std::min(std::min(far.x, far.y), std::min(far.z, maxDistance));
+  return enter <= exit ? enter : INF;
+}
+
+bool sphereBox(glm::vec3 center, float radius, glm::vec3 min, glm::vec3 max) {
+  glm::vec3 closest = glm::clamp(center, min, max);
+  glm::vec3 d = closest - center;
+  return glm::dot(d, d) <= radius * radius;
+}
+
+} // namespace
+
+void Bvh::build(const BoundsArray &bounds, ThreadPool &threadPool) {
+  uint32_t count = static_cast<uint32_t>(bounds.size());
+
+  m_nodes.clear();
+  m_dirtyLeaves.clear();
+  m_freePositions.clear();
+  m_items.resize(count);
+  m_buildItems.resize(count);
+  m_itemPositions.assign(count, NONE);
+  m_itemLeaves.resize(count);
+  m_itemBounds.resize(count);
+  m_areaSum = 0.0f;
+  m_buildCost = 0.0f;
+
+  if (count == 0) {
+    m_parents.clear();
+    m_nodeDirty.clear();
+    return;
+  }
+
+  threadPool.parallelFor(count, GRAIN_SIZE, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      m_buildItems[i] = {boundsMin(bounds, i), static_cast<uint32_t>(i), boundsMax(bounds, i), 0.0f};
+    }
+  });
+
+  Node root{glm::vec3(INF), 0, glm::vec3(-INF), count, 0};
+  for (uint32_t i = 0; i < count; i++) {
+    root.min = glm::min(root.min, boundsMin(bounds, i));
+    root.max = glm::max(root.max, boundsMax(bounds, i));
+  }
+  m_nodes.push_back(root);
+
+  // split the top of the tree on this thread until there are enough
+  // independent subtrees to keep every thread busy
+  size_t targetSubtrees = static_cast<size_t>(threadPool.threadCount()) * 4;
+  std::vector<uint32_t> queue{0};
+  std::vector<uint32_t> subtrees;
+  for (size_t i = 0; i < queue.size(); i++) {
+    uint32_t node = queue[i];
+    size_t pending = queue.size() - i + subtrees.size();
+    if (m_nodes[node].count <= SUBTREE_SIZE || pending >= targetSubtrees) {
+      subtrees.push_back(node);
+      continue;
+    }
+    if (split(m_nodes, node)) {
+      queue.push_back(m_nodes[node].left);
+      queue.push_back(m_nodes[node].left + 1);
+    }
+  }
+
+  // subtrees own disjoint ranges of m_items, so they can be built side by
+  // side, each into its own node array
+  std::vector<std::vector<Node>> subtreeNodes(subtrees.size());
+  threadPool.parallelFor(subtrees.size(), 1, 1, [&](size_t begin, size_t end) {
+    for (size_t s = begin; s < end; s++) {
+      subtreeNodes[s].push_back(m_nodes[subtrees[s]]);
+      buildSubtree(subtreeNodes[s]);
+    }
+  });
+
+  for (size_t s = 0; s < subtrees.size(); s++) {
+    std::vector<Node> &local = subtreeNodes[s];
+    // local node k ends up at offset + k, except for the subtree's root
+    // which replaces the node it was built from
+    uint32_t offset = static_cast<uint32_t>(m_nodes.size()) - 1;
+    for (Node &node : local) {
+      if (!node.isLeaf()) {
+        node.left += offset;
+      }
+    }
+    m_nodes[subtrees[s]] = local[0];
+    m_nodes.insert(m_nodes.end(), local.begin() + 1, local.end());
+  }
+
+  m_parents.assign(m_nodes.size(), NONE);
+  m_nodeDirty.assign(m_nodes.size(), 0);
+  for (uint32_t i = 0; i < static_cast<uint32_t>(m_nodes.size()); i++) {
+    const Node &node = m_nodes[i];
+    if (node.isLeaf()) {
+      std::fill(m_itemLeaves.begin() + node.first, m_itemLeaves.begin() + node.first + node.count, i);
+    } else {
+      m_parents[node.left] = i;
+      m_parents[node.left + 1] = i;
+      m_areaSum += halfArea(node.min, node.max);
+    }
+  }
+
+  threadPool.parallelFor(count, GRAIN_SIZE, 1, [&](size_t begin, size_t end) {
+    for (size_t position = begin; position < end; position++) {
+      const BuildItem &item = m_buildItems[position];
+      m_items[position] = item.id;
+      m_itemPositions[item.id] = static_cast<uint32_t>(position);
+      m_itemBounds.set(position, item.min, item.max);
+    }
+  });
+
+  m_buildCost = cost();
+}
+
+void Bvh::buildSubtree(std::vector<Node> &nodes) {
+  std::vector<uint32_t> stack{0};
+  while (!stack.empty()) {
+    uint32_t node = stack.back();
+    stack.pop_back();
+    if (split(nodes, node)) {
+      stack.push_back(nodes[node].left);
+      stack.push_back(nodes[node].left + 1);
+    }
+  }
+}
+
+bool Bvh::split(std::vector<Node> &nodes, uint32_t nodeIndex) {
+  Node node = nodes[nodeIndex];
+  if (node.count <= MAX_LEAF_SIZE) {
+    return false;
+  }
+
+  BuildItem *items = m_buildItems.data() + node.first;
+
+  // centroids are left doubled, that doesn't change which bin anything falls into
+  glm::vec3 centroidMin{INF};
+  glm::vec3 centroidMax{-INF};
+  for (uint32_t i = 0; i < node.count; i++) {
+    centroidMin = glm::min(centroidMin, items[i].min + items[i].max);
+    centroidMax = glm::max(centroidMax, items[i].min + items[i].max);
+  }
+
+  glm::vec3 extent = centroidMax - centroidMin;
+  int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+  uint32_t leftCount = 0;
+  glm::vec3 leftMin{INF}, leftMax{-INF}, rightMin{INF}, rightMax{-INF};
+
+  if (extent[axis] > 0.0f) {
+    struct Bin {
+      glm::vec3 min{INF};
+      glm::vec3 max{-INF};
+      uint32_t count{0};
+    };
+    std::array<Bin, SAH_BIN_COUNT> bins{};
+
+    float scale = SAH_BIN_COUNT / extent[axis];
+    auto binOf = [&](const BuildItem &item) {
+      uint32_t bin = static_cast<uint32_t>((item.min[axis] + item.max[axis] - centroidMin[axis]) * scale);
+      return std::min(bin, SAH_BIN_COUNT - 1);
+    };
+
+    for (uint32_t i = 0; i < node.count; i++) {
+      Bin &bin = bins[binOf(items[i])];
+      bin.min = glm::min(bin.min, items[i].min);
+      bin.max = glm::max(bin.max, items[i].max);
+      bin.count++;
+    }
+
+    // everything right of each possible split, swept in from the right
+    std::array<Bin, SAH_BIN_COUNT> right{};
+    Bin accumulated{};
+    for (uint32_t i = SAH_BIN_COUNT - 1; i > 0; i--) {
+      accumulated.min = glm::min(accumulated.min, bins[i].min);
+      accumulated.max = glm::max(accumulated.max, bins[i].max);
+      accumulated.count += bins[i].count;
+      right[i - 1] = accumulated;
+    }
+
+    // split after bin `i`, cost is area * count on either side
+    float bestCost = INF;
+    uint32_t bestSplit = 0;
+    accumulated = Bin{};
+    for (uint32_t i = 0; i < SAH_BIN_COUNT - 1; i++) {
+      accumulated.min = glm::min(accumulated.min, bins[i].min);
+      accumulated.max = glm::max(accumulated.max, bins[i].max);
+      accumulated.count += bins[i].count;
+      if (accumulated.count == 0 || right[i].count == 0) {
+        continue;
+      }
+
+      float cost = halfArea(accumulated.min, accumulated.max) * accumulated.count +
+                   halfArea(right[i].min, right[i].max) * right[i].count;
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestSplit = i;
+        leftCount = accumulated.count;
+        leftMin = accumulated.min;
+        leftMax = accumulated.max;
+        rightMin = right[i].min;
+        rightMax = right[i].max;
+      }
+    }
+
+    if (leftCount > 0) {
+      std::partition(items, items + node.count, [&](const BuildItem &item) { return binOf(item) <= bestSplit; });
+    }
+  }
+
+  if (leftCount == 0) {
+    // all centroids in one spot, split the range in half to keep leaves small
+    leftCount = node.count / 2;
+    for (uint32_t i = 0; i < node.count; i++) {
+      glm::vec3 &min = i < leftCount ? leftMin : rightMin;
+      glm::vec3 &max = i < leftCount ? leftMax : rightMax;
+      min = glm::min(min, items[i].min);
+      max = glm::max(max, items[i].max);
+    }
+  }
+
+  uint32_t left = static_cast<uint32_t>(nodes.size());
+  nodes.push_back({leftMin, node.first, leftMax, leftCount, 0});
+  nodes.push_back({rightMin, node.first + leftCount, rightMax, node.count - leftCount, 0});
+  nodes[nodeIndex].left = left;
+  return true;
+}
+
+void Bvh::update(uint32_t item, glm::vec3 min, glm::vec3 max) {
+  uint32_t position = m_itemPositions[item];
+  m_itemBounds.set(position, min, max);
+
+  uint32_t leaf = m_itemLeaves[position];
+  if (!m_nodeDirty[leaf]) {
+    m_nodeDirty[leaf] = 1;
+    m_dirtyLeaves.push_back(leaf);
+  }
+}
+
+void Bvh::insert(uint32_t item, glm::vec3 min, glm::vec3 max) {
+  uint32_t position = static_cast<uint32_t>(m_items.size());
+  m_items.push_back(item);
+  m_itemBounds.resize(position + 1);
+  m_itemBounds.set(position, min, max);
+  if (item >= m_itemPositions.size()) {
+    m_itemPositions.resize(item + 1, NONE);
+  }
+  m_itemPositions[item] = position;
+
+  Node leaf{min, position, max, 1, 0};
+  if (m_nodes.empty()) {
+    m_nodes.push_back(leaf);
+    m_parents.push_back(NONE);
+    m_nodeDirty.push_back(0);
+    m_itemLeaves.push_back(0);
+    return;
+  }
+
+  // the sibling moves to the end of the nodes next to the new leaf, and a
+  // new node over the two of them takes its place
+  uint32_t sibling = findSibling(min, max);
+  uint32_t moved = static_cast<uint32_t>(m_nodes.size());
+  m_nodes.push_back(m_nodes[sibling]);
+  m_nodes.push_back(leaf);
+  m_parents.push_back(sibling);
+  m_parents.push_back(sibling);
+  m_nodeDirty.push_back(m_nodeDirty[sibling]);
+  m_nodeDirty.push_back(0);
+  m_itemLeaves.push_back(moved + 1);
+  if (m_nodeDirty[sibling]) {
+    m_dirtyLeaves.push_back(moved);
+  }
+
+  const Node &movedNode = m_nodes[moved];
+  if (movedNode.isLeaf()) {
+    std::fill(m_itemLeaves.begin() + movedNode.first, m_itemLeaves.begin() + movedNode.first + movedNode.count, moved);
+  } else {
+    m_parents[movedNode.left] = moved;
+    m_parents[movedNode.left + 1] = moved;
+  }
+
+  Node &parent = m_nodes[sibling];
+  parent.min = glm::min(movedNode.min, min);
+  parent.max = glm::max(movedNode.max, max);
+  parent.first = 0;
+  parent.count = NONE;
+  parent.left = moved;
+  m_areaSum += halfArea(parent.min, parent.max);
+
+  // everything above grows to take in the new box, and its items aren't one range anymore
+  for (uint32_t node = m_parents[sibling]; node != NONE; node = m_parents[node]) {
+    Node &ancestor = m_nodes[node];
+    float oldArea = halfArea(ancestor.min, ancestor.max);
+    ancestor.min = glm::min(ancestor.min, min);
+    ancestor.max = glm::max(ancestor.max, max);
+    ancestor.count = NONE;
+    m_areaSum += halfArea(ancestor.min, ancestor.max) - oldArea;
+  }
+}
+
+uint32_t Bvh::findSibling(glm::vec3 min, glm::vec3 max) const {
+  // pairing the box with a node costs the area of the node they share, plus
+  // what every node above it grows by. below a node that's at least the
+  // box's own area plus what the node and everything above it grow by
+  float area = halfArea(min, max);
+  uint32_t best = 0;
+  float bestCost = INF;
+
+  struct Entry {
+    uint32_t node;
+    float inherited;
+  };
+  std::vector<Entry> stack;
+  stack.reserve(64);
+  stack.push_back({0, 0.0f});
+
+  while (!stack.empty()) {
+    Entry entry = stack.back();
+    stack.pop_back();
+
+    const Node &node = m_nodes[entry.node];
+    float merged = halfArea(glm::min(node.min, min), glm::max(node.max, max));
+    float cost = merged + entry.inherited;
+    if (cost < bestCost) {
+      bestCost = cost;
+      best = entry.node;
+    }
+    if (node.isLeaf()) {
+      continue;
+    }
+
+    float inherited = entry.inherited + merged - halfArea(node.min, node.max);
+    if (area + inherited < bestCost) {
+      stack.push_back({node.left, inherited});
+      stack.push_back({node.left + 1, inherited});
+    }
+  }
+
+  return best;
+}
+
+void Bvh::remove(uint32_t item) {
+  // the box stays where it is, so nothing above it has to be refitted
+  uint32_t position = m_itemPositions[item];
+  m_items[position] = NONE;
+  m_itemPositions[item] = NONE;
+  m_freePositions.push_back(position);
+}
+
+void Bvh::rename(uint32_t from, uint32_t to) {
+  uint32_t position = m_itemPositions[from];
+  if (to >= m_itemPositions.size()) {
+    m_itemPositions.resize(to + 1, NONE);
+  }
+  m_items[position] = to;
+  m_itemPositions[to] = position;
+  m_itemPositions[from] = NONE;
+}
+
+void Bvh::refitNode(uint32_t index) {
+  Node &node = m_nodes[index];
+  if (node.isLeaf()) {
+    node.min = glm::vec3(INF);
+    node.max = glm::vec3(-INF);
+    for (uint32_t i = node.first; i < node.first + node.count; i++) {
+      node.min = glm::min(node.min, boundsMin(m_itemBounds, i));
+      node.max = glm::max(node.max, boundsMax(m_itemBounds, i));
+    }
+  } else {
+    const Node &left = m_nodes[node.left];
+    const Node &right = m_nodes[node.left + 1];
+    node.min = glm::min(left.min, right.min);
+    node.max = glm::max(left.max, right.max);
+  }
+}
+
+void Bvh::refit() {
+  if (m_dirtyLeaves.empty()) {
+    return;
+  }
+
+  if (m_dirtyLeaves.size() * 8 > m_nodes.size()) {
+    // going backwards through the nodes in breadth first order refits
+    // everything in a single pass, which beats walking up from lots of leaves.
+    // a build leaves children after their parents, but `insert()` doesn't
+    m_refitOrder.clear();
+    m_refitOrder.push_back(0);
+    for (size_t i = 0; i < m_refitOrder.size(); i++) {
+      const Node &node = m_nodes[m_refitOrder[i]];
+      if (!node.isLeaf()) {
+        m_refitOrder.push_back(node.left);
+        m_refitOrder.push_back(node.left + 1);
+      }
+    }
+
+    m_areaSum = 0.0f;
+    for (size_t i = m_refitOrder.size(); i-- > 0;) {
+      uint32_t node = m_refitOrder[i];
+      refitNode(node);
+      if (!m_nodes[node].isLeaf()) {
+        m_areaSum += halfArea(m_nodes[node].min, m_nodes[node].max);
+      }
+    }
+  } else {
+    for (uint32_t leaf : m_dirtyLeaves) {
+      uint32_t node = leaf;
+      while (node != NONE) {
+        glm::vec3 oldMin = m_nodes[node].min;
+        glm::vec3 oldMax = m_nodes[node].max;
+        refitNode(node);
+
+        const Node &refitted = m_nodes[node];
+        if (refitted.min == oldMin && refitted.max == oldMax) {
+          break;
+        }
+        if (!refitted.isLeaf()) {
+          m_areaSum += halfArea(refitted.min, refitted.max) - halfArea(oldMin, oldMax);
+        }
+        node = m_parents[node];
+      }
+    }
+  }
+
+  for (uint32_t leaf : m_dirtyLeaves) {
+    m_nodeDirty[leaf] = 0;
+  }
+  m_dirtyLeaves.clear();
+}
+
+float Bvh::cost() const {
+  if (m_nodes.empty()) {
+    return 0.0f;
+  }
+  float rootArea = halfArea(m_nodes[0].min, m_nodes[0].max);
+  return rootArea > 0.0f ? m_areaSum / rootArea : 0.0f;
+}
+
+uint32_t Bvh::cull(const Frustum &frustum, std::vector<uint32_t> &items) const {
+  if (m_nodes.empty()) {
+    return 0;
+  }
+
+  // planes the node isn't known to be entirely inside of yet, one bit each
+  struct Entry {
+    uint32_t node;
+    uint32_t planes;
+  };
+  std::vector<Entry> stack;
+  stack.reserve(64);
+  stack.push_back({0, 0x3f});
+
+  std::array<uint8_t, MAX_LEAF_SIZE> visible;
+  uint32_t visited = 0;
+
+  while (!stack.empty()) {
+    Entry entry = stack.back();
+    stack.pop_back();
+    visited++;
+
+    const Node &node = m_nodes[entry.node];
+    bool outside = false;
+    for (uint32_t p = 0; p < 6 && !outside; p++) {
+      if (!(entry.planes & (1u << p))) {
+        continue;
+      }
+
+      const glm::vec4 &plane = frustum.plane(p);
+      glm::vec3 normal{plane};
+      glm::vec3 positive{
+          normal.x >= 0.0f ? node.max.x : node.min.x,
+          normal.y >= 0.0f ? node.max.y : node.min.y,
+          normal.z >= 0.0f ? node.max.z : node.min.z};
+      glm::vec3 negative{
+          normal.x >= 0.0f ? node.min.x : node.max.x,
+          normal.y >= 0.0f ? node.min.y : node.max.y,
+          normal.z >= 0.0f ? node.min.z : node.max.z};
+
+      if (glm::dot(normal, positive) + plane.w < 0.0f) {
+        outside = true;
+      } else if (glm::dot(normal, negative) + plane.w >= 0.0f) {
+        // children of a node that's inside a plane are inside it too
+        entry.planes &= ~(1u << p);
+      }
+    }
+
+    if (outside) {
+      continue;
+    }
+    if (entry.planes == 0 && node.count == NONE) {
+      // entirely inside, but items were inserted below so they're spread out
+      stack.push_back({node.left, 0});
+      stack.push_back({node.left + 1, 0});
+      continue;
+    }
+    if (entry.planes == 0) {
+      if (m_freePositions.empty()) {
+        items.insert(items.end(), m_items.begin() + node.first, m_items.begin() + node.first + node.count);
+      } else {
+        std::copy_if(
+            m_items.begin() + node.first,
+            m_items.begin() + node.first + node.count,
+            std::back_inserter(items),
+            [](uint32_t item) { return item != NONE; });
+      }
+      continue;
+    }
+    if (node.isLeaf()) {
+      frustum.cull(m_itemBounds, node.first, node.first + node.count, visible.data());
+      for (uint32_t i = 0; i < node.count; i++) {
+        if (visible[i] && m_items[node.first + i] != NONE) {
+          items.push_back(m_items[node.first + i]);
+        }
+      }
+      continue;
+    }
+
+    stack.push_back({node.left, entry.planes});
+    stack.push_back({node.left + 1, entry.planes});
+  }
+
+  return visited;
+}
+
+uint32_t Bvh::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float &distance) const {
+  distance = maxDistance;
+  if (m_nodes.empty()) {
+    return NONE;
+  }
+
+  glm::vec3 inverseDirection = 1.0f / direction;
+  float rootDistance = rayBox(origin, inverseDirection, m_nodes[0].min, m_nodes[0].max, maxDistance);
+  if (rootDistance == INF) {
+    return NONE;
+  }
+
+  struct Entry {
+    uint32_t node;
+    float distance;
+  };
+  std::vector<Entry> stack;
+  stack.reserve(64);
+  stack.push_back({0, rootDistance});
+
+  uint32_t hit = NONE;
+  while (!stack.empty()) {
+    Entry entry = stack.back();
+    stack.pop_back();
+    if (hit != NONE && entry.distance >= distance) {
+      continue;
+    }
+
+    const Node &node = m_nodes[entry.node];
+    if (node.isLeaf()) {
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        if (m_items[i] == NONE) {
+          continue;
+        }
+        float t = rayBox(origin, inverseDirection, boundsMin(m_itemBounds, i), boundsMax(m_itemBounds, i), distance);
+        if (t != INF && (hit == NONE || t < distance)) {
+          distance = t;
+          hit = m_items[i];
+        }
+      }
+      continue;
+    }
+
+    const Node &left = m_nodes[node.left];
+    const Node &right = m_nodes[node.left + 1];
+    float leftDistance = rayBox(origin, inverseDirection, left.min, left.max, distance);
+    float rightDistance = rayBox(origin, inverseDirection, right.min, right.max, distance);
+
+    // push the closer child last so it's visited first
+    if (leftDistance < rightDistance) {
+      if (rightDistance != INF) {
+        stack.push_back({node.left + 1, rightDistance});
+      }
+      stack.push_back({node.left, leftDistance});
+    } else {
+      if (leftDistance != INF) {
+        stack.push_back({node.left, leftDistance});
+      }
+      if (rightDistance != INF) {
+        stack.push_back({node.left + 1, rightDistance});
+      }
+    }
+  }
+
+  return hit;
+}
+
+void Bvh::queryRadius(glm::vec3 center, float radius, std::vector<uint32_t> &items) const {
+  if (m_nodes.empty()) {
+    return;
+  }
+
+  std::vector<uint32_t> stack;
+  stack.reserve(64);
+  stack.push_back(0);
+
+  while (!stack.empty()) {
+    const Node &node = m_nodes[stack.back()];
+    stack.pop_back();
+    if (!sphereBox(center, radius, node.min, node.max)) {
+      continue;
+    }
+
+    if (node.isLeaf()) {
+      for (uint32_t i = node.first; i < node.first + node.count; i++) {
+        if (m_items[i] != NONE && sphereBox(center, radius, boundsMin(m_itemBounds, i), boundsMax(m_itemBounds, i))) {
+          items.push_back(m_items[i]);
+        }
+      }
+      continue;
+    }
+
+    stack.push_back(node.left);
+    stack.push_back(node.left + 1);
+  }
+}
+
+} // namespace ve
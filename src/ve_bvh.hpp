@@ -0,0 +1,129 @@
+#pragma once
+
+#include "ve_frustum.hpp"
+#include "ve_thread_pool.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace ve {
+
+// bounding volume hierarchy over a set of axis aligned boxes, identified by
+// their index in the `BoundsArray` passed to `build()`.
+//
+// `build()` constructs the tree from scratch with a binned SAH, splitting the
+// top levels on the calling thread and building the subtrees below them in
+// parallel. moving items afterwards only needs `update()` and `refit()`,
+// which keep the topology and just grow or shrink the boxes on the way up.
+// once refitting has made the tree much worse than it was when it was built,
+// `cost()` will be well above `buildCost()` and it's time for another build.
+//
+// `insert()` adds items one at a time without a build. it picks the node
+// whose pairing with the new item's box adds the least surface area to the
+// tree, puts a new parent over the two and grows the boxes above it.
+// removing an item leaves its position in the leaf behind as an empty one,
+// those only go away with the next build.
+class Bvh {
+public:
+  struct Node {
+    glm::vec3 min;
+    // the items of a node's subtree are m_items[first, first + count). once
+    // `insert()` has added items below an inner node they're no longer one
+    // range and its count is NONE
+    uint32_t first;
+    glm::vec3 max;
+    uint32_t count;
+    // children are stored next to each other at `left` and `left + 1`,
+    // 0 means this is a leaf since the root is never anyone's child
+    uint32_t left;
+
+    bool isLeaf() const { return left == 0; }
+  };
+
+  // leaves hold at most one batch worth of boxes for `Frustum::cull()`
+  static constexpr uint32_t MAX_LEAF_SIZE = Frustum::BATCH_SIZE > 4 ? Frustum::BATCH_SIZE : 4;
+  static constexpr uint32_t SAH_BIN_COUNT = 16;
+  // nodes with fewer items than this are built as one job
+  static constexpr uint32_t SUBTREE_SIZE = 1024;
+  static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  void build(const BoundsArray &bounds, ThreadPool &threadPool);
+
+  // moves item `item` to (min, max), the tree isn't updated until `refit()`
+  void update(uint32_t item, glm::vec3 min, glm::vec3 max);
+  void refit();
+
+  // adds `item` in a leaf of its own, next to the node it fits in best
+  void insert(uint32_t item, glm::vec3 min, glm::vec3 max);
+  void remove(uint32_t item);
+  // gives item `from` the id `to`, which mustn't be in the tree
+  void rename(uint32_t from, uint32_t to);
+  bool contains(uint32_t item) const { return item < m_itemPositions.size() && m_itemPositions[item] != NONE; }
+
+  // appends every item whose box is at least partially inside the frustum,
+  // returns the number of nodes visited
+  uint32_t cull(const Frustum &frustum, std::vector<uint32_t> &items) const;
+  // the item with the closest box the ray enters within `maxDistance`, or
+  // NONE if the ray misses everything. `direction` doesn't need to be normalized,
+  // `distance` is measured in multiples of it
+  uint32_t raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float &distance) const;
+  // appends every item whose box intersects the sphere
+  void queryRadius(glm::vec3 center, float radius, std::vector<uint32_t> &items) const;
+
+  // items in the tree, and the positions they and the free ones take up
+  size_t size() const { return m_items.size() - m_freePositions.size(); }
+  size_t capacity() const { return m_items.size(); }
+  bool empty() const { return size() == 0; }
+  const std::vector<Node> &nodes() const { return m_nodes; }
+
+  // surface area heuristic cost of the tree, relative to the root
+  float cost() const;
+  float buildCost() const { return m_buildCost; }
+
+private:
+  // splits `nodes[node]` in two and appends the children to `nodes`, returns
+  // false if the node should stay a leaf
+  bool split(std::vector<Node> &nodes, uint32_t node);
+  void buildSubtree(std::vector<Node> &nodes);
+  void refitNode(uint32_t node);
+  // the node that adds the least surface area to the tree when it's paired
+  // with a new box, found by branch and bound
+  uint32_t findSibling(glm::vec3 min, glm::vec3 max) const;
+
+  std::vector<Node> m_nodes;
+  std::vector<uint32_t> m_parents;
+  // item ids in leaf order, and their boxes in the same order. free
+  // positions hold NONE and keep the box of the item that left them
+  std::vector<uint32_t> m_items;
+  BoundsArray m_itemBounds;
+  // per item id: where it ended up in `m_items`, and per position: its leaf
+  std::vector<uint32_t> m_itemPositions;
+  std::vector<uint32_t> m_itemLeaves;
+  std::vector<uint32_t> m_freePositions;
+
+  // boxes get shuffled around together with their ids while building, so
+  // splitting only ever touches contiguous memory
+  struct BuildItem {
+    glm::vec3 min;
+    uint32_t id;
+    glm::vec3 max;
+    float pad;
+  };
+  std::vector<BuildItem> m_buildItems;
+
+  std::vector<uint32_t> m_dirtyLeaves;
+  std::vector<uint8_t> m_nodeDirty;
+  // every node with parents before their children, for refitting all of them
+  std::vector<uint32_t> m_refitOrder;
+
+  // sum of the surface areas of all internal nodes
+  float m_areaSum{0.0f};
+  float m_buildCost{0.0f};
+};
+
+} // namespace ve
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "ve_frustum.hpp"
 #include "ve_game_object.hpp"
 #include "ve_input.hpp"
 
@@ -21,6 +22,7 @@ public:
   const glm::vec3 &up() const { return m_up; }
 
   const glm::vec3 &position() const { return m_position; }
+  Frustum frustum() const { return Frustum(m_projection * m_view); }
 
   const float aspect() const { return m_aspect; }
 
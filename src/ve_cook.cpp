@@ -0,0 +1,311 @@
+// ve-cook: cooks every model and texture of an asset directory ahead of
+// time, so the engine only ever maps finished .vemesh and .vetex files.
+//
+//   ve-cook [asset directory] [--force]
+//
+// the asset directory (the working directory by default) is the one the
+// engine runs from, holding models/ and textures/. cooked files are written
+// next to their sources, and a manifest of content hashes in the asset
+// directory lets the next run skip everything that hasn't changed
+
+#include "ve_mapped_file.hpp"
+#include "ve_mesh.hpp"
+#include "ve_mesh_cooker.hpp"
+#include "ve_texture_cooker.hpp"
+#include "ve_thread_pool.hpp"
+#include "ve_vemesh.hpp"
+#include "ve_vetex.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const std::string MANIFEST_NAME = "cook_manifest.txt";
+const std::string MESH_EXTENSION = ".vemesh";
+const std::string TEXTURE_EXTENSION = ".vetex";
+
+const std::vector<std::string> MODEL_SOURCES = {".gltf", ".glb"};
+const std::vector<std::string> TEXTURE_SOURCES = {".png", ".jpg", ".jpeg", ".tga", ".bmp"};
+
+constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+struct Job {
+  enum class Kind { Model, Texture };
+
+  Kind kind;
+  fs::path source;
+  fs::path cooked;
+  // the source's path relative to the asset directory, as the manifest records it
+  std::string name;
+  uint64_t hash{0};
+};
+
+std::string lowercase(std::string text) {
+  std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+  return text;
+}
+
+uint64_t hashBytes(const uint8_t *data, size_t size, uint64_t hash = FNV_OFFSET) {
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+uint64_t hashValue(uint64_t value, uint64_t hash) {
+  return hashBytes(reinterpret_cast<const uint8_t *>(&value), sizeof(value), hash);
+}
+
+// the files a glTF file points to with "uri": "...", that aren't data uris.
+// only the ones next to it matter, images live under textures/ and get cooked on their own
+std::vector<fs::path> externalFiles(const fs::path &source, const uint8_t *data, size_t size) {
+  std::vector<fs::path> files;
+  std::string text(reinterpret_cast<const char *>(data), size);
+  const std::string key = "\"uri\"";
+  for (size_t at = text.find(key); at != std::string::npos; at = text.find(key, at + key.size())) {
+    size_t open = text.find('"', text.find(':', at + key.size()));
+    size_t close = open == std::string::npos ? std::string::npos : text.find('"', open + 1);
+    if (close == std::string::npos) {
+      break;
+    }
+    std::string uri = text.substr(open + 1, close - open - 1);
+    if (uri.compare(0, 5, "data:") == 0) {
+      continue;
+    }
+    fs::path file = source.parent_path() / fs::u8path(uri);
+    std::error_code error;
+    if (fs::is_regular_file(file, error)) {
+      files.push_back(file);
+    }
+  }
+  return files;
+}
+
+// changes whenever the cooked file would: the source's bytes, the bytes of
+// the buffers a model uses and the version of the format it's cooked into
+uint64_t contentHash(const Job &job) {
+  ve::MappedFile file(job.source.string());
+  uint64_t hash = hashBytes(file.data(), file.size());
+
+  if (job.kind == Job::Kind::Model) {
+    hash = hashValue(ve::vemesh::VERSION, hash);
+    hash = hashValue(ve::Mesh::Layout::stride, hash);
+    hash = hashValue(sizeof(ve::Mesh::Primitive), hash);
+    for (const fs::path &external : externalFiles(job.source, file.data(), file.size())) {
+      ve::MappedFile externalFile(external.string());
+      hash = hashBytes(externalFile.data(), externalFile.size(), hash);
+    }
+  } else {
+    hash = hashValue(ve::vetex::VERSION, hash);
+  }
+  return hash;
+}
+
+// whether the cooked file of `job` can stay as it is. the engine throws away
+// cooked files whose source time doesn't match, so sources touched without
+// changing, by a checkout say, have their new time stamped into the old file
+bool reuseCooked(const Job &job, int64_t sourceTime) {
+  std::vector<uint8_t> data;
+  {
+    ve::MappedFile file(job.cooked.string());
+    data.assign(file.data(), file.data() + file.size());
+  }
+
+  int64_t *cookedTime = nullptr;
+  if (job.kind == Job::Kind::Model) {
+    const ve::vemesh::Header *header = ve::vemesh::parse(data.data(), data.size());
+    cookedTime = header ? const_cast<int64_t *>(&header->sourceTime) : nullptr;
+  } else {
+    const ve::vetex::Header *header = ve::vetex::parse(data.data(), data.size());
+    cookedTime = header ? const_cast<int64_t *>(&header->sourceTime) : nullptr;
+  }
+  if (cookedTime == nullptr) {
+    return false;
+  }
+  if (*cookedTime == sourceTime) {
+    return true;
+  }
+  *cookedTime = sourceTime;
+  return ve::saveFile(job.cooked.string(), data);
+}
+
+// the subdirectory of `root` called `name`, whatever its case. the engine
+// runs on case insensitive file systems as well
+fs::path findDirectory(const fs::path &root, const std::string &name) {
+  std::error_code error;
+  for (const fs::directory_entry &entry : fs::directory_iterator(root, error)) {
+    if (entry.is_directory() && lowercase(entry.path().filename().string()) == name) {
+      return entry.path();
+    }
+  }
+  return {};
+}
+
+void findJobs(
+    const fs::path &root,
+    const std::string &directoryName,
+    Job::Kind kind,
+    const std::vector<std::string> &extensions,
+    const std::string &cookedExtension,
+    std::vector<Job> &jobs) {
+  fs::path directory = findDirectory(root, directoryName);
+  if (directory.empty()) {
+    std::cout << "ve-cook: no " << directoryName << " directory in " << root.string() << std::endl;
+    return;
+  }
+
+  for (const fs::directory_entry &entry : fs::recursive_directory_iterator(directory)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    std::string extension = lowercase(entry.path().extension().string());
+    if (std::find(extensions.begin(), extensions.end(), extension) == extensions.end()) {
+      continue;
+    }
+
+    Job job{};
+    job.kind = kind;
+    job.source = entry.path();
+    job.cooked = entry.path();
+    job.cooked += cookedExtension;
+    job.name = fs::relative(entry.path(), root).generic_string();
+    jobs.push_back(std::move(job));
+  }
+}
+
+// `<hash> <name>` lines
+std::map<std::string, uint64_t> readManifest(const fs::path &path) {
+  std::map<std::string, uint64_t> manifest;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream stream(line);
+    uint64_t hash;
+    std::string name;
+    if (stream >> std::hex >> hash && std::getline(stream >> std::ws, name)) {
+      manifest[name] = hash;
+    }
+  }
+  return manifest;
+}
+
+bool writeManifest(const fs::path &path, const std::map<std::string, uint64_t> &manifest) {
+  std::ostringstream stream;
+  for (const auto &[name, hash] : manifest) {
+    stream << std::hex << std::setw(16) << std::setfill('0') << hash << ' ' << name << '\n';
+  }
+  std::string text = stream.str();
+  return ve::saveFile(path.string(), std::vector<uint8_t>(text.begin(), text.end()));
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  fs::path root = ".";
+  bool force = false;
+  for (int i = 1; i < argc; i++) {
+    std::string argument = argv[i];
+    if (argument == "--force") {
+      force = true;
+    } else if (argument == "--help" || argument == "-h") {
+      std::cout << "usage: ve-cook [asset directory] [--force]" << std::endl;
+      return 0;
+    } else {
+      root = argument;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<Job> jobs;
+  try {
+    findJobs(root, "models", Job::Kind::Model, MODEL_SOURCES, MESH_EXTENSION, jobs);
+    findJobs(root, "textures", Job::Kind::Texture, TEXTURE_SOURCES, TEXTURE_EXTENSION, jobs);
+  } catch (const std::exception &e) {
+    std::cerr << "ve-cook: " << e.what() << std::endl;
+    return 1;
+  }
+
+  fs::path manifestPath = root / MANIFEST_NAME;
+  std::map<std::string, uint64_t> previous = force ? std::map<std::string, uint64_t>{} : readManifest(manifestPath);
+
+  ve::ThreadPool threadPool;
+  ve::MeshCooker meshCooker{threadPool};
+
+  std::mutex logMutex;
+  std::vector<char> succeeded(jobs.size(), 0);
+  std::atomic<uint32_t> cooked{0};
+  std::atomic<uint32_t> skipped{0};
+
+  // sources differ a lot in size, so every thread keeps taking the next one
+  // instead of getting an even share up front. cooking a model fans out over
+  // the same pool again
+  std::atomic<size_t> next{0};
+  threadPool.parallelFor(threadPool.threadCount(), 1, 1, [&](size_t, size_t) {
+    for (size_t i = next++; i < jobs.size(); i = next++) {
+      Job &job = jobs[i];
+      try {
+        job.hash = contentHash(job);
+        int64_t sourceTime = ve::MeshCooker::sourceTime(job.source.string());
+        auto entry = previous.find(job.name);
+        if (entry != previous.end() && entry->second == job.hash && fs::exists(job.cooked) &&
+            reuseCooked(job, sourceTime)) {
+          succeeded[i] = 1;
+          skipped++;
+          continue;
+        }
+
+        std::vector<uint8_t> data = job.kind == Job::Kind::Model
+                                        ? meshCooker.cookglTF(job.source.string(), sourceTime)
+                                        : ve::TextureCooker::cookImage(job.source.string(), sourceTime);
+        if (!ve::saveFile(job.cooked.string(), data)) {
+          throw std::runtime_error("Failed to write " + job.cooked.string());
+        }
+
+        succeeded[i] = 1;
+        cooked++;
+        std::lock_guard<std::mutex> lock{logMutex};
+        std::cout << "ve-cook: cooked " << job.name << std::endl;
+      } catch (const std::exception &e) {
+        std::lock_guard<std::mutex> lock{logMutex};
+        std::cerr << "ve-cook: FAILED " << job.name << ": " << e.what() << std::endl;
+      }
+    }
+  });
+
+  // failed sources are left out, so they're tried again next time
+  std::map<std::string, uint64_t> manifest;
+  for (size_t i = 0; i < jobs.size(); i++) {
+    if (succeeded[i]) {
+      manifest[jobs[i].name] = jobs[i].hash;
+    }
+  }
+  if (!writeManifest(manifestPath, manifest)) {
+    std::cerr << "ve-cook: couldn't write " << manifestPath.string() << std::endl;
+  }
+
+  uint32_t failed = static_cast<uint32_t>(jobs.size()) - cooked - skipped;
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "ve-cook: " << cooked << " cooked, " << skipped << " up to date, " << failed << " failed in "
+            << elapsed << "s on " << threadPool.threadCount() << " threads" << std::endl;
+
+  return failed == 0 ? 0 : 1;
+}
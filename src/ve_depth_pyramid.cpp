@@ -0,0 +1,248 @@
+#include "ve_depth_pyramid.hpp"
+
+#include "ve_pipeline_builder.hpp"
+#include "ve_shader.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace ve {
+
+struct DepthPyramidPushConstants {
+  uint32_t width;
+  uint32_t height;
+  uint32_t reduce;
+  uint32_t samples;
+};
+
+DepthPyramid::DepthPyramid(
+    Device &device,
+    FileSystem &fileSystem,
+    DescriptorLayoutCache &layoutCache,
+    uint32_t framesInFlight)
+    : m_device{device}
+    , m_fileSystem{fileSystem}
+    , m_layoutCache{layoutCache} {
+  for (uint32_t i = 0; i < framesInFlight; i++) {
+    m_frameAllocators.push_back(std::make_unique<DescriptorAllocator>(device.device()));
+  }
+
+  // texelFetch() ignores the filter, but the sampler still has to allow every level
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_NEAREST;
+  samplerInfo.minFilter = VK_FILTER_NEAREST;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.minLod = 0.0f;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+  if (vkCreateSampler(m_device.device(), &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create depth pyramid sampler");
+  }
+
+  createPipelines();
+
+  // a placeholder until there's a depth buffer to build from, so there's
+  // always something to bind
+  createImage({1, 1});
+}
+
+DepthPyramid::~DepthPyramid() {
+  destroyImage();
+  vkDestroySampler(m_device.device(), m_sampler, nullptr);
+}
+
+bool DepthPyramid::resize(VkExtent2D extent) {
+  if (extent.width == m_extent.width && extent.height == m_extent.height) {
+    return false;
+  }
+
+  // only happens when the window changes size, earlier frames may still be
+  // using the old image
+  vkDeviceWaitIdle(m_device.device());
+  destroyImage();
+  createImage(extent);
+  return true;
+}
+
+VkDescriptorImageInfo DepthPyramid::descriptorInfo() {
+  VkDescriptorImageInfo info{};
+  info.sampler = m_sampler;
+  info.imageView = m_view;
+  info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+  return info;
+}
+
+void DepthPyramid::build(
+    VkCommandBuffer cmd,
+    uint32_t frameIndex,
+    VkImageView depthView,
+    VkSampleCountFlagBits samples) {
+  DescriptorAllocator &allocator = *m_frameAllocators[frameIndex];
+  allocator.resetPools();
+
+  // the previous frame may still be testing against the pyramid
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(
+      cmd,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0,
+      1,
+      &barrier,
+      0,
+      nullptr,
+      0,
+      nullptr);
+
+  uint32_t width = m_extent.width;
+  uint32_t height = m_extent.height;
+  for (uint32_t level = 0; level < levelCount(); level++) {
+    VkDescriptorImageInfo sourceInfo{};
+    sourceInfo.sampler = m_sampler;
+    if (level == 0) {
+      sourceInfo.imageView = depthView;
+      sourceInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    } else {
+      sourceInfo.imageView = m_levelViews[level - 1];
+      sourceInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    VkDescriptorImageInfo destinationInfo{};
+    destinationInfo.imageView = m_levelViews[level];
+    destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkDescriptorSet set;
+    DescriptorBuilder::begin(&m_layoutCache, &allocator)
+        .bindImage(0, &sourceInfo, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+        .bindImage(1, &destinationInfo, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+        .build(set);
+
+    // a multisampled depth buffer needs its own shader to be read
+    Pipeline &pipeline = level == 0 && samples != VK_SAMPLE_COUNT_1_BIT ? *m_resolvePipeline : *m_reducePipeline;
+    pipeline.bind(cmd);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout(), 0, 1, &set, 0, nullptr);
+
+    DepthPyramidPushConstants push{};
+    push.width = width;
+    push.height = height;
+    push.reduce = level == 0 ? 0 : 1;
+    push.samples = static_cast<uint32_t>(samples);
+    vkCmdPushConstants(cmd, pipeline.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    vkCmdDispatch(cmd, (width + GROUP_SIZE - 1) / GROUP_SIZE, (height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+
+    // each level is read by the next one, and the last one by whoever tests against the pyramid
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(
+        cmd,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1,
+        &barrier,
+        0,
+        nullptr,
+        0,
+        nullptr);
+
+    width = std::max(1u, (width + 1) / 2);
+    height = std::max(1u, (height + 1) / 2);
+  }
+}
+
+void DepthPyramid::createImage(VkExtent2D extent) {
+  m_extent = extent;
+
+  // every level rounds its size up, so none of the depth buffer is left out
+  uint32_t levels = 1;
+  for (uint32_t size = std::max(extent.width, extent.height); size > 1; size = (size + 1) / 2) {
+    levels++;
+  }
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = extent.width;
+  imageInfo.extent.height = extent.height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = levels;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = VK_FORMAT_R32_SFLOAT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  m_image = std::make_unique<Image>(m_device.getAllocator());
+  m_image->create(&imageInfo, VK_IMAGE_ASPECT_COLOR_BIT, 0, VMA_MEMORY_USAGE_GPU_ONLY);
+
+  VkImageViewCreateInfo viewInfo = m_image->imageViewInfo();
+  if (vkCreateImageView(m_device.device(), &viewInfo, nullptr, &m_view) != VK_SUCCESS) {
+    throw std::runtime_error("Failed to create depth pyramid image view");
+  }
+
+  m_levelViews.resize(levels);
+  for (uint32_t level = 0; level < levels; level++) {
+    viewInfo.subresourceRange.baseMipLevel = level;
+    viewInfo.subresourceRange.levelCount = 1;
+    if (vkCreateImageView(m_device.device(), &viewInfo, nullptr, &m_levelViews[level]) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to create depth pyramid level image view");
+    }
+  }
+
+  // nothing tests against the pyramid before it's been built, so its contents can start out undefined
+  m_device.imageLayoutTransition(
+      m_image->image,
+      1,
+      levels,
+      VK_IMAGE_ASPECT_COLOR_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_IMAGE_LAYOUT_GENERAL,
+      0,
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+  std::cout << "Depth pyramid of " << extent.width << "x" << extent.height << " with " << levels << " levels"
+            << std::endl;
+}
+
+void DepthPyramid::destroyImage() {
+  for (VkImageView view : m_levelViews) {
+    vkDestroyImageView(m_device.device(), view, nullptr);
+  }
+  m_levelViews.clear();
+  vkDestroyImageView(m_device.device(), m_view, nullptr);
+  m_view = VK_NULL_HANDLE;
+  m_image.reset();
+}
+
+void DepthPyramid::createPipelines() {
+  auto reduceShader = std::make_shared<ShaderStage>(
+      m_device,
+      m_fileSystem,
+      "shaders/depth_reduce.comp.spv",
+      VK_SHADER_STAGE_COMPUTE_BIT);
+  auto resolveShader = std::make_shared<ShaderStage>(
+      m_device,
+      m_fileSystem,
+      "shaders/depth_resolve.comp.spv",
+      VK_SHADER_STAGE_COMPUTE_BIT);
+
+  PipelineBuilder reduceBuilder(m_device);
+  m_reducePipeline = reduceBuilder.addShaderStage(reduceShader).reflectLayout().buildCompute();
+
+  PipelineBuilder resolveBuilder(m_device);
+  m_resolvePipeline = resolveBuilder.addShaderStage(resolveShader).reflectLayout().buildCompute();
+}
+
+} // namespace ve
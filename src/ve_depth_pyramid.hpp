@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ve_descriptor_builder.hpp"
+#include "ve_device.hpp"
+#include "ve_file_system.hpp"
+#include "ve_image.hpp"
+#include "ve_pipeline.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <vector>
+
+namespace ve {
+
+// hierarchical z buffer: a single channel float image with a full mip chain,
+// where every texel holds the furthest depth of the texels it covers in the
+// level below. level 0 has the size of the depth buffer it's built from.
+//
+// the image stays in VK_IMAGE_LAYOUT_GENERAL, it's written as a storage image
+// while building and read with texelFetch() by whoever tests against it.
+class DepthPyramid {
+public:
+  DepthPyramid(
+      Device &device,
+      FileSystem &fileSystem,
+      DescriptorLayoutCache &layoutCache,
+      uint32_t framesInFlight);
+  ~DepthPyramid();
+
+  DepthPyramid(const DepthPyramid &) = delete;
+  DepthPyramid &operator=(const DepthPyramid &) = delete;
+
+  // recreates the pyramid if `extent` differs from its current size. returns
+  // true if it did, which invalidates every descriptor pointing at `view()`
+  bool resize(VkExtent2D extent);
+
+  // records the reduction of `depthView`, which has to be in
+  // VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL and the size of the
+  // pyramid. the descriptor sets for frame `frameIndex` are rewritten, so
+  // the last command buffer recorded with that index has to be finished
+  void build(VkCommandBuffer cmd, uint32_t frameIndex, VkImageView depthView, VkSampleCountFlagBits samples);
+
+  VkExtent2D extent() { return m_extent; }
+  uint32_t levelCount() { return static_cast<uint32_t>(m_levelViews.size()); }
+  // all levels, for a combined image sampler
+  VkDescriptorImageInfo descriptorInfo();
+
+  // has to match local_size_x and local_size_y in depth_reduce.comp and depth_resolve.comp
+  static constexpr uint32_t GROUP_SIZE = 8;
+
+private:
+  void createImage(VkExtent2D extent);
+  void destroyImage();
+  void createPipelines();
+
+  Device &m_device;
+  FileSystem &m_fileSystem;
+  DescriptorLayoutCache &m_layoutCache;
+  std::vector<std::unique_ptr<DescriptorAllocator>> m_frameAllocators;
+
+  std::unique_ptr<Image> m_image;
+  VkImageView m_view{VK_NULL_HANDLE};
+  std::vector<VkImageView> m_levelViews;
+  VkExtent2D m_extent{0, 0};
+  VkSampler m_sampler;
+
+  std::unique_ptr<Pipeline> m_reducePipeline;
+  std::unique_ptr<Pipeline> m_resolvePipeline;
+};
+
+} // namespace ve
@@ -57,6 +57,9 @@ Device::Device(Window &window)
 Device::~Device() {
   vmaDestroyAllocator(m_allocator);
   vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+  if (m_transferCommandPool != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(m_device, m_transferCommandPool, nullptr);
+  }
   vkDestroyDevice(m_device, nullptr);
 
   if (enableValidationLayers) {
@@ -139,6 +142,9 @@ void Device::createLogicalDevice() {
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+  if (indices.transferFamilyHasValue) {
+    uniqueQueueFamilies.insert(indices.transferFamily);
+  }
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -150,8 +156,25 @@ void Device::createLogicalDevice() {
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+
+  // gpu driven rendering needs a non zero firstInstance in indirect draws, multi
+  // draw and the count extension only save command buffer work on top of that
+  m_drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+  m_multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
+  deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+  deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+
+  std::vector<const char *> extensions = deviceExtensions;
+  m_drawIndirectCount =
+      m_multiDrawIndirect && hasDeviceExtension(m_physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+  if (m_drawIndirectCount) {
+    extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+  }
 
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -160,8 +183,8 @@ void Device::createLogicalDevice() {
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
   createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  createInfo.ppEnabledExtensionNames = extensions.data();
 
   // might not really be necessary anymore because device specific validation
   // layers have been deprecated
@@ -178,6 +201,18 @@ void Device::createLogicalDevice() {
 
   vkGetDeviceQueue(m_device, indices.graphicsFamily, 0, &m_graphicsQueue);
   vkGetDeviceQueue(m_device, indices.presentFamily, 0, &m_presentQueue);
+  if (indices.transferFamilyHasValue) {
+    vkGetDeviceQueue(m_device, indices.transferFamily, 0, &m_transferQueue);
+  }
+
+  if (m_drawIndirectCount) {
+    m_vkCmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+        vkGetDeviceProcAddr(m_device, "vkCmdDrawIndexedIndirectCountKHR"));
+    m_drawIndirectCount = m_vkCmdDrawIndexedIndirectCount != nullptr;
+  }
+
+  std::cout << "multi draw indirect: " << m_multiDrawIndirect << ", draw indirect count: " << m_drawIndirectCount
+            << ", transfer queue: " << hasTransferQueue() << std::endl;
 }
 
 void Device::createAllocator() {
@@ -200,6 +235,13 @@ void Device::createCommandPool() {
   if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS) {
     throw std::runtime_error("failed to create command pool!");
   }
+
+  if (hasTransferQueue()) {
+    poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
+    if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_transferCommandPool) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create transfer command pool!");
+    }
+  }
 }
 
 void Device::createSurface() { m_window.createWindowSurface(m_instance, &m_surface); }
@@ -321,6 +363,21 @@ bool Device::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+bool Device::hasDeviceExtension(VkPhysicalDevice device, const char *extensionName) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+  for (const auto &extension : availableExtensions) {
+    if (strcmp(extensionName, extension.extensionName) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
@@ -349,6 +406,23 @@ QueueFamilyIndices Device::findQueueFamilies(VkPhysicalDevice device) {
     i++;
   }
 
+  // a family without graphics is a separate engine, one without compute
+  // either is all copy engine and preferred
+  for (uint32_t family = 0; family < queueFamilyCount; family++) {
+    VkQueueFlags flags = queueFamilies[family].queueFlags;
+    if (queueFamilies[family].queueCount == 0 || (flags & VK_QUEUE_TRANSFER_BIT) == 0 ||
+        (flags & VK_QUEUE_GRAPHICS_BIT) != 0) {
+      continue;
+    }
+    if (!indices.transferFamilyHasValue || (flags & VK_QUEUE_COMPUTE_BIT) == 0) {
+      indices.transferFamily = family;
+      indices.transferFamilyHasValue = true;
+    }
+    if ((flags & VK_QUEUE_COMPUTE_BIT) == 0) {
+      break;
+    }
+  }
+
   return indices;
 }
 
@@ -473,20 +547,22 @@ void Device::copyBuffer(
     VkDeviceSize size,
     VkDeviceSize srcOffset,
     VkDeviceSize dstOffset) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
   VkBufferCopy copyRegion{};
   copyRegion.srcOffset = srcOffset;
   copyRegion.dstOffset = dstOffset;
   copyRegion.size = size;
-  vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+  copyBuffer(srcBuffer, dstBuffer, {copyRegion});
+}
+
+void Device::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, const std::vector<VkBufferCopy> &regions) {
+  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+  vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, static_cast<uint32_t>(regions.size()), regions.data());
 
   endSingleTimeCommands(commandBuffer);
 }
 
 void Device::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
   VkBufferImageCopy region{};
   region.bufferOffset = 0;
   region.bufferRowLength = 0;
@@ -500,7 +576,18 @@ void Device::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, u
   region.imageOffset = {0, 0, 0};
   region.imageExtent = {width, height, 1};
 
-  vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+  copyBufferToImage(buffer, image, {region});
+}
+
+void Device::copyBufferToImage(VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy> &regions) {
+  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+  vkCmdCopyBufferToImage(
+      commandBuffer,
+      buffer,
+      image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      static_cast<uint32_t>(regions.size()),
+      regions.data());
   endSingleTimeCommands(commandBuffer);
 }
 
@@ -541,6 +628,17 @@ void Device::imageLayoutTransition(
   endSingleTimeCommands(cmd);
 }
 
+void Device::cmdDrawIndexedIndirectCount(
+    VkCommandBuffer commandBuffer,
+    VkBuffer buffer,
+    VkDeviceSize offset,
+    VkBuffer countBuffer,
+    VkDeviceSize countBufferOffset,
+    uint32_t maxDrawCount,
+    uint32_t stride) {
+  m_vkCmdDrawIndexedIndirectCount(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+}
+
 size_t Device::padUniformBufferSize(size_t originalSize) {
   // from https://github.com/SaschaWillems/Vulkan/tree/master/examples/dynamicuniformbuffer
 
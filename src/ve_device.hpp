@@ -21,8 +21,11 @@ struct SwapchainSupportDetails {
 struct QueueFamilyIndices {
   uint32_t graphicsFamily;
   uint32_t presentFamily;
+  // a family that can copy but not draw, usually the gpu's dma engines
+  uint32_t transferFamily;
   bool graphicsFamilyHasValue = false;
   bool presentFamilyHasValue = false;
+  bool transferFamilyHasValue = false;
   bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
 };
 
@@ -44,13 +47,22 @@ public:
   Device &operator=(Device &&) = delete;
 
   VkCommandPool getCommandPool() { return m_commandPool; }
+  // only valid if `hasTransferQueue()`
+  VkCommandPool getTransferCommandPool() { return m_transferCommandPool; }
   VkDevice device() { return m_device; }
   VkSurfaceKHR surface() { return m_surface; }
   VkQueue graphicsQueue() { return m_graphicsQueue; }
   VkQueue presentQueue() { return m_presentQueue; }
+  VkQueue transferQueue() { return m_transferQueue; }
+  // whether there's a queue of a separate family just for transfers,
+  // uploads on it run alongside rendering
+  bool hasTransferQueue() { return m_transferQueue != VK_NULL_HANDLE; }
   VkSampleCountFlagBits getSampleCount() { return m_msaaSamples; }
   VmaAllocator getAllocator() { return m_allocator; }
   VkPhysicalDeviceProperties getPhysicalDeviceProperties() { return m_physicalDeviceProperties; }
+  bool supportsDrawIndirectFirstInstance() { return m_drawIndirectFirstInstance; }
+  bool supportsMultiDrawIndirect() { return m_multiDrawIndirect; }
+  bool supportsDrawIndirectCount() { return m_drawIndirectCount; }
 
   SwapchainSupportDetails getSwapchainSupport() { return querySwapchainSupport(m_physicalDevice); }
   uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -70,7 +82,11 @@ public:
       VkDeviceSize size,
       VkDeviceSize srcOffset,
       VkDeviceSize dstOffset);
+  // one copy per region, all in a single submission. regions may not overlap
+  void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, const std::vector<VkBufferCopy> &regions);
   void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
+  // one copy per region, all in a single submission. used for whole mip chains
+  void copyBufferToImage(VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy> &regions);
   void imageLayoutTransition(
       VkImage image,
       uint32_t layerCount,
@@ -84,6 +100,16 @@ public:
       VkPipelineStageFlags dstStageMask);
   size_t padUniformBufferSize(size_t originalSize);
 
+  // VK_KHR_draw_indirect_count, only valid if `supportsDrawIndirectCount()`
+  void cmdDrawIndexedIndirectCount(
+      VkCommandBuffer commandBuffer,
+      VkBuffer buffer,
+      VkDeviceSize offset,
+      VkBuffer countBuffer,
+      VkDeviceSize countBufferOffset,
+      uint32_t maxDrawCount,
+      uint32_t stride);
+
   void createImageWithInfo(
       const VkImageCreateInfo &imageInfo,
       VkMemoryPropertyFlags properties,
@@ -109,6 +135,7 @@ private:
   void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
   void hasGflwRequiredInstanceExtensions();
   bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+  bool hasDeviceExtension(VkPhysicalDevice device, const char *extensionName);
   SwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice device);
   VkSampleCountFlagBits getMaxUseableSampleCount();
 
@@ -119,16 +146,23 @@ private:
   VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
   Window &m_window;
   VkCommandPool m_commandPool;
+  VkCommandPool m_transferCommandPool{VK_NULL_HANDLE};
 
   VkDevice m_device;
   VkSurfaceKHR m_surface;
   VkQueue m_graphicsQueue;
   VkQueue m_presentQueue;
+  VkQueue m_transferQueue{VK_NULL_HANDLE};
 
   VmaAllocator m_allocator;
 
   VkSampleCountFlagBits m_msaaSamples{VK_SAMPLE_COUNT_1_BIT};
 
+  bool m_drawIndirectFirstInstance{false};
+  bool m_multiDrawIndirect{false};
+  bool m_drawIndirectCount{false};
+  PFN_vkCmdDrawIndexedIndirectCountKHR m_vkCmdDrawIndexedIndirectCount{nullptr};
+
   const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
   const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 };
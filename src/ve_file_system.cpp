@@ -0,0 +1,88 @@
+#include "ve_file_system.hpp"
+
+#include "ve_lz4.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace ve {
+
+FileSystem::FileSystem(const std::vector<std::string> &archives) {
+  for (const std::string &archive : archives) {
+    if (std::filesystem::exists(archive)) {
+      mount(archive);
+    }
+  }
+}
+
+std::string FileSystem::normalize(const std::string &path) {
+  std::string normalized = path;
+  std::replace(normalized.begin(), normalized.end(), '\\', '/');
+  while (normalized.compare(0, 2, "./") == 0) {
+    normalized.erase(0, 2);
+  }
+  std::transform(normalized.begin(), normalized.end(), normalized.begin(), [](unsigned char c) {
+    return std::tolower(c);
+  });
+  return normalized;
+}
+
+void FileSystem::mount(const std::string &path) {
+  MappedFile file(path);
+  const pak::Header *header = pak::parse(file.data(), file.size());
+  if (header == nullptr) {
+    throw std::runtime_error("Failed to mount " + path);
+  }
+
+  // the mapping stays where it is when the file is moved into the list
+  const pak::Entry *entries = pak::entries(file.data(), *header);
+  for (uint32_t i = 0; i < header->entryCount; i++) {
+    m_entries[normalize(pak::name(file.data(), *header, entries[i]))] = {file.data(), &entries[i]};
+  }
+  std::cout << "FileSystem: mounted " << path << " with " << header->entryCount << " files" << std::endl;
+  m_archives.push_back(std::move(file));
+}
+
+bool FileSystem::isLooseFile(const std::string &path) {
+  std::error_code error;
+  return std::filesystem::is_regular_file(path, error);
+}
+
+bool FileSystem::exists(const std::string &path) const {
+  return isLooseFile(path) || m_entries.find(normalize(path)) != m_entries.end();
+}
+
+FileView FileSystem::open(const std::string &path) const {
+  FileView view;
+
+  auto found = m_entries.end();
+  if (!isLooseFile(path)) {
+    found = m_entries.find(normalize(path));
+  }
+  if (found == m_entries.end()) {
+    view.m_file = std::make_shared<MappedFile>(path);
+    view.m_data = view.m_file->data();
+    view.m_size = view.m_file->size();
+    return view;
+  }
+
+  const pak::Entry &entry = *found->second.entry;
+  const uint8_t *stored = found->second.archive + entry.offset;
+  view.m_size = static_cast<size_t>(entry.size);
+  if (entry.compression == pak::Compression::None) {
+    view.m_data = stored;
+    return view;
+  }
+
+  view.m_storage.resize(view.m_size);
+  if (!lz4::decompress(stored, static_cast<size_t>(entry.storedSize), view.m_storage.data(), view.m_size)) {
+    throw std::runtime_error("Failed to decompress " + path);
+  }
+  view.m_data = view.m_storage.data();
+  return view;
+}
+
+} // namespace ve
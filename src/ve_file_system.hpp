@@ -0,0 +1,74 @@
+#pragma once
+
+#include "ve_mapped_file.hpp"
+#include "ve_pak.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ve {
+
+// the bytes of a file opened through a FileSystem. points straight into the
+// mapped archive or file when it can, and only owns a copy of them when they
+// had to be decompressed. views into archives stay valid as long as the
+// FileSystem does
+class FileView {
+public:
+  FileView() = default;
+  // move only, a copy of a decompressed view would point into the other one's storage
+  FileView(const FileView &) = delete;
+  FileView &operator=(const FileView &) = delete;
+  FileView(FileView &&) = default;
+  FileView &operator=(FileView &&) = default;
+
+  const uint8_t *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  friend class FileSystem;
+
+  const uint8_t *m_data{nullptr};
+  size_t m_size{0};
+  std::vector<uint8_t> m_storage;
+  std::shared_ptr<MappedFile> m_file;
+};
+
+// where assets are read from: loose files relative to the working directory,
+// and the .pak archives mounted into it for everything that isn't there.
+// loose files win so a file cooked again after the archive was packed (or
+// edited by hand) is the one that's read, not the stale copy in the archive.
+// paths match archive entries whatever their case and slashes. all of it is
+// read only after mounting, so it can be used from any thread
+class FileSystem {
+public:
+  // mounts those of `archives` that exist, later ones win over earlier ones
+  explicit FileSystem(const std::vector<std::string> &archives = {});
+
+  FileSystem(const FileSystem &) = delete;
+  FileSystem &operator=(const FileSystem &) = delete;
+
+  // throws if the archive can't be read
+  void mount(const std::string &path);
+
+  bool exists(const std::string &path) const;
+  // throws if there's no such file
+  FileView open(const std::string &path) const;
+
+private:
+  static std::string normalize(const std::string &path);
+  static bool isLooseFile(const std::string &path);
+
+  struct Location {
+    const uint8_t *archive;
+    const pak::Entry *entry;
+  };
+
+  std::vector<MappedFile> m_archives;
+  std::unordered_map<std::string, Location> m_entries;
+};
+
+} // namespace ve
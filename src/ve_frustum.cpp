@@ -0,0 +1,133 @@
+#include "ve_frustum.hpp"
+
+#if defined(VE_FRUSTUM_AVX)
+#include <immintrin.h>
+#elif defined(VE_FRUSTUM_SSE)
+#include <emmintrin.h>
+#endif
+
+namespace ve {
+
+void BoundsArray::resize(size_t count) {
+  minX.resize(count);
+  minY.resize(count);
+  minZ.resize(count);
+  maxX.resize(count);
+  maxY.resize(count);
+  maxZ.resize(count);
+}
+
+void BoundsArray::set(size_t i, glm::vec3 min, glm::vec3 max) {
+  minX[i] = min.x;
+  minY[i] = min.y;
+  minZ[i] = min.z;
+  maxX[i] = max.x;
+  maxY[i] = max.y;
+  maxZ[i] = max.z;
+}
+
+void transformBounds(const glm::mat4 &transform, glm::vec3 min, glm::vec3 max, glm::vec3 &outMin, glm::vec3 &outMax) {
+  // transform the center and grow the extents by the absolute value of the
+  // rotation and scale part (Arvo), cheaper than transforming all 8 corners
+  glm::vec3 center = (min + max) * 0.5f;
+  glm::vec3 extent = (max - min) * 0.5f;
+
+  glm::vec3 worldCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+  glm::vec3 worldExtent = glm::abs(glm::vec3(transform[0])) * extent.x +
+                          glm::abs(glm::vec3(transform[1])) * extent.y +
+                          glm::abs(glm::vec3(transform[2])) * extent.z;
+
+  outMin = worldCenter - worldExtent;
+  outMax = worldCenter + worldExtent;
+}
+
+Frustum::Frustum(const glm::mat4 &viewProjection) {
+  // glm matrices are column major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+  glm::vec4 row0{viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]};
+  glm::vec4 row1{viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]};
+  glm::vec4 row2{viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]};
+  glm::vec4 row3{viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]};
+
+  m_planes[0] = row3 + row0; // left
+  m_planes[1] = row3 - row0; // right
+  m_planes[2] = row3 + row1; // bottom
+  m_planes[3] = row3 - row1; // top
+  m_planes[4] = row2;        // near, depth goes from 0 to 1
+  m_planes[5] = row3 - row2; // far
+}
+
+bool Frustum::intersects(glm::vec3 min, glm::vec3 max) const {
+  for (const glm::vec4 &plane : m_planes) {
+    // the corner furthest along the plane normal
+    glm::vec3 positive{
+        plane.x >= 0.0f ? max.x : min.x,
+        plane.y >= 0.0f ? max.y : min.y,
+        plane.z >= 0.0f ? max.z : min.z};
+    if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t Frustum::cull(const BoundsArray &bounds, size_t begin, size_t end, uint8_t *visible) const {
+  uint32_t visibleCount = 0;
+  size_t i = begin;
+
+  // which side of the box to test is the same for every box, so both kernels
+  // pick the arrays once per plane instead of blending per lane
+#if defined(VE_FRUSTUM_AVX)
+  for (; i + 8 <= end; i += 8) {
+    __m256 outside = _mm256_setzero_ps();
+    for (const glm::vec4 &plane : m_planes) {
+      __m256 x = _mm256_loadu_ps(plane.x >= 0.0f ? &bounds.maxX[i] : &bounds.minX[i]);
+      __m256 y = _mm256_loadu_ps(plane.y >= 0.0f ? &bounds.maxY[i] : &bounds.minY[i]);
+      __m256 z = _mm256_loadu_ps(plane.z >= 0.0f ? &bounds.maxZ[i] : &bounds.minZ[i]);
+
+      __m256 distance = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+          _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+      outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+
+    int mask = ~_mm256_movemask_ps(outside) & 0xff;
+    for (int lane = 0; lane < 8; lane++) {
+      visible[i - begin + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+      visibleCount += static_cast<uint32_t>((mask >> lane) & 1);
+    }
+  }
+#elif defined(VE_FRUSTUM_SSE)
+  for (; i + 4 <= end; i += 4) {
+    __m128 outside = _mm_setzero_ps();
+    for (const glm::vec4 &plane : m_planes) {
+      __m128 x = _mm_loadu_ps(plane.x >= 0.0f ? &bounds.maxX[i] : &bounds.minX[i]);
+      __m128 y = _mm_loadu_ps(plane.y >= 0.0f ? &bounds.maxY[i] : &bounds.minY[i]);
+      __m128 z = _mm_loadu_ps(plane.z >= 0.0f ? &bounds.maxZ[i] : &bounds.minZ[i]);
+
+      __m128 distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+          _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+    }
+
+    int mask = ~_mm_movemask_ps(outside) & 0xf;
+    for (int lane = 0; lane < 4; lane++) {
+      visible[i - begin + lane] = static_cast<uint8_t>((mask >> lane) & 1);
+      visibleCount += static_cast<uint32_t>((mask >> lane) & 1);
+    }
+  }
+#endif
+
+  // whatever doesn't fill a whole register
+  for (; i < end; i++) {
+    bool inside = intersects(
+        glm::vec3(bounds.minX[i], bounds.minY[i], bounds.minZ[i]),
+        glm::vec3(bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]));
+    visible[i - begin] = inside ? 1 : 0;
+    visibleCount += inside ? 1 : 0;
+  }
+
+  return visibleCount;
+}
+
+} // namespace ve
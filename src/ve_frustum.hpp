@@ -0,0 +1,68 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__)
+#define VE_FRUSTUM_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VE_FRUSTUM_SSE
+#endif
+
+namespace ve {
+
+// axis aligned boxes stored as one array per component, so the culling
+// kernel can load the same component of 4 or 8 boxes in one go
+struct BoundsArray {
+  std::vector<float> minX;
+  std::vector<float> minY;
+  std::vector<float> minZ;
+  std::vector<float> maxX;
+  std::vector<float> maxY;
+  std::vector<float> maxZ;
+
+  size_t size() const { return minX.size(); }
+  void resize(size_t count);
+  void set(size_t i, glm::vec3 min, glm::vec3 max);
+};
+
+// transforms the box (min, max) by `transform` and returns the axis aligned
+// box around the result in (outMin, outMax)
+void transformBounds(const glm::mat4 &transform, glm::vec3 min, glm::vec3 max, glm::vec3 &outMin, glm::vec3 &outMax);
+
+class Frustum {
+public:
+  Frustum() = default;
+  // extracts the six clip planes from a view projection matrix with a [0, 1]
+  // depth range, the planes point inwards
+  explicit Frustum(const glm::mat4 &viewProjection);
+
+  const glm::vec4 &plane(size_t i) const { return m_planes[i]; }
+
+  bool intersects(glm::vec3 min, glm::vec3 max) const;
+
+  // writes 1 to visible[i - begin] for every box i in [begin, end) that is
+  // at least partially inside the frustum and 0 for the rest, returns the
+  // number of visible boxes. uses SSE or AVX when available
+  uint32_t cull(const BoundsArray &bounds, size_t begin, size_t end, uint8_t *visible) const;
+
+  // number of boxes `cull()` tests at once
+#if defined(VE_FRUSTUM_AVX)
+  static constexpr uint32_t BATCH_SIZE = 8;
+#elif defined(VE_FRUSTUM_SSE)
+  static constexpr uint32_t BATCH_SIZE = 4;
+#else
+  static constexpr uint32_t BATCH_SIZE = 1;
+#endif
+
+private:
+  std::array<glm::vec4, 6> m_planes{};
+};
+
+} // namespace ve
@@ -8,23 +8,26 @@
 
 namespace ve {
 
+// translation * Ry * Rx * Rz * scale
+inline glm::mat4 composeTransform(const glm::vec3 &translation, const glm::vec3 &rotation, const glm::vec3 &scale) {
+  glm::mat4 m{1.0f};
+
+  m = glm::translate(m, translation);
+
+  m = glm::rotate(m, rotation.y, {0.0f, 1.0f, 0.0f});
+  m = glm::rotate(m, rotation.x, {1.0f, 0.0f, 0.0f});
+  m = glm::rotate(m, rotation.z, {0.0f, 0.0f, 1.0f});
+
+  m = glm::scale(m, scale);
+  return m;
+}
+
 struct TransformComponent {
   glm::vec3 translation{};
   glm::vec3 scale{1.0f, 1.0f, 1.0f};
   glm::vec3 rotation{};
 
-  const glm::mat4 mat4() const {
-    glm::mat4 m{1.0f};
-
-    m = glm::translate(m, translation);
-
-    m = glm::rotate(m, rotation.y, {0.0f, 1.0f, 0.0f});
-    m = glm::rotate(m, rotation.x, {1.0f, 0.0f, 0.0f});
-    m = glm::rotate(m, rotation.z, {0.0f, 0.0f, 1.0f});
-
-    m = glm::scale(m, scale);
-    return m;
-  }
+  const glm::mat4 mat4() const { return composeTransform(translation, rotation, scale); }
 };
 
 class GameObject {
@@ -1,10 +1,250 @@
 #include "ve_gltf_loader.hpp"
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VE_GLTF_SSE
+#include <emmintrin.h>
+#endif
 
 namespace ve {
 namespace glTF {
 
+namespace {
+
+// a typed view of an accessor's elements, however far apart its buffer view
+// puts them. elements are copied out, nothing promises they're aligned
+template <typename T>
+class AccessorView {
+public:
+  // walks the elements in order, handing out copies
+  class Iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = T;
+
+    Iterator(const unsigned char *element, size_t stride) : m_element{element}, m_stride{stride} {}
+
+    T operator*() const {
+      T value;
+      std::memcpy(&value, m_element, sizeof(T));
+      return value;
+    }
+    Iterator &operator++() {
+      m_element += m_stride;
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator previous = *this;
+      m_element += m_stride;
+      return previous;
+    }
+    Iterator operator+(size_t n) const { return Iterator{m_element + n * m_stride, m_stride}; }
+    bool operator==(const Iterator &other) const { return m_element == other.m_element; }
+    bool operator!=(const Iterator &other) const { return m_element != other.m_element; }
+
+  private:
+    const unsigned char *m_element;
+    size_t m_stride;
+  };
+
+  AccessorView() = default;
+  AccessorView(const tinygltf::Model &model, const tinygltf::Accessor &accessor) {
+    if (accessor.bufferView < 0) {
+      return;
+    }
+    const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
+    m_data = model.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset;
+    int stride = accessor.ByteStride(view);
+    m_stride = stride > 0 ? static_cast<size_t>(stride) : sizeof(T);
+    m_size = accessor.count;
+  }
+
+  size_t size() const { return m_size; }
+  // whether the elements follow each other without gaps
+  bool packed() const { return m_stride == sizeof(T); }
+  const unsigned char *data() const { return m_data; }
+
+  Iterator begin() const { return Iterator{m_data, m_stride}; }
+  Iterator end() const { return begin() + m_size; }
+
+  T operator[](size_t i) const { return *(begin() + i); }
+
+private:
+  const unsigned char *m_data{nullptr};
+  size_t m_stride{sizeof(T)};
+  size_t m_size{0};
+};
+
+// the bounds of the positions as they are in the file
+void positionBounds(const AccessorView<glm::vec3> &positions, glm::vec3 &min, glm::vec3 &max) {
+  glm::vec3 lo(FLT_MAX);
+  glm::vec3 hi(-FLT_MAX);
+  for (glm::vec3 position : positions) {
+    lo = glm::min(lo, position);
+    hi = glm::max(hi, position);
+  }
+  min = lo;
+  max = hi;
+}
+
+#if defined(VE_GLTF_SSE)
+// a vertex is 10 floats in a row, the kernel below writes it as such
+static_assert(sizeof(ve::Mesh::Vertex) == 10 * sizeof(float), "Mesh::Vertex has to be packed floats");
+static_assert(offsetof(ve::Mesh::Vertex, normal) == 3 * sizeof(float), "normal has to follow position");
+static_assert(offsetof(ve::Mesh::Vertex, uv0) == 6 * sizeof(float), "uv0 has to follow normal");
+static_assert(offsetof(ve::Mesh::Vertex, uv1) == 8 * sizeof(float), "uv1 has to follow uv0");
+
+// the first `count` vertices, four at a time, out of tightly packed float
+// accessors. positions and normals have to have `count` elements, either
+// uv accessor can be empty. returns how many vertices it did, the rest is
+// left for the scalar loop
+size_t convertVerticesSse(
+    const AccessorView<glm::vec3> &positions,
+    const AccessorView<glm::vec3> &normals,
+    const AccessorView<glm::vec2> &uv0,
+    const AccessorView<glm::vec2> &uv1,
+    ve::Mesh::Vertex *vertices,
+    size_t count) {
+  const float *positionData = reinterpret_cast<const float *>(positions.data());
+  const float *normalData = reinterpret_cast<const float *>(normals.data());
+  const unsigned char *uv0Data = uv0.size() > 0 ? uv0.data() : nullptr;
+  const unsigned char *uv1Data = uv1.size() > 0 ? uv1.data() : nullptr;
+  const __m128 flipY = _mm_setr_ps(0.0f, -0.0f, 0.0f, 0.0f);
+  const __m128 zero = _mm_setzero_ps();
+
+  size_t v = 0;
+  for (; v + 4 <= count; v += 4) {
+    // one register per vertex, x y z and the next vertex's x. the last
+    // vertex is shuffled out of the block's last 4 floats so nothing past
+    // the block is read
+    __m128 position[4];
+    __m128 normal[4];
+    const float *p = positionData + v * 3;
+    const float *n = normalData + v * 3;
+    for (int i = 0; i < 3; i++) {
+      position[i] = _mm_loadu_ps(p + i * 3);
+      normal[i] = _mm_loadu_ps(n + i * 3);
+    }
+    __m128 lastPosition = _mm_loadu_ps(p + 8);
+    __m128 lastNormal = _mm_loadu_ps(n + 8);
+    position[3] = _mm_shuffle_ps(lastPosition, lastPosition, _MM_SHUFFLE(3, 3, 2, 1));
+    normal[3] = _mm_shuffle_ps(lastNormal, lastNormal, _MM_SHUFFLE(3, 3, 2, 1));
+
+    // the lengths of all four normals at once, zero length ones scale by 0
+    // instead of by infinity
+    __m128 x = normal[0];
+    __m128 y = normal[1];
+    __m128 z = normal[2];
+    __m128 w = normal[3];
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    __m128 scale = _mm_and_ps(
+        _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared)),
+        _mm_cmpgt_ps(lengthSquared, zero));
+    __m128 scales[4] = {
+        _mm_shuffle_ps(scale, scale, _MM_SHUFFLE(0, 0, 0, 0)),
+        _mm_shuffle_ps(scale, scale, _MM_SHUFFLE(1, 1, 1, 1)),
+        _mm_shuffle_ps(scale, scale, _MM_SHUFFLE(2, 2, 2, 2)),
+        _mm_shuffle_ps(scale, scale, _MM_SHUFFLE(3, 3, 3, 3))};
+
+    for (int i = 0; i < 4; i++) {
+      __m128 uv0Pair = uv0Data ? _mm_castsi128_ps(_mm_loadl_epi64(
+                                     reinterpret_cast<const __m128i *>(uv0Data + (v + i) * sizeof(glm::vec2))))
+                               : zero;
+      __m128 uv1Pair = uv1Data ? _mm_castsi128_ps(_mm_loadl_epi64(
+                                     reinterpret_cast<const __m128i *>(uv1Data + (v + i) * sizeof(glm::vec2))))
+                               : zero;
+
+      // each store's fourth float is overwritten by the next one, the last
+      // one ends exactly at the end of the vertex
+      float *out = reinterpret_cast<float *>(vertices + v + i);
+      _mm_storeu_ps(out, _mm_xor_ps(position[i], flipY));
+      _mm_storeu_ps(out + 3, _mm_xor_ps(_mm_mul_ps(normal[i], scales[i]), flipY));
+      _mm_storeu_ps(out + 6, _mm_movelh_ps(uv0Pair, uv1Pair));
+    }
+  }
+  return v;
+}
+#endif
+
+// fills the first `count` vertices in a single pass, so every vertex is
+// written once while it's in the cache instead of once per attribute.
+// positions and normals get y flipped and normals are normalized, with a
+// zero length one becoming a zero normal instead of NaNs. attributes the
+// accessors have no element for are zeros
+void convertVertices(
+    const AccessorView<glm::vec3> &positions,
+    const AccessorView<glm::vec3> &normals,
+    const AccessorView<glm::vec2> &uv0,
+    const AccessorView<glm::vec2> &uv1,
+    ve::Mesh::Vertex *vertices,
+    size_t count) {
+  size_t v = 0;
+#if defined(VE_GLTF_SSE)
+  // what exporters write almost always, strided or short accessors take the loop below
+  auto fits = [count](const auto &accessor) { return accessor.packed() && accessor.size() >= count; };
+  if (fits(positions) && fits(normals) && (uv0.size() == 0 || fits(uv0)) && (uv1.size() == 0 || fits(uv1))) {
+    v = convertVerticesSse(positions, normals, uv0, uv1, vertices, count);
+  }
+#endif
+
+  // where the loop picks up in each accessor, which can be shorter than that
+  auto from = [&v](const auto &accessor) { return accessor.begin() + std::min(v, accessor.size()); };
+  auto position = from(positions);
+  auto normal = from(normals);
+  auto texCoord0 = from(uv0);
+  auto texCoord1 = from(uv1);
+  for (; v < count; v++) {
+    ve::Mesh::Vertex &vertex = vertices[v];
+    glm::vec3 p = v < positions.size() ? *position++ : glm::vec3(0.0f);
+    vertex.position = glm::vec3(p.x, -p.y, p.z);
+
+    glm::vec3 n = v < normals.size() ? *normal++ : glm::vec3(0.0f);
+    float lengthSquared = glm::dot(n, n);
+    float scale = lengthSquared > 0.0f ? 1.0f / std::sqrt(lengthSquared) : 0.0f;
+    vertex.normal = glm::vec3(n.x, -n.y, n.z) * scale;
+
+    vertex.uv0 = v < uv0.size() ? *texCoord0++ : glm::vec2(0.0f);
+    vertex.uv1 = v < uv1.size() ? *texCoord1++ : glm::vec2(0.0f);
+  }
+}
+
+// appends the indices to `indexBuffer`, offset to where the primitive's vertices start
+template <typename T>
+void appendIndices(
+    const AccessorView<T> &indices,
+    uint32_t vertexStart,
+    std::vector<ve::Mesh::IndexType> &indexBuffer) {
+  size_t start = indexBuffer.size();
+  indexBuffer.resize(start + indices.size());
+  ve::Mesh::IndexType *out = indexBuffer.data() + start;
+  if (indices.packed()) {
+    // what indices almost always are, with a constant stride release builds vectorize this loop
+    const unsigned char *data = indices.data();
+    for (size_t i = 0; i < indices.size(); i++) {
+      T index;
+      std::memcpy(&index, data + i * sizeof(T), sizeof(T));
+      out[i] = static_cast<ve::Mesh::IndexType>(index) + vertexStart;
+    }
+  } else {
+    for (T index : indices) {
+      *out++ = static_cast<ve::Mesh::IndexType>(index) + vertexStart;
+    }
+  }
+}
+
+} // namespace
+
 Primitive::Primitive(uint32_t firstIndex, uint32_t indexCount, uint32_t vertexCount, int32_t material)
     : firstIndex{firstIndex}
     , indexCount{indexCount}
@@ -33,6 +273,23 @@ void Model::loadFromFile(const std::string &filename, float scale) {
     loadTextureSamplers(gltfModel);
     loadTextures(gltfModel);
     loadMaterials(gltfModel);
+    // room for every primitive up front, so converting them doesn't keep growing the buffers
+    size_t vertexTotal = vertexBuffer.size();
+    size_t indexTotal = indexBuffer.size();
+    for (const tinygltf::Mesh &mesh : gltfModel.meshes) {
+      for (const tinygltf::Primitive &primitive : mesh.primitives) {
+        auto position = primitive.attributes.find("POSITION");
+        if (position != primitive.attributes.end()) {
+          vertexTotal += gltfModel.accessors[position->second].count;
+        }
+        if (primitive.indices > -1) {
+          indexTotal += gltfModel.accessors[primitive.indices].count;
+        }
+      }
+    }
+    vertexBuffer.reserve(vertexTotal);
+    indexBuffer.reserve(indexTotal);
+
     const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
     for (size_t i = 0; i < scene.nodes.size(); i++) {
       const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
@@ -120,17 +377,9 @@ void Model::loadNode(
       bool hasIndices = primitive.indices > -1;
       // Vertices
       {
-        const float *bufferPos = nullptr;
-        const float *bufferNormals = nullptr;
-        const float *bufferTexCoordSet0 = nullptr;
-        const float *bufferTexCoordSet1 = nullptr;
         const void *bufferJoints = nullptr;
         const float *bufferWeights = nullptr;
 
-        int posByteStride;
-        int normByteStride;
-        int uv0ByteStride;
-        int uv1ByteStride;
         int jointByteStride;
         int weightByteStride;
 
@@ -140,39 +389,28 @@ void Model::loadNode(
         assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
 
         const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-        const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
-        bufferPos = reinterpret_cast<const float *>(
-            &(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
-        posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
-        posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
+        AccessorView<glm::vec3> positions(model, posAccessor);
+        // min and max are required for positions, but compute them if an exporter left them out
+        bool hasBounds = posAccessor.minValues.size() >= 3 && posAccessor.maxValues.size() >= 3;
+        if (hasBounds) {
+          posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
+          posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
+        } else {
+          positionBounds(positions, posMin, posMax);
+        }
         vertexCount = static_cast<uint32_t>(posAccessor.count);
-        posByteStride = posAccessor.ByteStride(posView) ? (posAccessor.ByteStride(posView) / sizeof(float))
-                                                        : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
 
+        AccessorView<glm::vec3> normals;
         if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-          const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
-          const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
-          bufferNormals = reinterpret_cast<const float *>(
-              &(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
-          normByteStride = normAccessor.ByteStride(normView) ? (normAccessor.ByteStride(normView) / sizeof(float))
-                                                             : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC3);
+          normals = AccessorView<glm::vec3>(model, model.accessors[primitive.attributes.find("NORMAL")->second]);
         }
-
+        AccessorView<glm::vec2> uv0;
         if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-          const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-          const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-          bufferTexCoordSet0 = reinterpret_cast<const float *>(
-              &(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-          uv0ByteStride = uvAccessor.ByteStride(uvView) ? (uvAccessor.ByteStride(uvView) / sizeof(float))
-                                                        : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC2);
+          uv0 = AccessorView<glm::vec2>(model, model.accessors[primitive.attributes.find("TEXCOORD_0")->second]);
         }
+        AccessorView<glm::vec2> uv1;
         if (primitive.attributes.find("TEXCOORD_1") != primitive.attributes.end()) {
-          const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_1")->second];
-          const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-          bufferTexCoordSet1 = reinterpret_cast<const float *>(
-              &(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-          uv1ByteStride = uvAccessor.ByteStride(uvView) ? (uvAccessor.ByteStride(uvView) / sizeof(float))
-                                                        : tinygltf::GetNumComponentsInType(TINYGLTF_TYPE_VEC2);
+          uv1 = AccessorView<glm::vec2>(model, model.accessors[primitive.attributes.find("TEXCOORD_1")->second]);
         }
 
         // Skinning
@@ -200,51 +438,26 @@ void Model::loadNode(
 
         hasSkin = (bufferJoints && bufferWeights);
 
-        for (size_t v = 0; v < posAccessor.count; v++) {
-          ve::Mesh::Vertex vert{};
-          vert.position = glm::vec4(glm::make_vec3(&bufferPos[v * posByteStride]), 1.0f);
-          vert.position.y *= -1;
-          vert.normal = glm::normalize(
-              glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * normByteStride]) : glm::vec3(0.0f)));
-          vert.normal.y *= -1;
-          vert.uv0 = bufferTexCoordSet0 ? glm::make_vec2(&bufferTexCoordSet0[v * uv0ByteStride]) : glm::vec3(0.0f);
-          vert.uv1 = bufferTexCoordSet1 ? glm::make_vec2(&bufferTexCoordSet1[v * uv1ByteStride]) : glm::vec3(0.0f);
-          vert.color = glm::vec3(1.0f, 1.0f, 1.0f);
-
-          vertexBuffer.push_back(vert);
-        }
+        // the whole primitive is converted in one go, straight into its place in the buffer
+        vertexBuffer.resize(vertexBuffer.size() + vertexCount);
+        ve::Mesh::Vertex *vertices = vertexBuffer.data() + vertexStart;
+        convertVertices(positions, normals, uv0, uv1, vertices, vertexCount);
       }
       // Indices
       if (hasIndices) {
-        const tinygltf::Accessor &accessor = model.accessors[primitive.indices > -1 ? primitive.indices : 0];
-        const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-        const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-
+        const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
         indexCount = static_cast<uint32_t>(accessor.count);
-        const void *dataPtr = &(buffer.data[accessor.byteOffset + bufferView.byteOffset]);
 
         switch (accessor.componentType) {
-        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-          const uint32_t *buf = static_cast<const uint32_t *>(dataPtr);
-          for (size_t index = 0; index < accessor.count; index++) {
-            indexBuffer.push_back(buf[index] + vertexStart);
-          }
+        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
+          appendIndices(AccessorView<uint32_t>(model, accessor), vertexStart, indexBuffer);
           break;
-        }
-        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-          const uint16_t *buf = static_cast<const uint16_t *>(dataPtr);
-          for (size_t index = 0; index < accessor.count; index++) {
-            indexBuffer.push_back(buf[index] + vertexStart);
-          }
+        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
+          appendIndices(AccessorView<uint16_t>(model, accessor), vertexStart, indexBuffer);
           break;
-        }
-        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-          const uint8_t *buf = static_cast<const uint8_t *>(dataPtr);
-          for (size_t index = 0; index < accessor.count; index++) {
-            indexBuffer.push_back(buf[index] + vertexStart);
-          }
+        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
+          appendIndices(AccessorView<uint8_t>(model, accessor), vertexStart, indexBuffer);
           break;
-        }
         default:
           std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
           return;
@@ -256,6 +469,9 @@ void Model::loadNode(
       // std::cout << "glTF::Model::loadNode(): vertexCount: " << vertexCount << std::endl;
       // std::cout << "glTF::Model::loadNode(): primitive.material: " << primitive.material << std::endl;
       Primitive *newPrimitive = new Primitive(indexStart, indexCount, vertexCount, primitive.material);
+      // y is flipped on load, so the bounds have to be flipped with it
+      newPrimitive->bb.min = glm::vec3(posMin.x, -posMax.y, posMin.z);
+      newPrimitive->bb.max = glm::vec3(posMax.x, -posMin.y, posMax.z);
       newMesh->primitives.push_back(newPrimitive);
     }
     newNode->mesh = newMesh;
@@ -16,7 +16,10 @@
 namespace ve {
 namespace glTF {
 struct Node;
-struct BoundingBox {};
+struct BoundingBox {
+  glm::vec3 min{};
+  glm::vec3 max{};
+};
 struct TextureSampler {
   VkFilter magFilter;
   VkFilter minFilter;
@@ -57,6 +60,7 @@ struct Primitive {
   uint32_t vertexCount;
   int32_t material;
   bool hasIndices;
+  BoundingBox bb;
   Primitive(uint32_t firstIndex, uint32_t indexCount, uint32_t vertexCount, int32_t material);
 };
 struct Mesh {
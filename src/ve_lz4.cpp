@@ -0,0 +1,192 @@
+#include "ve_lz4.hpp"
+
+#include <cstring>
+#include <vector>
+
+namespace ve {
+
+namespace lz4 {
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+// the format wants the last 5 bytes to be literals, and no match to start
+// in the last 12
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MATCH_FIND_LIMIT = 12;
+constexpr size_t MAX_OFFSET = 65535;
+constexpr uint32_t HASH_BITS = 16;
+
+uint32_t read32(const uint8_t *data) {
+  uint32_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+uint32_t hash(uint32_t sequence) { return (sequence * 2654435761u) >> (32 - HASH_BITS); }
+
+// lengths of 15 or more continue in bytes of 255 and a final smaller one
+void writeLength(uint8_t *&out, size_t length) {
+  for (; length >= 255; length -= 255) {
+    *out++ = 255;
+  }
+  *out++ = static_cast<uint8_t>(length);
+}
+
+bool readLength(const uint8_t *src, size_t srcSize, size_t &in, size_t &length) {
+  uint8_t byte;
+  do {
+    if (in >= srcSize) {
+      return false;
+    }
+    byte = src[in++];
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// a match of `matchLength` bytes `offset` back, after `literalCount` literals.
+// a match length of 0 ends the block with just the literals
+bool writeSequence(
+    uint8_t *&out,
+    const uint8_t *outEnd,
+    const uint8_t *literals,
+    size_t literalCount,
+    size_t offset,
+    size_t matchLength) {
+  size_t worstCase = 1 + literalCount / 255 + 1 + literalCount + 2 + matchLength / 255 + 1;
+  if (static_cast<size_t>(outEnd - out) < worstCase) {
+    return false;
+  }
+
+  size_t matchCode = matchLength > 0 ? matchLength - MIN_MATCH : 0;
+  uint8_t *token = out++;
+  *token = static_cast<uint8_t>((literalCount < 15 ? literalCount : 15) << 4);
+  if (literalCount >= 15) {
+    writeLength(out, literalCount - 15);
+  }
+  std::memcpy(out, literals, literalCount);
+  out += literalCount;
+
+  if (matchLength == 0) {
+    return true;
+  }
+
+  *out++ = static_cast<uint8_t>(offset);
+  *out++ = static_cast<uint8_t>(offset >> 8);
+  *token |= static_cast<uint8_t>(matchCode < 15 ? matchCode : 15);
+  if (matchCode >= 15) {
+    writeLength(out, matchCode - 15);
+  }
+  return true;
+}
+
+} // namespace
+
+size_t compressBound(size_t size) { return size + size / 255 + 16; }
+
+size_t compress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstCapacity) {
+  uint8_t *out = dst;
+  const uint8_t *outEnd = dst + dstCapacity;
+  size_t anchor = 0;
+
+  if (srcSize > MATCH_FIND_LIMIT) {
+    // greedy: every position is looked up by its first 4 bytes, and the
+    // longest run at the last position with the same hash is taken
+    std::vector<uint32_t> table(size_t{1} << HASH_BITS, 0);
+    size_t matchLimit = srcSize - LAST_LITERALS;
+    size_t searchEnd = srcSize - MATCH_FIND_LIMIT;
+    size_t position = 0;
+    while (position < searchEnd) {
+      uint32_t sequence = read32(src + position);
+      uint32_t &slot = table[hash(sequence)];
+      size_t candidate = slot;
+      slot = static_cast<uint32_t>(position);
+
+      if (candidate >= position || position - candidate > MAX_OFFSET || read32(src + candidate) != sequence) {
+        position++;
+        continue;
+      }
+
+      size_t length = MIN_MATCH;
+      while (position + length < matchLimit && src[candidate + length] == src[position + length]) {
+        length++;
+      }
+      // the match may also reach back into the literals before it
+      while (position > anchor && candidate > 0 && src[position - 1] == src[candidate - 1]) {
+        position--;
+        candidate--;
+        length++;
+      }
+
+      if (!writeSequence(out, outEnd, src + anchor, position - anchor, position - candidate, length)) {
+        return 0;
+      }
+      position += length;
+      anchor = position;
+    }
+  }
+
+  if (!writeSequence(out, outEnd, src + anchor, srcSize - anchor, 0, 0)) {
+    return 0;
+  }
+  return static_cast<size_t>(out - dst);
+}
+
+bool decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < srcSize) {
+    uint8_t token = src[in++];
+
+    size_t literalCount = token >> 4;
+    if (literalCount == 15 && !readLength(src, srcSize, in, literalCount)) {
+      return false;
+    }
+    if (literalCount > srcSize - in || literalCount > dstSize - out) {
+      return false;
+    }
+    std::memcpy(dst + out, src + in, literalCount);
+    in += literalCount;
+    out += literalCount;
+
+    // the last sequence has no match
+    if (in == srcSize) {
+      break;
+    }
+
+    if (srcSize - in < 2) {
+      return false;
+    }
+    size_t offset = src[in] | (size_t{src[in + 1]} << 8);
+    in += 2;
+    if (offset == 0 || offset > out) {
+      return false;
+    }
+
+    size_t matchLength = token & 15;
+    if (matchLength == 15 && !readLength(src, srcSize, in, matchLength)) {
+      return false;
+    }
+    matchLength += MIN_MATCH;
+    if (matchLength > dstSize - out) {
+      return false;
+    }
+
+    // matches closer than their length repeat the bytes they're copying
+    const uint8_t *match = dst + out - offset;
+    if (offset >= matchLength) {
+      std::memcpy(dst + out, match, matchLength);
+    } else {
+      for (size_t i = 0; i < matchLength; i++) {
+        dst[out + i] = match[i];
+      }
+    }
+    out += matchLength;
+  }
+  return out == dstSize;
+}
+
+} // namespace lz4
+
+} // namespace ve
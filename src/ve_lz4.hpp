@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ve {
+
+// the LZ4 block format: a fast byte oriented LZ77 without entropy coding.
+// decompressing is little more than memcpy, which is what matters for
+// assets that get compressed once and read on every start
+namespace lz4 {
+
+// the most `compress()` can write for `size` bytes
+size_t compressBound(size_t size);
+
+// compresses `src` into `dst`, returns the compressed size, or 0 if it
+// didn't fit into `dstCapacity` bytes
+size_t compress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstCapacity);
+
+// decompresses `src` into exactly `dstSize` bytes of `dst`. false if `src`
+// is corrupt or doesn't decompress to `dstSize` bytes, never reads or
+// writes out of bounds either way
+bool decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize);
+
+} // namespace lz4
+
+} // namespace ve
@@ -0,0 +1,166 @@
+#include "ve_mapped_file.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace ve {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path) {
+  HANDLE file = CreateFileA(
+      path.c_str(),
+      GENERIC_READ,
+      FILE_SHARE_READ,
+      nullptr,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+      nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+  m_file = file;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    unmap();
+    throw std::runtime_error("Failed to get the size of " + path);
+  }
+  m_size = static_cast<size_t>(size.QuadPart);
+  // empty files can't be mapped, they just have no data
+  if (m_size == 0) {
+    return;
+  }
+
+  m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping == nullptr) {
+    unmap();
+    throw std::runtime_error("Failed to map " + path);
+  }
+  m_data = static_cast<const uint8_t *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (m_data == nullptr) {
+    unmap();
+    throw std::runtime_error("Failed to map " + path);
+  }
+}
+
+void MappedFile::unmap() {
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file) {
+    CloseHandle(m_file);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_mapping = nullptr;
+  m_file = nullptr;
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data{std::exchange(other.m_data, nullptr)}
+    , m_size{std::exchange(other.m_size, 0)}
+    , m_file{std::exchange(other.m_file, nullptr)}
+    , m_mapping{std::exchange(other.m_mapping, nullptr)} {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    unmap();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    m_file = std::exchange(other.m_file, nullptr);
+    m_mapping = std::exchange(other.m_mapping, nullptr);
+  }
+  return *this;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path) {
+  m_file = open(path.c_str(), O_RDONLY);
+  if (m_file < 0) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+
+  struct stat info;
+  if (fstat(m_file, &info) != 0) {
+    unmap();
+    throw std::runtime_error("Failed to get the size of " + path);
+  }
+  m_size = static_cast<size_t>(info.st_size);
+  // empty files can't be mapped, they just have no data
+  if (m_size == 0) {
+    return;
+  }
+
+  void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+  if (data == MAP_FAILED) {
+    unmap();
+    throw std::runtime_error("Failed to map " + path);
+  }
+  m_data = static_cast<const uint8_t *>(data);
+  // everything gets read front to back right away
+  madvise(data, m_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+}
+
+void MappedFile::unmap() {
+  if (m_data) {
+    munmap(const_cast<uint8_t *>(m_data), m_size);
+  }
+  if (m_file >= 0) {
+    close(m_file);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_file = -1;
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : m_data{std::exchange(other.m_data, nullptr)}
+    , m_size{std::exchange(other.m_size, 0)}
+    , m_file{std::exchange(other.m_file, -1)} {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    unmap();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    m_file = std::exchange(other.m_file, -1);
+  }
+  return *this;
+}
+
+#endif
+
+MappedFile::~MappedFile() { unmap(); }
+
+bool saveFile(const std::string &path, const std::vector<uint8_t> &data) {
+  // written next to the final file first, so a crash never leaves half of one behind
+  std::string temporaryPath = path + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char *>(data.data()), data.size())) {
+      return false;
+    }
+  }
+  std::remove(path.c_str());
+  return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+} // namespace ve
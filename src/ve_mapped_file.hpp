@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ve {
+
+// a whole file mapped read only into memory, pages are read in as they're
+// first touched. throws if the file can't be opened or mapped
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  const uint8_t *data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+private:
+  void unmap();
+
+  const uint8_t *m_data{nullptr};
+  size_t m_size{0};
+#ifdef _WIN32
+  void *m_file{nullptr};
+  void *m_mapping{nullptr};
+#else
+  int m_file{-1};
+#endif
+};
+
+// writes a whole file at once, false if that failed. the file is either
+// replaced completely or left as it was
+bool saveFile(const std::string &path, const std::vector<uint8_t> &data);
+
+} // namespace ve
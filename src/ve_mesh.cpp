@@ -7,47 +7,16 @@
 
 namespace ve {
 
-std::vector<VkVertexInputBindingDescription> Mesh::Vertex::getBindingDescriptions() {
-  std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
-  bindingDescriptions[0].binding = 0;
-  bindingDescriptions[0].stride = sizeof(Vertex);
-  bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-  return bindingDescriptions;
-}
-
-std::vector<VkVertexInputAttributeDescription> Mesh::Vertex::getAttributeDescriptions() {
-  std::vector<VkVertexInputAttributeDescription> attributeDescriptions(5);
-
-  attributeDescriptions[0].binding = 0;
-  attributeDescriptions[0].location = 0;
-  attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[0].offset = offsetof(Vertex, position);
-
-  attributeDescriptions[1].binding = 0;
-  attributeDescriptions[1].location = 1;
-  attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[1].offset = offsetof(Vertex, color);
-
-  attributeDescriptions[2].binding = 0;
-  attributeDescriptions[2].location = 2;
-  attributeDescriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[2].offset = offsetof(Vertex, normal);
-
-  attributeDescriptions[3].binding = 0;
-  attributeDescriptions[3].location = 3;
-  attributeDescriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
-  attributeDescriptions[3].offset = offsetof(Vertex, uv0);
-
-  attributeDescriptions[4].binding = 0;
-  attributeDescriptions[4].location = 4;
-  attributeDescriptions[4].format = VK_FORMAT_R32G32_SFLOAT;
-  attributeDescriptions[4].offset = offsetof(Vertex, uv1);
-
-  return attributeDescriptions;
+uint32_t Mesh::Primitive::selectLod(float errorScale) const {
+  for (uint32_t lod = lodCount - 1; lod > 0; lod--) {
+    if (lods[lod].error * errorScale <= 1.0f) {
+      return lod;
+    }
+  }
+  return 0;
 }
 
-bool Mesh::operator==(const Mesh &other) {
+bool Mesh::operator==(const Mesh &other) const {
   return (this->primitiveCount == other.primitiveCount) && (this->firstPrimitive == other.firstPrimitive);
 }
 
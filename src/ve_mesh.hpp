@@ -2,11 +2,13 @@
 
 #include "ve_buffer.hpp"
 #include "ve_device.hpp"
+#include "ve_vertex_layout.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include <array>
 #include <vector>
 
 namespace ve {
@@ -17,38 +19,91 @@ namespace ve {
 // the mesh.
 class Mesh {
 public:
+  // vertices as they're loaded and processed on the cpu, `Layout` is what
+  // they get packed into in the vertex buffer
   struct Vertex {
     glm::vec3 position;
-    glm::vec3 color;
     glm::vec3 normal;
     glm::vec2 uv0;
     glm::vec2 uv1;
-
-    static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
-    static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
   };
 
+  using Layout = PackedVertexLayout;
+
+  // indices as they're loaded and processed on the cpu
   typedef uint32_t IndexType;
-  static constexpr VkIndexType vulkanIndexType = VK_INDEX_TYPE_UINT32;
+
+  // the gpu's index buffers are split into arenas by index size. primitives
+  // whose vertices fit 16 bit indices go into the first one, the rest into the second
+  static constexpr uint32_t INDEX_ARENA_COUNT = 2;
+  static constexpr uint32_t SHORT_INDEX_ARENA = 0;
+  static constexpr uint32_t LONG_INDEX_ARENA = 1;
+  static constexpr uint32_t MAX_SHORT_INDEX_VERTEX_COUNT = 65536;
+
+  // geometry is spread over pages of separate buffers, every page has a
+  // vertex buffer and an index buffer per arena. draws are grouped by the
+  // index buffer they use, numbered page * INDEX_ARENA_COUNT + arena
+  static constexpr uint32_t MAX_PAGE_COUNT = 16;
+  static constexpr uint32_t INDEX_BUFFER_COUNT = MAX_PAGE_COUNT * INDEX_ARENA_COUNT;
+
+  static constexpr VkIndexType indexType(uint32_t arena) {
+    return arena == SHORT_INDEX_ARENA ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+  }
+  static constexpr uint32_t indexSize(uint32_t arena) { return arena == SHORT_INDEX_ARENA ? 2 : 4; }
 
   struct Data {
     std::vector<Vertex> vertices{};
     std::vector<uint32_t> indices{};
   };
 
+  // simplified versions of a primitive, sharing its vertices
+  static constexpr uint32_t MAX_LOD_COUNT = 4;
+
+  struct Lod {
+    Mesh::IndexType firstIndex;
+    uint32_t indexCount;
+    // how far, in object space, the lod's surface strays from the full resolution one
+    float error;
+  };
+
   struct Primitive {
     int32_t material{-1};
     uint32_t vertexCount;
     uint32_t indexCount;
+    // first index, and those of the lods, count from the start of the primitive's index arena
+    uint32_t indexArena{LONG_INDEX_ARENA};
+    // the page holding the primitive's vertices and indices, set when it's loaded
+    uint32_t page{0};
     Mesh::IndexType firstIndex;
     int32_t vertexOffset;
+
+    // object space bounds, used for culling
+    glm::vec3 boundsMin{0.0f};
+    glm::vec3 boundsMax{0.0f};
+
+    // undoes the quantization of the positions in the vertex buffer, if `Layout` quantizes them
+    vertex::Quantization quantization{};
+
+    // lods[0] is the primitive itself, every following one has fewer triangles and a larger error
+    std::array<Lod, MAX_LOD_COUNT> lods{};
+    uint32_t lodCount{1};
+
+    uint32_t indexBuffer() const { return page * INDEX_ARENA_COUNT + indexArena; }
+
+    // the coarsest lod whose error stays below 1 once multiplied by
+    // `errorScale`, the size of one unit of object space in pixels, say
+    uint32_t selectLod(float errorScale) const;
   };
 
   void draw(VkCommandBuffer cmd);
 
-  bool operator==(const Mesh &other);
+  bool operator==(const Mesh &other) const;
   uint32_t primitiveCount;
   uint32_t firstPrimitive;
+
+  // union of the bounds of all primitives in the mesh
+  glm::vec3 boundsMin{0.0f};
+  glm::vec3 boundsMax{0.0f};
 };
 
 } // namespace ve
\ No newline at end of file
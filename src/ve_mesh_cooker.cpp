@@ -0,0 +1,282 @@
+#include "ve_mesh_cooker.hpp"
+
+#include "ve_gltf_loader.hpp"
+#include "ve_mesh_simplify.hpp"
+#include "ve_vemesh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+namespace ve {
+
+MeshCooker::MeshCooker(ThreadPool &threadPool)
+    : m_threadPool{threadPool} {}
+
+int64_t MeshCooker::sourceTime(const std::string &path) {
+  std::error_code error;
+  auto time = std::filesystem::last_write_time(path, error);
+  return error ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+}
+
+void MeshCooker::weldPrimitives(glTF::Model &model, glTF::Mesh &mesh) {
+  // primitives never share indices and only read the vertices, so each can be welded on its own
+  uint32_t before = 0;
+  for (auto primitive : mesh.primitives) {
+    before += primitive->vertexCount;
+  }
+
+  m_threadPool.parallelFor(mesh.primitives.size(), 1, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      glTF::Primitive &primitive = *mesh.primitives[i];
+      if (primitive.indexCount == 0) {
+        continue;
+      }
+      primitive.vertexCount = weldVertices(
+          model.vertexBuffer,
+          model.indexBuffer.data() + primitive.firstIndex,
+          primitive.indexCount,
+          m_weldTolerance);
+    }
+  });
+
+  uint32_t after = 0;
+  for (auto primitive : mesh.primitives) {
+    after += primitive->vertexCount;
+  }
+  std::cout << "MeshCooker::weldPrimitives(): " << before << " -> " << after << " vertices";
+  if (before > 0) {
+    std::cout << " (" << 100.0f * (before - after) / before << "% fewer)";
+  }
+  std::cout << std::endl;
+}
+
+void MeshCooker::optimizePrimitive(glTF::Model &model, const glTF::Primitive &primitive) {
+  if (primitive.indexCount < 3) {
+    return;
+  }
+
+  uint32_t *indices = model.indexBuffer.data() + primitive.firstIndex;
+  VertexCacheStats before = analyzeVertexCache(indices, primitive.indexCount, VERTEX_CACHE_SIZE);
+
+  // overdraw only moves whole clusters around, which costs little of what
+  // ordering for the cache gained
+  std::vector<uint32_t> clusters;
+  optimizeVertexCache(indices, primitive.indexCount, VERTEX_CACHE_SIZE, &clusters);
+  optimizeOverdraw(indices, primitive.indexCount, model.vertexBuffer, clusters);
+
+  VertexCacheStats after = analyzeVertexCache(indices, primitive.indexCount, VERTEX_CACHE_SIZE);
+  std::cout << "MeshCooker::optimizePrimitive(): " << primitive.indexCount / 3 << " triangles, ACMR " << before.acmr
+            << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+}
+
+std::vector<Mesh::Lod> MeshCooker::generateLods(
+    const glTF::Model &model,
+    const glTF::Primitive &primitive,
+    std::vector<uint32_t> &lodIndices) {
+  std::vector<Mesh::Lod> lods;
+  if (primitive.indexCount < 3) {
+    return lods;
+  }
+
+  float maxError = LOD_MAX_ERROR * glm::length(primitive.bb.max - primitive.bb.min);
+
+  // every lod is simplified from the one before it, so their errors add up
+  std::vector<uint32_t> indices(
+      model.indexBuffer.begin() + primitive.firstIndex,
+      model.indexBuffer.begin() + primitive.firstIndex + primitive.indexCount);
+  float totalError = 0.0f;
+  while (lods.size() + 1 < Mesh::MAX_LOD_COUNT) {
+    size_t target = static_cast<size_t>(indices.size() / 3 * LOD_REDUCTION) * 3;
+    float error;
+    std::vector<uint32_t> simplified =
+        simplifyMesh(model.vertexBuffer, indices.data(), indices.size(), target, maxError - totalError, error);
+    if (simplified.empty() || simplified.size() > indices.size() * LOD_MIN_REDUCTION) {
+      break;
+    }
+    optimizeVertexCache(simplified.data(), simplified.size(), VERTEX_CACHE_SIZE);
+
+    totalError += error;
+    lods.push_back(
+        {static_cast<uint32_t>(lodIndices.size()), static_cast<uint32_t>(simplified.size()), totalError});
+    lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+    indices = std::move(simplified);
+  }
+
+  std::cout << "MeshCooker::generateLods(): " << primitive.indexCount / 3 << " triangles";
+  for (const Mesh::Lod &lod : lods) {
+    std::cout << ", " << lod.indexCount / 3;
+  }
+  std::cout << std::endl;
+  return lods;
+}
+
+std::vector<uint8_t> MeshCooker::cookglTF(const std::string &path, int64_t sourceTime) {
+  glTF::Model model;
+  model.loadFromFile(path);
+
+  size_t numberOfMeshes = 0;
+  glTF::Mesh *firstMesh = nullptr;
+  for (auto node : model.nodes) {
+    if (node->mesh != nullptr) {
+      if (firstMesh == nullptr) {
+        firstMesh = node->mesh;
+      }
+      numberOfMeshes++;
+    }
+  }
+
+  if (numberOfMeshes == 0) {
+    std::cout << "MeshCooker::cookglTF(): ERROR: tried to load a gltf that doesn't contain any meshes" << std::endl;
+    throw std::runtime_error("No meshes");
+  }
+  if (numberOfMeshes > 1) {
+    std::cout << "MeshCooker::cookglTF(): WARNING: Trying to load glTF file with multiple meshes. Only the first "
+                 "mesh will be "
+                 "accessible, but all geometry in the file will be loaded into memory. One mesh per glTF file please."
+              << std::endl;
+  }
+
+  // duplicate vertices are welded first, then triangles are reordered per
+  // primitive and the vertices of the whole file in the order the triangles
+  // use them, which also drops the welded ones. lods are built after that,
+  // so they share the reordered vertices
+  weldPrimitives(model, *firstMesh);
+  for (auto primitive : firstMesh->primitives) {
+    optimizePrimitive(model, *primitive);
+  }
+  optimizeVertexFetch(model.vertexBuffer, model.indexBuffer.data(), model.indexBuffer.size());
+
+  // simplify every primitive into a chain of lods, the lods' first indices
+  // start out relative to `lodIndices`
+  std::vector<uint32_t> lodIndices;
+  std::vector<std::vector<Mesh::Lod>> primitiveLods;
+  for (auto primitive : firstMesh->primitives) {
+    primitiveLods.push_back(generateLods(model, *primitive, lodIndices));
+  }
+
+  // sort every primitive and its lods into an index arena. a primitive goes
+  // into the 16 bit one if its vertices span few enough of them, its
+  // indices are then made relative to its first vertex
+  std::array<std::vector<uint8_t>, Mesh::INDEX_ARENA_COUNT> arenaIndices;
+  auto appendIndices = [&](uint32_t arena, const uint32_t *indices, uint32_t count, uint32_t base) {
+    std::vector<uint8_t> &data = arenaIndices[arena];
+    uint32_t indexSize = Mesh::indexSize(arena);
+    uint32_t firstIndex = static_cast<uint32_t>(data.size() / indexSize);
+    data.resize(data.size() + count * indexSize);
+    uint8_t *out = data.data() + data.size() - count * indexSize;
+    for (uint32_t i = 0; i < count; i++) {
+      if (arena == Mesh::SHORT_INDEX_ARENA) {
+        uint16_t index = static_cast<uint16_t>(indices[i] - base);
+        std::memcpy(out + i * indexSize, &index, indexSize);
+      } else {
+        std::memcpy(out + i * indexSize, &indices[i], indexSize);
+      }
+    }
+    return firstIndex;
+  };
+
+  // all primitives of the file share one quantization
+  vertex::Quantization quantization =
+      Mesh::Layout::quantization(model.vertexBuffer.data(), model.vertexBuffer.size());
+
+  std::vector<Mesh::Primitive> primitives;
+  for (size_t i = 0; i < firstMesh->primitives.size(); i++) {
+    glTF::Primitive *primitive = firstMesh->primitives[i];
+    const uint32_t *indices = model.indexBuffer.data() + primitive->firstIndex;
+
+    // lods only ever use vertices of the primitive they were simplified from
+    uint32_t base = 0;
+    uint32_t arena = Mesh::LONG_INDEX_ARENA;
+    if (primitive->indexCount > 0) {
+      auto range = std::minmax_element(indices, indices + primitive->indexCount);
+      if (*range.second - *range.first < Mesh::MAX_SHORT_INDEX_VERTEX_COUNT) {
+        base = *range.first;
+        arena = Mesh::SHORT_INDEX_ARENA;
+      }
+    }
+
+    Mesh::Primitive newPrimitive{};
+    newPrimitive.material = primitive->material;
+    newPrimitive.indexArena = arena;
+    newPrimitive.firstIndex = appendIndices(arena, indices, primitive->indexCount, base);
+    newPrimitive.indexCount = primitive->indexCount;
+    newPrimitive.vertexCount = primitive->vertexCount;
+    newPrimitive.vertexOffset = static_cast<int32_t>(base);
+    newPrimitive.boundsMin = primitive->bb.min;
+    newPrimitive.boundsMax = primitive->bb.max;
+    newPrimitive.quantization = quantization;
+    newPrimitive.lods[0] = {newPrimitive.firstIndex, newPrimitive.indexCount, 0.0f};
+    for (const Mesh::Lod &lod : primitiveLods[i]) {
+      Mesh::Lod &newLod = newPrimitive.lods[newPrimitive.lodCount++];
+      newLod = lod;
+      newLod.firstIndex = appendIndices(arena, lodIndices.data() + lod.firstIndex, lod.indexCount, base);
+    }
+    primitives.push_back(newPrimitive);
+  }
+
+  std::vector<uint8_t> packedVertices(model.vertexBuffer.size() * Mesh::Layout::stride);
+  Mesh::Layout::pack(model.vertexBuffer.data(), model.vertexBuffer.size(), quantization, packedVertices.data());
+
+  vemesh::Writer writer;
+
+  // textures first, their table points at their paths or pixels
+  std::vector<vemesh::Texture> textures;
+  for (const glTF::Texture &texture : model.textures) {
+    vemesh::Texture newTexture{};
+    if (texture.isExternalTexture) {
+      newTexture.path = writer.append(texture.texturePath.data(), texture.texturePath.size());
+    } else {
+      newTexture.pixels = writer.append(texture.rawData);
+      newTexture.width = static_cast<uint32_t>(texture.width);
+      newTexture.height = static_cast<uint32_t>(texture.height);
+    }
+    textures.push_back(newTexture);
+  }
+
+  std::vector<vemesh::Material> materials;
+  for (const glTF::Material &material : model.materials) {
+    vemesh::Material newMaterial{};
+    newMaterial.baseColorFactor = material.baseColorFactor;
+    newMaterial.emissiveFactor = material.emissiveFactor;
+    newMaterial.metallicRoughnessFactor = glm::vec4(1.0f, material.roughnessFactor, material.metallicFactor, 1.0f);
+
+    // without textures every material uses the default ones
+    bool textured = !textures.empty();
+    newMaterial.baseColorTexture = textured ? material.baseColorTexture : vemesh::NO_TEXTURE;
+    newMaterial.metallicRoughnessTexture = textured ? material.metallicRoughnessTexture : vemesh::NO_TEXTURE;
+    newMaterial.normalTexture = textured ? material.normalTexture : vemesh::NO_TEXTURE;
+    newMaterial.occlusionTexture = textured ? material.occlusionTexture : vemesh::NO_TEXTURE;
+    newMaterial.emissiveTexture = textured ? material.emissiveTexture : vemesh::NO_TEXTURE;
+    materials.push_back(newMaterial);
+  }
+
+  vemesh::Header header{};
+  header.magic = vemesh::MAGIC;
+  header.version = vemesh::VERSION;
+  header.vertexStride = Mesh::Layout::stride;
+  header.primitiveSize = sizeof(Mesh::Primitive);
+  header.sourceTime = sourceTime;
+  header.vertexCount = static_cast<uint32_t>(model.vertexBuffer.size());
+  header.primitiveCount = static_cast<uint32_t>(primitives.size());
+  header.materialCount = static_cast<uint32_t>(materials.size());
+  header.textureCount = static_cast<uint32_t>(textures.size());
+  header.vertices = writer.append(packedVertices);
+  for (uint32_t arena = 0; arena < Mesh::INDEX_ARENA_COUNT; arena++) {
+    header.indexCounts[arena] = static_cast<uint32_t>(arenaIndices[arena].size() / Mesh::indexSize(arena));
+    header.indices[arena] = writer.append(arenaIndices[arena]);
+  }
+  header.primitives = writer.append(primitives);
+  header.materials = writer.append(materials);
+  header.textures = writer.append(textures);
+
+  std::cout << "MeshCooker::cookglTF(): " << path << ": " << header.vertexCount << " vertices, "
+            << header.indexCounts[Mesh::SHORT_INDEX_ARENA] << " 16 bit and "
+            << header.indexCounts[Mesh::LONG_INDEX_ARENA] << " 32 bit indices" << std::endl;
+  return writer.finish(header);
+}
+
+} // namespace ve
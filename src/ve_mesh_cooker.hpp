@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ve_mesh.hpp"
+#include "ve_mesh_optimize.hpp"
+#include "ve_thread_pool.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ve {
+
+namespace glTF {
+struct Model;
+struct Mesh;
+struct Primitive;
+} // namespace glTF
+
+// turns source models into .vemesh files (see ve_vemesh.hpp), doing all the
+// cpu work of importing them once: parsing, welding, ordering for the
+// caches, simplifying into lods and packing vertices and indices the way
+// the gpu buffers hold them. needs no device
+class MeshCooker {
+public:
+  MeshCooker(ThreadPool &threadPool);
+
+  // how close vertices have to be to get welded
+  void setWeldTolerance(const WeldTolerance &tolerance) { m_weldTolerance = tolerance; }
+
+  // the contents of a .vemesh file for the glTF file at `path`, recording
+  // `sourceTime` as the time the source was written. throws if it can't be loaded
+  std::vector<uint8_t> cookglTF(const std::string &path, int64_t sourceTime);
+
+  // last write time of `path`, in whatever unit the file system uses
+  static int64_t sourceTime(const std::string &path);
+
+private:
+  // welds the duplicate vertices of every primitive of `mesh`, in parallel
+  void weldPrimitives(glTF::Model &model, glTF::Mesh &mesh);
+  // reorders the triangles of `primitive` for the vertex cache and then for
+  // overdraw, and reports how many vertices are transformed per triangle
+  void optimizePrimitive(glTF::Model &model, const glTF::Primitive &primitive);
+  // simplifies `primitive` into up to Mesh::MAX_LOD_COUNT - 1 lods, appending
+  // their indices to `lodIndices`. the lods' first indices point into `lodIndices`
+  std::vector<Mesh::Lod> generateLods(
+      const glTF::Model &model,
+      const glTF::Primitive &primitive,
+      std::vector<uint32_t> &lodIndices);
+
+  // entries of the post transform cache triangles are ordered for, small
+  // enough that every gpu has at least that many
+  static constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+  // every lod aims for this fraction of the previous one's triangles, and the
+  // chain ends once simplifying can't get below `LOD_MIN_REDUCTION` of them
+  static constexpr float LOD_REDUCTION = 0.5f;
+  static constexpr float LOD_MIN_REDUCTION = 0.9f;
+  // largest error a lod may have, relative to the diagonal of its primitive's bounds
+  static constexpr float LOD_MAX_ERROR = 0.25f;
+
+  ThreadPool &m_threadPool;
+  WeldTolerance m_weldTolerance{};
+};
+
+} // namespace ve
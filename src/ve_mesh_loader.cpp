@@ -1,229 +1,646 @@
 #include "ve_mesh_loader.hpp"
 
-#include "ve_gltf_loader.hpp"
+#include "ve_swapchain.hpp"
+#include "ve_vemesh.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <limits>
 
 namespace ve {
 
 const std::string MeshLoader::MODEL_PATH = "models/";
 
-MeshLoader::MeshLoader(Device &device)
-    : m_device{device}
-    , m_invalidBuffers{true}
-    , m_textureLoader{device} {
-  m_bigVertexBuffer = std::make_unique<Buffer>(m_device.getAllocator());
-  m_bigIndexBuffer = std::make_unique<Buffer>(m_device.getAllocator());
-  m_bigVertexBuffer->create(
-      INITIAL_BUFFER_SIZE,
-      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      0,
-      VMA_MEMORY_USAGE_GPU_ONLY);
-  m_bigIndexBuffer->create(
-      INITIAL_BUFFER_SIZE,
-      VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      0,
-      VMA_MEMORY_USAGE_GPU_ONLY);
-
+MeshLoader::MeshLoader(Device &device, ThreadPool &threadPool, FileSystem &fileSystem, UploadContext &uploadContext)
+    : m_invalidBuffers{true}
+    , m_textureLoader{device, fileSystem, uploadContext}
+    , m_cooker{threadPool}
+    , m_device{device}
+    , m_threadPool{threadPool}
+    , m_fileSystem{fileSystem}
+    , m_uploadContext{uploadContext} {
   // add default empty material at index 0
   addMaterial({});
 }
 
-MeshLoader::~MeshLoader() {}
+MeshLoader::~MeshLoader() {
+  // workers reading a file still use the loader
+  for (const std::unique_ptr<StreamingMesh> &streaming : m_streamingMeshes) {
+    if (!streaming->read) {
+      streaming->reading.wait();
+    }
+  }
+  // copies into the buffers and textures about to be destroyed
+  m_uploadContext.wait(m_uploadContext.submit());
+}
 
-void MeshLoader::growVertexBuffer() {
-  std::cout << "ModelLoader: grew vertex buffer. New size: " << m_currentVertexBufferSize * 2 << std::endl;
-  auto newBuffer = std::make_unique<Buffer>(m_device.getAllocator());
-  newBuffer->create(
-      m_currentVertexBufferSize * 2,
-      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      0,
-      VMA_MEMORY_USAGE_GPU_ONLY);
-  m_device.copyBuffer(m_bigVertexBuffer->buffer, newBuffer->buffer, m_currentVertexBufferSize);
+VkDeviceSize MeshLoader::elementSize(uint32_t ranges) {
+  return ranges == VERTEX_RANGES ? Mesh::Layout::stride : Mesh::indexSize(ranges);
+}
 
-  m_currentVertexBufferSize *= 2;
-  m_bigVertexBuffer = std::move(newBuffer);
+bool MeshLoader::createBuffer(uint32_t page, uint32_t ranges, uint32_t count) {
+  VkDeviceSize size = std::max(PAGE_SIZE, count * elementSize(ranges));
+  if (m_bufferBytes[ranges] + size > m_bufferBudget) {
+    return false;
+  }
+  if (ranges == VERTEX_RANGES) {
+    std::cout << "MeshLoader: created vertex buffer of page " << page << ". Size: " << size << std::endl;
+  } else {
+    std::cout << "MeshLoader: created " << Mesh::indexSize(ranges) * 8 << " bit index buffer of page " << page
+              << ". Size: " << size << std::endl;
+  }
+
+  VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  usage |= ranges == VERTEX_RANGES ? VK_BUFFER_USAGE_VERTEX_BUFFER_BIT : VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+  GeometryPage &geometryPage = m_pages[page];
+  geometryPage.buffers[ranges] = std::make_unique<Buffer>(m_device.getAllocator());
+  // uploads into new meshes may run on another queue while this one draws the others
+  geometryPage.buffers[ranges]->create(
+      size,
+      usage,
+      0,
+      VMA_MEMORY_USAGE_GPU_ONLY,
+      m_uploadContext.sharedQueueFamilies());
+  geometryPage.allocators[ranges].grow(static_cast<uint32_t>(size / elementSize(ranges)));
+  m_bufferBytes[ranges] += size;
   m_invalidBuffers = true;
+  return true;
 }
 
-void MeshLoader::growIndexBuffer() {
-  std::cout << "MeshLoader: grew index buffer. New size: " << m_currentIndexBufferSize * 2 << std::endl;
-  auto newBuffer = std::make_unique<Buffer>(m_device.getAllocator());
-  newBuffer->create(
-      m_currentIndexBufferSize * 2,
-      VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      0,
-      VMA_MEMORY_USAGE_GPU_ONLY);
-  m_device.copyBuffer(m_bigIndexBuffer->buffer, newBuffer->buffer, m_currentIndexBufferSize);
+bool MeshLoader::allocateInPage(uint32_t page, LoadedMesh &loaded) {
+  GeometryPage &geometryPage = m_pages[page];
+  uint32_t ranges = 0;
+  for (; ranges < RANGE_COUNT; ranges++) {
+    uint32_t count = loaded.counts[ranges];
+    if (count == 0) {
+      continue;
+    }
+    if (!geometryPage.buffers[ranges] && !createBuffer(page, ranges, count)) {
+      break;
+    }
+    loaded.offsets[ranges] = geometryPage.allocators[ranges].allocate(count);
+    if (loaded.offsets[ranges] == RangeAllocator::INVALID_OFFSET) {
+      break;
+    }
+  }
+  if (ranges == RANGE_COUNT) {
+    loaded.page = page;
+    return true;
+  }
 
-  m_currentIndexBufferSize *= 2;
-  m_bigIndexBuffer = std::move(newBuffer);
-  m_invalidBuffers = true;
+  for (uint32_t allocated = 0; allocated < ranges; allocated++) {
+    if (loaded.counts[allocated] > 0) {
+      geometryPage.allocators[allocated].free(loaded.offsets[allocated]);
+    }
+  }
+  return false;
 }
 
-void MeshLoader::bindBuffers(VkCommandBuffer cmd) {
-  VkBuffer buffers[] = {m_bigVertexBuffer->buffer};
-  VkDeviceSize offsets[] = {0};
-  vkCmdBindVertexBuffers(cmd, 0, 1, buffers, offsets);
+bool MeshLoader::allocateMesh(LoadedMesh &loaded) {
+  for (uint32_t page = 0; page < pageCount(); page++) {
+    if (allocateInPage(page, loaded)) {
+      return true;
+    }
+  }
 
-  vkCmdBindIndexBuffer(cmd, m_bigIndexBuffer->buffer, 0, Mesh::vulkanIndexType);
+  if (m_pages.size() < Mesh::MAX_PAGE_COUNT) {
+    m_pages.emplace_back();
+    if (allocateInPage(pageCount() - 1, loaded)) {
+      return true;
+    }
+    m_pages.pop_back();
+  }
+  // frames in flight may still read the ranges of unloaded and moved meshes,
+  // rather than waiting for the gpu the mesh waits until they're released
+  if (!m_retiredRanges.empty()) {
+    return false;
+  }
+  throw std::runtime_error("MeshLoader: geometry doesn't fit in the buffer budget");
+}
 
-  m_invalidBuffers = false;
+void MeshLoader::freeMesh(const LoadedMesh &loaded) {
+  for (uint32_t ranges = 0; ranges < RANGE_COUNT; ranges++) {
+    if (loaded.counts[ranges] > 0) {
+      m_pages[loaded.page].allocators[ranges].free(loaded.offsets[ranges]);
+    }
+  }
 }
 
-Mesh MeshLoader::loadFromglTF(const std::string &filepath) {
-  if (m_loadedMeshes.find(filepath) != m_loadedMeshes.end()) {
-    std::cout << "MeshLoader: " << filepath << " is already loaded." << std::endl;
-    return m_loadedMeshes[filepath];
-  } else {
-    glTF::Model model;
-    model.loadFromFile(MODEL_PATH + filepath);
-
-    // std::cout << "MeshLoader::loadFromglTF(): " << filepath << ":" << std::endl;
-    // std::cout << "\tmodel.nodes.size(): " << model.nodes.size() << ":" << std::endl;
-
-    size_t numberOfMeshes = 0;
-    glTF::Mesh *firstMesh = nullptr;
-    for (auto node : model.nodes) {
-      if (node->mesh != nullptr) {
-        if (firstMesh == nullptr) {
-          firstMesh = node->mesh;
+void MeshLoader::trackMesh(LoadedMesh &loaded) {
+  for (uint32_t ranges = 0; ranges < RANGE_COUNT; ranges++) {
+    if (loaded.counts[ranges] > 0) {
+      m_pages[loaded.page].meshes[ranges][loaded.offsets[ranges]] = &loaded;
+    }
+  }
+}
+
+void MeshLoader::untrackMesh(const LoadedMesh &loaded) {
+  for (uint32_t ranges = 0; ranges < RANGE_COUNT; ranges++) {
+    if (loaded.counts[ranges] > 0) {
+      m_pages[loaded.page].meshes[ranges].erase(loaded.offsets[ranges]);
+    }
+  }
+}
+
+void MeshLoader::releaseRetiredRanges() {
+  if (m_retiredRanges.empty()) {
+    return;
+  }
+  vkDeviceWaitIdle(m_device.device());
+  for (const RetiredRange &range : m_retiredRanges) {
+    m_pages[range.page].allocators[range.ranges].free(range.offset);
+  }
+  m_retiredRanges.clear();
+}
+
+void MeshLoader::unloadMesh(const std::string &filepath) {
+  auto found = m_loadedMeshes.find(filepath);
+  if (found == m_loadedMeshes.end()) {
+    std::cout << "MeshLoader: " << filepath << " isn't loaded." << std::endl;
+    return;
+  }
+
+  const LoadedMesh &loaded = found->second;
+  untrackMesh(loaded);
+  for (uint32_t ranges = 0; ranges < RANGE_COUNT; ranges++) {
+    if (loaded.counts[ranges] > 0) {
+      m_retiredRanges.push_back({loaded.page, ranges, loaded.offsets[ranges], m_frame});
+    }
+  }
+  // draw calls of the mesh that are still around draw nothing from now on.
+  // its materials and textures stay loaded
+  for (uint32_t i = 0; i < loaded.mesh.primitiveCount; i++) {
+    uint32_t index = loaded.mesh.firstPrimitive + i;
+    primitives[index] = Mesh::Primitive{};
+    primitives[index].material = 0;
+    m_movedPrimitives.push_back(index);
+  }
+  m_loadedMeshes.erase(found);
+}
+
+void MeshLoader::advanceFrame() {
+  m_frame++;
+
+  // the frame whose fence was waited on for this one is the last that could
+  // have read ranges retired MAX_FRAMES_IN_FLIGHT frames ago
+  auto released = std::remove_if(m_retiredRanges.begin(), m_retiredRanges.end(), [&](const RetiredRange &range) {
+    if (m_frame - range.frame < static_cast<uint64_t>(Swapchain::MAX_FRAMES_IN_FLIGHT)) {
+      return false;
+    }
+    m_pages[range.page].allocators[range.ranges].free(range.offset);
+    return true;
+  });
+  m_retiredRanges.erase(released, m_retiredRanges.end());
+
+  VkDeviceSize budget = COMPACTION_BYTES_PER_FRAME;
+  for (uint32_t page = 0; page < pageCount() && budget > 0; page++) {
+    for (uint32_t ranges = 0; ranges < RANGE_COUNT && budget > 0; ranges++) {
+      compact(page, ranges, budget);
+    }
+  }
+
+  updateStreaming();
+}
+
+void MeshLoader::compact(uint32_t page, uint32_t ranges, VkDeviceSize &budget) {
+  RangeAllocator &rangeAllocator = m_pages[page].allocators[ranges];
+  if (rangeAllocator.stats().holes == 0) {
+    return;
+  }
+
+  // all copies go into one command, so a mesh only moves once per frame,
+  // otherwise one copy could read what another one writes. the meshes are
+  // walked from the highest range down, each into the lowest hole below it
+  // that fits, and only put back at their new offsets once the walk is done
+  std::map<uint32_t, LoadedMesh *> &meshes = m_pages[page].meshes[ranges];
+  std::vector<VkBufferCopy> copies;
+  std::vector<std::pair<uint32_t, LoadedMesh *>> moved;
+  VkDeviceSize size = elementSize(ranges);
+  // a mesh that found no hole below it, meshes at least as big further down won't either
+  uint32_t smallestMisfit = std::numeric_limits<uint32_t>::max();
+  for (auto entry = meshes.rbegin(); entry != meshes.rend() && budget > 0; ++entry) {
+    LoadedMesh *loaded = entry->second;
+    uint32_t from = entry->first;
+    uint32_t count = loaded->counts[ranges];
+    if (count >= smallestMisfit) {
+      continue;
+    }
+    uint32_t to = rangeAllocator.allocateBelow(count, from);
+    if (to == RangeAllocator::INVALID_OFFSET) {
+      smallestMisfit = count;
+      continue;
+    }
+
+    copies.push_back({from * size, to * size, count * size});
+    // frames in flight still draw from the old range
+    m_retiredRanges.push_back({page, ranges, from, m_frame});
+    loaded->offsets[ranges] = to;
+    moved.push_back({from, loaded});
+    budget -= std::min(budget, count * size);
+
+    const Mesh &mesh = loaded->mesh;
+    for (uint32_t i = 0; i < mesh.primitiveCount; i++) {
+      uint32_t index = mesh.firstPrimitive + i;
+      Mesh::Primitive &primitive = primitives[index];
+      if (ranges == VERTEX_RANGES) {
+        primitive.vertexOffset += static_cast<int32_t>(to) - static_cast<int32_t>(from);
+      } else if (primitive.indexArena == ranges) {
+        primitive.firstIndex = primitive.firstIndex - from + to;
+        for (uint32_t lod = 0; lod < primitive.lodCount; lod++) {
+          primitive.lods[lod].firstIndex = primitive.lods[lod].firstIndex - from + to;
         }
-        numberOfMeshes++;
+      } else {
+        continue;
       }
+      m_movedPrimitives.push_back(index);
     }
-    // std::cout << "firstMesh: " << firstMesh << std::endl;
+  }
 
-    if (numberOfMeshes == 0) {
-      std::cout << "MeshLoader::loadFromglTF(): ERROR: tried to load a gltf that doesn't contain any meshes"
-                << std::endl;
-      throw std::runtime_error("No meshes");
-    }
-    if (numberOfMeshes > 1) {
-      std::cout << "MeshLoader::loadFromglTF(): WARNING: Trying to load glTF file with multiple meshes. Only the first "
-                   "mesh will be "
-                   "accessible, but all geometry in the file will be loaded into memory. One mesh per glTF file please."
-                << std::endl;
+  for (const auto &move : moved) {
+    meshes.erase(move.first);
+  }
+  for (const auto &move : moved) {
+    meshes[move.second->offsets[ranges]] = move.second;
+  }
+
+  if (!copies.empty()) {
+    VkBuffer buffer = m_pages[page].buffers[ranges]->buffer;
+    m_uploadContext.copyBuffer(buffer, buffer, copies);
+  }
+}
+
+MeshLoader::GeometryStats MeshLoader::geometryStats() const {
+  GeometryStats stats{};
+  stats.pages = static_cast<uint32_t>(m_pages.size());
+  for (const GeometryPage &page : m_pages) {
+    for (uint32_t ranges = 0; ranges < RANGE_COUNT; ranges++) {
+      RangeAllocator::Stats pageStats = page.allocators[ranges].stats();
+      RangeAllocator::Stats &total = ranges == VERTEX_RANGES ? stats.vertices : stats.indices[ranges];
+      total.capacity += pageStats.capacity;
+      total.used += pageStats.used;
+      total.allocations += pageStats.allocations;
+      total.freeRanges += pageStats.freeRanges;
+      total.largestFreeRange = std::max(total.largestFreeRange, pageStats.largestFreeRange);
+      total.holes += pageStats.holes;
     }
+  }
+  return stats;
+}
 
-    // upload geometry data to GPU
-    VkDeviceSize vertexBufferSize = model.vertexBuffer.size() * sizeof(Mesh::Vertex);
-    VkDeviceSize indexBufferSize = model.indexBuffer.size() * sizeof(Mesh::IndexType);
+void MeshLoader::bindBuffers(VkCommandBuffer cmd, uint32_t indexBuffer) {
+  const GeometryPage &page = m_pages[indexBuffer / Mesh::INDEX_ARENA_COUNT];
+  uint32_t arena = indexBuffer % Mesh::INDEX_ARENA_COUNT;
+
+  VkBuffer buffers[] = {page.buffers[VERTEX_RANGES]->buffer};
+  VkDeviceSize offsets[] = {0};
+  vkCmdBindVertexBuffers(cmd, 0, 1, buffers, offsets);
+  vkCmdBindIndexBuffer(cmd, page.buffers[arena]->buffer, 0, Mesh::indexType(arena));
 
-    Buffer stagingVertexBuffer{m_device.getAllocator()};
-    stagingVertexBuffer.create(vertexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 0, VMA_MEMORY_USAGE_CPU_ONLY);
-    stagingVertexBuffer.write((void *)model.vertexBuffer.data(), vertexBufferSize);
+  m_invalidBuffers = false;
+}
 
-    Buffer stagingIndexBuffer{m_device.getAllocator()};
-    stagingIndexBuffer.create(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 0, VMA_MEMORY_USAGE_CPU_ONLY);
-    stagingIndexBuffer.write((void *)model.indexBuffer.data(), indexBufferSize);
+bool MeshLoader::hasIndices(uint32_t indexBuffer) {
+  uint32_t page = indexBuffer / Mesh::INDEX_ARENA_COUNT;
+  return page < pageCount() && m_pages[page].allocators[indexBuffer % Mesh::INDEX_ARENA_COUNT].used() > 0;
+}
 
-    while (m_currentVertexBufferSize - m_currentVertexOffset < vertexBufferSize) {
-      growVertexBuffer();
+std::shared_future<Mesh> MeshLoader::requestglTF(const std::string &filepath) {
+  return request(filepath, [this, filepath]() { return readglTF(filepath); });
+}
+
+std::shared_future<Mesh> MeshLoader::requestVemesh(const std::string &filepath) {
+  return request(filepath, [this, filepath]() { return readVemesh(filepath); });
+}
+
+std::vector<std::shared_future<Mesh>> MeshLoader::requestglTFs(const std::vector<std::string> &filepaths) {
+  uint64_t group = m_nextGroup++;
+  std::vector<std::shared_future<Mesh>> meshes;
+  meshes.reserve(filepaths.size());
+  for (const std::string &filepath : filepaths) {
+    meshes.push_back(request(filepath, [this, filepath]() { return readglTF(filepath); }, group));
+  }
+  return meshes;
+}
+
+Mesh MeshLoader::loadFromglTF(const std::string &filepath) { return finish(filepath, requestglTF(filepath)); }
+
+Mesh MeshLoader::loadVemesh(const std::string &filepath) { return finish(filepath, requestVemesh(filepath)); }
+
+std::shared_future<Mesh> MeshLoader::request(
+    const std::string &filepath,
+    std::function<CookedMesh()> read,
+    uint64_t group) {
+  auto found = m_loadedMeshes.find(filepath);
+  if (found != m_loadedMeshes.end()) {
+    std::cout << "MeshLoader: " << filepath << " is already loaded." << std::endl;
+    std::promise<Mesh> loaded;
+    loaded.set_value(found->second.mesh);
+    return loaded.get_future().share();
+  }
+  for (const std::unique_ptr<StreamingMesh> &streaming : m_streamingMeshes) {
+    if (streaming->filepath == filepath) {
+      return streaming->mesh;
     }
+  }
 
-    m_device.copyBuffer(
-        stagingVertexBuffer.buffer,
-        m_bigVertexBuffer->buffer,
-        vertexBufferSize,
-        0,
-        m_currentVertexOffset * sizeof(Mesh::Vertex));
+  auto streaming = std::make_unique<StreamingMesh>();
+  streaming->filepath = filepath;
+  streaming->group = group;
+  streaming->mesh = streaming->promise.get_future().share();
+  streaming->reading = m_threadPool.submit(std::move(read));
+  m_streamingMeshes.push_back(std::move(streaming));
+  return m_streamingMeshes.back()->mesh;
+}
 
-    while (m_currentIndexBufferSize - m_currentIndexOffset < indexBufferSize) {
-      growIndexBuffer();
+Mesh MeshLoader::finish(const std::string &filepath, const std::shared_future<Mesh> &mesh) {
+  while (mesh.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    updateStreaming();
+    auto streaming = std::find_if(
+        m_streamingMeshes.begin(),
+        m_streamingMeshes.end(),
+        [&filepath](const std::unique_ptr<StreamingMesh> &streaming) { return streaming->filepath == filepath; });
+    if (streaming == m_streamingMeshes.end()) {
+      break;
     }
 
-    m_device.copyBuffer(
-        stagingIndexBuffer.buffer,
-        m_bigIndexBuffer->buffer,
-        indexBufferSize,
-        0,
-        m_currentIndexOffset * sizeof(Mesh::IndexType));
+    // nothing to do but wait for the workers or the gpu
+    StreamingMesh *unread = (*streaming)->read ? unreadInGroup((*streaming)->group) : streaming->get();
+    if (unread != nullptr) {
+      unread->reading.wait();
+    } else if ((*streaming)->batch != 0) {
+      m_uploadContext.wait((*streaming)->batch);
+    } else {
+      // the ring is full, of batches that were all submitted, or the geometry
+      // buffers are, of ranges frames in flight may still read. this stalls
+      // anyway, so it might as well wait for the gpu to be done with them
+      m_uploadContext.wait(m_uploadContext.currentBatch() - 1);
+      releaseRetiredRanges();
+    }
+  }
+  return mesh.get();
+}
+
+MeshLoader::CookedMesh MeshLoader::readglTF(const std::string &filepath) {
+  // the cooked file next to the source is used as long as it was cooked
+  // from the source as it is now, otherwise the source is cooked again and
+  // the result saved for the next time
+  std::string sourcePath = MODEL_PATH + filepath;
+  std::string cookedPath = sourcePath + COOKED_EXTENSION;
+  int64_t sourceTime = MeshCooker::sourceTime(sourcePath);
+  CookedMesh cooked;
+  if (m_fileSystem.exists(cookedPath)) {
+    cooked.file = m_fileSystem.open(cookedPath);
+    const vemesh::Header *header = vemesh::parse(cooked.file.data(), cooked.file.size());
+    if (header && (header->sourceTime == sourceTime || !std::filesystem::exists(sourcePath))) {
+      std::cout << "MeshLoader: loading " << filepath << " from " << cookedPath << std::endl;
+      readTextures(cooked);
+      return cooked;
+    }
+  }
 
-    // load textures
+  cooked.file = {};
+  cooked.cooked = m_cooker.cookglTF(sourcePath, sourceTime);
+  if (!saveFile(cookedPath, cooked.cooked)) {
+    std::cout << "MeshLoader: WARNING: couldn't save " << cookedPath << ", " << filepath
+              << " will be cooked again next time" << std::endl;
+  }
+  readTextures(cooked);
+  return cooked;
+}
 
-    // std::cout << "MeshLoader::loadFromglTF(): loading textures" << std::endl;
+MeshLoader::CookedMesh MeshLoader::readVemesh(const std::string &filepath) {
+  CookedMesh cooked;
+  cooked.file = m_fileSystem.open(MODEL_PATH + filepath);
+  readTextures(cooked);
+  return cooked;
+}
 
-    std::vector<Texture> textures;
-    for (auto texture : model.textures) {
-      Texture newTexture;
-      if (texture.isExternalTexture) {
-        newTexture = m_textureLoader.loadFromFile(texture.texturePath);
-      } else {
-        newTexture = m_textureLoader.loadFromData(texture.rawData.data(), texture.width, texture.height);
+void MeshLoader::readTextures(CookedMesh &cooked) {
+  // a broken file is reported once it's uploaded
+  const vemesh::Header *header = vemesh::parse(cooked.data(), cooked.size());
+  if (header == nullptr) {
+    return;
+  }
+  const vemesh::Texture *textures = vemesh::table<vemesh::Texture>(cooked.data(), header->textures);
+  for (uint32_t i = 0; i < header->textureCount; i++) {
+    if (textures[i].path.size == 0) {
+      continue;
+    }
+    std::string path(reinterpret_cast<const char *>(cooked.data() + textures[i].path.offset), textures[i].path.size);
+    if (cooked.textures.find(path) == cooked.textures.end()) {
+      cooked.textures.emplace(path, m_textureLoader.readTexture(path));
+    }
+  }
+}
+
+MeshLoader::StreamingMesh *MeshLoader::unreadInGroup(uint64_t group) {
+  if (group == 0) {
+    return nullptr;
+  }
+  for (const std::unique_ptr<StreamingMesh> &streaming : m_streamingMeshes) {
+    if (streaming->group == group && !streaming->read && !streaming->done) {
+      return streaming.get();
+    }
+  }
+  return nullptr;
+}
+
+void MeshLoader::updateStreaming() {
+  for (std::unique_ptr<StreamingMesh> &streaming : m_streamingMeshes) {
+    if (streaming->read || streaming->reading.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      continue;
+    }
+    streaming->read = true;
+    try {
+      streaming->cooked = streaming->reading.get();
+    } catch (...) {
+      streaming->promise.set_exception(std::current_exception());
+      streaming->done = true;
+    }
+  }
+
+  for (std::unique_ptr<StreamingMesh> &streaming : m_streamingMeshes) {
+    // a group waits until all of it is read, then goes all at once
+    if (streaming->batch != 0 || streaming->done || !streaming->read ||
+        unreadInGroup(streaming->group) != nullptr) {
+      continue;
+    }
+    try {
+      // meshes go to the gpu in the order they were asked for
+      if (!beginUpload(*streaming, streaming->group != 0)) {
+        break;
       }
-      textures.push_back(newTexture);
+    } catch (...) {
+      streaming->promise.set_exception(std::current_exception());
+      streaming->done = true;
+    }
+  }
+  m_uploadContext.submit();
+
+  for (std::unique_ptr<StreamingMesh> &streaming : m_streamingMeshes) {
+    if (streaming->batch != 0 && !streaming->done && m_uploadContext.finished(streaming->batch)) {
+      LoadedMesh &loaded = m_loadedMeshes[streaming->filepath];
+      loaded = streaming->loaded;
+      trackMesh(loaded);
+      streaming->promise.set_value(streaming->loaded.mesh);
+      streaming->done = true;
     }
+  }
+  m_streamingMeshes.erase(
+      std::remove_if(
+          m_streamingMeshes.begin(),
+          m_streamingMeshes.end(),
+          [](const std::unique_ptr<StreamingMesh> &streaming) { return streaming->done; }),
+      m_streamingMeshes.end());
+}
 
-    // load materials
+bool MeshLoader::beginUpload(StreamingMesh &streaming, bool waitForRoom) {
+  const uint8_t *data = streaming.cooked.data();
+  const vemesh::Header *header = vemesh::parse(data, streaming.cooked.size());
+  if (header == nullptr) {
+    throw std::runtime_error("Failed to load cooked mesh " + streaming.filepath);
+  }
 
-    // std::cout << "MeshLoader::loadFromglTF(): loading materials" << std::endl;
+  // the vertices and indices of every arena go into the staging ring as one
+  // piece, each section aligned
+  LoadedMesh &loaded = streaming.loaded;
+  std::array<vemesh::Section, RANGE_COUNT> sections;
+  std::array<VkDeviceSize, RANGE_COUNT> stagedOffsets{};
+  VkDeviceSize stagedSize = 0;
+  for (uint32_t ranges = 0; ranges < RANGE_COUNT; ranges++) {
+    sections[ranges] = ranges == VERTEX_RANGES ? header->vertices : header->indices[ranges];
+    loaded.counts[ranges] = ranges == VERTEX_RANGES ? header->vertexCount : header->indexCounts[ranges];
+    stagedOffsets[ranges] = stagedSize;
+    if (loaded.counts[ranges] > 0) {
+      stagedSize += (sections[ranges].size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    }
+  }
 
-    std::vector<size_t> currentMeshMaterials{};
+  if (!allocateMesh(loaded)) {
+    return false;
+  }
 
-    size_t materialOffset = materials.size();
-    for (auto material : model.materials) {
-      Material newMaterial;
-      newMaterial.baseColorFactor = material.baseColorFactor;
-      newMaterial.emissiveFactor = material.emissiveFactor;
-      newMaterial.metallicRoughnessFactor = glm::vec4(1.0f, material.roughnessFactor, material.metallicFactor, 1.0f);
+  void *staged = nullptr;
+  VkDeviceSize stagedStart = 0;
+  bool onePiece = stagedSize <= m_uploadContext.size();
+  if (onePiece && !m_uploadContext.allocate(stagedSize, STAGING_ALIGNMENT, staged, stagedStart)) {
+    if (!waitForRoom) {
+      // nothing was copied into the ranges yet, they can go right back
+      freeMesh(loaded);
+      return false;
+    }
+    onePiece = false;
+  }
 
-      if (textures.size() == 0) {
-        continue;
-      }
+  GeometryPage &page = m_pages[loaded.page];
+  for (uint32_t ranges = 0; ranges < RANGE_COUNT; ranges++) {
+    if (loaded.counts[ranges] == 0) {
+      continue;
+    }
+    const uint8_t *source = data + sections[ranges].offset;
+    VkDeviceSize size = sections[ranges].size;
+    VkDeviceSize dstOffset = loaded.offsets[ranges] * elementSize(ranges);
+    if (onePiece) {
+      std::memcpy(static_cast<uint8_t *>(staged) + stagedOffsets[ranges], source, static_cast<size_t>(size));
+      VkBufferCopy region{stagedStart + stagedOffsets[ranges], dstOffset, size};
+      VkBuffer dstBuffer = page.buffers[ranges]->buffer;
+      vkCmdCopyBuffer(m_uploadContext.commandBuffer(), m_uploadContext.buffer(), dstBuffer, 1, &region);
+    } else {
+      // too big for the ring, or it's full and this can't wait. staged range by
+      // range, waiting for room as it goes or with staging memory of its own
+      m_uploadContext.uploadBuffer(source, size, page.buffers[ranges]->buffer, dstOffset);
+    }
+  }
 
-      // std::cout << "MeshLoader::loadFromglTF(): no. of textures: " << textures.size() << std::endl;
-
-      // std::cout << "MeshLoader::loadFromglTF(): base color index: " << material.baseColorTexture << std::endl;
-      newMaterial.baseColorTexture = textures[material.baseColorTexture];
-      // std::cout << "MeshLoader::loadFromglTF(): MR index: " << material.metallicRoughnessTexture << std::endl;
-      newMaterial.metallicRoughnessTexture = textures[material.metallicRoughnessTexture];
-      // std::cout << "MeshLoader::loadFromglTF(): emissive index: " << material.emissiveTexture << std::endl;
-      newMaterial.emissiveTexture = textures[material.emissiveTexture];
-      // std::cout << "MeshLoader::loadFromglTF(): normals index: " << material.normalTexture << std::endl;
-      newMaterial.normalTexture = textures[material.normalTexture];
-      // std::cout << "MeshLoader::loadFromglTF(): occlusion index: " << material.occlusionTexture << std::endl;
-      newMaterial.occlusionTexture = textures[material.occlusionTexture];
-
-      size_t matID = addMaterial(newMaterial);
-      currentMeshMaterials.push_back(matID);
-    }
-
-    // Load primitives
-
-    // std::cout << "MeshLoader::loadFromglTF(): loading primitives" << std::endl;
-
-    std::cout << "MeshLoader::loadFromglTF(): # of materials in current mesh: " << currentMeshMaterials.size()
-              << std::endl;
-
-    Mesh newMesh;
-    newMesh.primitiveCount = 0;
-    newMesh.firstPrimitive = static_cast<uint32_t>(primitives.size());
-    for (auto primitive : firstMesh->primitives) {
-      Mesh::Primitive newPrimitive{};
-      newPrimitive.firstIndex = static_cast<Mesh::IndexType>(primitive->firstIndex + m_currentIndexOffset);
-      newPrimitive.indexCount = primitive->indexCount;
-      newPrimitive.vertexCount = primitive->vertexCount;
-      newPrimitive.vertexOffset = m_currentVertexOffset;
-      if (primitive->material == -1) {
-        std::cout << "MeshLoader::loadFromglTF(): primitive doesn't have a material, using the default" << std::endl;
-        newPrimitive.material = 0;
-      } else {
-        std::cout << "MeshLoader::loadFromglTF(): adding primitive using material: " << primitive->material
-                  << " (offset " << currentMeshMaterials[primitive->material] << ")" << std::endl;
-        newPrimitive.material = currentMeshMaterials[primitive->material];
-      }
+  // textures may not fit in the batch the vertices went into, the mesh is
+  // done once the last one they went into is
+  addPrimitives(streaming.cooked, *header, loaded);
+  streaming.batch = m_uploadContext.currentBatch();
+  return true;
+}
 
-      m_currentIndexOffset += newPrimitive.indexCount;
-      m_currentVertexOffset += newPrimitive.vertexCount;
-      primitives.push_back(newPrimitive);
-      newMesh.primitiveCount++;
+void MeshLoader::addPrimitives(const CookedMesh &cooked, const vemesh::Header &header, LoadedMesh &loaded) {
+  const uint8_t *data = cooked.data();
+
+  // load textures, the worker already read their files
+
+  const vemesh::Texture *cookedTextures = vemesh::table<vemesh::Texture>(data, header.textures);
+  std::vector<Texture> textures;
+  for (uint32_t i = 0; i < header.textureCount; i++) {
+    const vemesh::Texture &texture = cookedTextures[i];
+    Texture newTexture;
+    if (texture.path.size > 0) {
+      std::string path(reinterpret_cast<const char *>(data + texture.path.offset), texture.path.size);
+      auto read = cooked.textures.find(path);
+      newTexture = read != cooked.textures.end() ? m_textureLoader.loadFromCooked(path, read->second)
+                                                 : m_textureLoader.loadFromFile(path);
+    } else {
+      newTexture = m_textureLoader.loadFromData((void *)(data + texture.pixels.offset), texture.width, texture.height);
     }
+    textures.push_back(newTexture);
+  }
 
-    m_loadedMeshes[filepath] = newMesh;
-    // std::cout << "MeshLoader::loadFromglTF(): finished loading " << filepath << std::endl;
-    return newMesh;
+  // load materials
+
+  auto texture = [&](uint32_t index) { return index < textures.size() ? textures[index] : Texture{}; };
+
+  const vemesh::Material *cookedMaterials = vemesh::table<vemesh::Material>(data, header.materials);
+  std::vector<size_t> currentMeshMaterials{};
+  for (uint32_t i = 0; i < header.materialCount; i++) {
+    const vemesh::Material &material = cookedMaterials[i];
+    Material newMaterial;
+    newMaterial.baseColorFactor = material.baseColorFactor;
+    newMaterial.emissiveFactor = material.emissiveFactor;
+    newMaterial.metallicRoughnessFactor = material.metallicRoughnessFactor;
+    newMaterial.baseColorTexture = texture(material.baseColorTexture);
+    newMaterial.metallicRoughnessTexture = texture(material.metallicRoughnessTexture);
+    newMaterial.emissiveTexture = texture(material.emissiveTexture);
+    newMaterial.normalTexture = texture(material.normalTexture);
+    newMaterial.occlusionTexture = texture(material.occlusionTexture);
+
+    currentMeshMaterials.push_back(addMaterial(newMaterial));
   }
+
+  // load primitives, moving their offsets to where the file's data ended up
+
+  std::cout << "MeshLoader::addPrimitives(): # of materials in current mesh: " << currentMeshMaterials.size()
+            << std::endl;
+
+  Mesh newMesh;
+  newMesh.primitiveCount = 0;
+  newMesh.firstPrimitive = static_cast<uint32_t>(primitives.size());
+  const uint8_t *cookedPrimitives = data + header.primitives.offset;
+  for (uint32_t i = 0; i < header.primitiveCount; i++) {
+    Mesh::Primitive newPrimitive;
+    std::memcpy(&newPrimitive, cookedPrimitives + i * sizeof(Mesh::Primitive), sizeof(Mesh::Primitive));
+    newPrimitive.page = loaded.page;
+    newPrimitive.vertexOffset += static_cast<int32_t>(loaded.offsets[VERTEX_RANGES]);
+    newPrimitive.firstIndex += loaded.offsets[newPrimitive.indexArena];
+    for (uint32_t lod = 0; lod < newPrimitive.lodCount; lod++) {
+      newPrimitive.lods[lod].firstIndex += loaded.offsets[newPrimitive.indexArena];
+    }
+    if (newPrimitive.material < 0 || static_cast<size_t>(newPrimitive.material) >= currentMeshMaterials.size()) {
+      std::cout << "MeshLoader::addPrimitives(): primitive doesn't have a material, using the default" << std::endl;
+      newPrimitive.material = 0;
+    } else {
+      newPrimitive.material = static_cast<int32_t>(currentMeshMaterials[newPrimitive.material]);
+    }
+
+    primitives.push_back(newPrimitive);
+    if (newMesh.primitiveCount == 0) {
+      newMesh.boundsMin = newPrimitive.boundsMin;
+      newMesh.boundsMax = newPrimitive.boundsMax;
+    } else {
+      newMesh.boundsMin = glm::min(newMesh.boundsMin, newPrimitive.boundsMin);
+      newMesh.boundsMax = glm::max(newMesh.boundsMax, newPrimitive.boundsMax);
+    }
+    newMesh.primitiveCount++;
+  }
+
+  loaded.mesh = newMesh;
 }
 
-} // namespace ve
\ No newline at end of file
+} // namespace ve
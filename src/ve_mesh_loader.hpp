@@ -2,28 +2,59 @@
 
 #include "ve_buffer.hpp"
 #include "ve_device.hpp"
+#include "ve_file_system.hpp"
 #include "ve_material.hpp"
 #include "ve_mesh.hpp"
+#include "ve_mesh_cooker.hpp"
+#include "ve_range_allocator.hpp"
 #include "ve_texture_loader.hpp"
+#include "ve_thread_pool.hpp"
+#include "ve_upload_context.hpp"
 
+#include <array>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace ve {
 
+namespace vemesh {
+struct Header;
+} // namespace vemesh
+
+// loads meshes into the shared vertex and index buffers. meshes are read, and
+// cooked if they have to be, on worker threads. everything else, from
+// uploading to adding their materials and primitives, happens on the thread
+// using the loader, so `primitives`, `materials` and the loaded meshes are
+// only ever touched by that one
 class MeshLoader {
 public:
-  MeshLoader(Device &device);
+  MeshLoader(Device &device, ThreadPool &threadPool, FileSystem &fileSystem, UploadContext &uploadContext);
   ~MeshLoader();
 
-  void bindBuffers(VkCommandBuffer cmd);
+  // binds the vertex buffer of the page of `indexBuffer`, and the index buffer
+  // itself. see Mesh::INDEX_BUFFER_COUNT
+  void bindBuffers(VkCommandBuffer cmd, uint32_t indexBuffer);
+  // whether any primitive is loaded into `indexBuffer`
+  bool hasIndices(uint32_t indexBuffer);
+  uint32_t pageCount() { return static_cast<uint32_t>(m_pages.size()); }
+  // index buffers past this one are never used
+  uint32_t indexBufferCount() { return pageCount() * Mesh::INDEX_ARENA_COUNT; }
 
   bool invalidBuffers() { return m_invalidBuffers; }
 
   TextureLoader &textureLoader() { return m_textureLoader; }
 
+  // how close vertices have to be to get welded while importing, only
+  // affects files cooked afterwards. workers read it, so it can only change
+  // while nothing is being loaded
+  void setWeldTolerance(const WeldTolerance &tolerance) { m_cooker.setWeldTolerance(tolerance); }
+
   Mesh::Primitive &getPrimitive(size_t i) { return primitives[i]; }
   Material &getMaterial(size_t i) { return materials[i]; }
 
@@ -35,32 +66,184 @@ public:
   };
 
   static const std::string MODEL_PATH;
+  // appended to a source model's path to get the path of its cooked version
+  static constexpr const char *COOKED_EXTENSION = ".vemesh";
   // Mesh loadPrimitive(const Mesh::Data &data);
+  // starts loading the cooked version of the glTF file in the background,
+  // cooking it first if it's missing or was cooked from an older version of
+  // the file. the mesh is ready once its vertices and indices are on the gpu,
+  // which `advanceFrame()` checks for, or holds what loading it threw
+  std::shared_future<Mesh> requestglTF(const std::string &filepath);
+  // the same for a .vemesh file, without looking for its source
+  std::shared_future<Mesh> requestVemesh(const std::string &filepath);
+  // requests all of them together. they're read and cooked in parallel, and
+  // once every one of them has been read they go to the gpu at once in the
+  // order given, so where their geometry, materials and primitives end up
+  // doesn't depend on which worker was done first. one future per path
+  std::vector<std::shared_future<Mesh>> requestglTFs(const std::vector<std::string> &filepaths);
+  // request and wait for it
   Mesh loadFromglTF(const std::string &filepath);
+  Mesh loadVemesh(const std::string &filepath);
+  // gives the vertices and indices of the mesh loaded from `filepath` back.
+  // nothing may draw it anymore, but frames already in flight can still
+  // read it, so its ranges only get reused MAX_FRAMES_IN_FLIGHT frames later.
+  // its primitives stay behind empty, their indices aren't reused
+  void unloadMesh(const std::string &filepath);
+
+  // has to be called once per frame, before anything reads the primitives.
+  // releases the ranges unloaded far enough back and moves up to
+  // COMPACTION_BYTES_PER_FRAME of live geometry down into holes, so the
+  // buffers don't need to grow while content is streamed in and out. then
+  // uploads the requested meshes that have been read, and hands out those
+  // whose uploads are done
+  void advanceFrame();
+  // primitives whose vertex offset or first indices changed since the last
+  // call to `clearMovedPrimitives()`, draw calls made from them are out of date
+  const std::vector<uint32_t> &movedPrimitives() { return m_movedPrimitives; }
+  void clearMovedPrimitives() { m_movedPrimitives.clear(); }
+
+  // the most bytes the vertex buffers, and the index buffers of each arena,
+  // of all pages together may take up. loading more than fits throws
+  void setBufferBudget(VkDeviceSize bytes) { m_bufferBudget = bytes; }
+
+  // summed over all pages, the largest free range is that of the emptiest one
+  struct GeometryStats {
+    uint32_t pages;
+    RangeAllocator::Stats vertices;
+    std::array<RangeAllocator::Stats, Mesh::INDEX_ARENA_COUNT> indices;
+  };
+  GeometryStats geometryStats() const;
 
   std::vector<Material> materials;
   std::vector<Mesh::Primitive> primitives;
 
 private:
-  void growVertexBuffer();
-  void growIndexBuffer();
+  // the vertex buffer and the index buffers of a page all hand out ranges the
+  // same way, ranges 0 to INDEX_ARENA_COUNT - 1 are the arenas' indices
+  static constexpr uint32_t VERTEX_RANGES = Mesh::INDEX_ARENA_COUNT;
+  static constexpr uint32_t RANGE_COUNT = Mesh::INDEX_ARENA_COUNT + 1;
+
+  // a loaded mesh, the page all of it is in and its ranges in that page's buffers
+  struct LoadedMesh {
+    Mesh mesh;
+    uint32_t page;
+    std::array<uint32_t, RANGE_COUNT> offsets{};
+    std::array<uint32_t, RANGE_COUNT> counts{};
+  };
+
+  // buffers are created when a page first needs them and never grow, a page
+  // only gets a bigger one if a single mesh doesn't fit otherwise
+  struct GeometryPage {
+    std::array<std::unique_ptr<Buffer>, RANGE_COUNT> buffers;
+    // in elements
+    std::array<RangeAllocator, RANGE_COUNT> allocators;
+    // the loaded meshes with a range in each buffer, by the offset of that
+    // range, so compaction finds the highest ones without looking at all meshes
+    std::array<std::map<uint32_t, LoadedMesh *>, RANGE_COUNT> meshes;
+  };
+
+  // the contents of a .vemesh file, mapped or straight out of the cooker
+  struct CookedMesh {
+    FileView file;
+    std::vector<uint8_t> cooked;
+    // the image files its textures come from, read by the same worker
+    std::unordered_map<std::string, TextureLoader::CookedTexture> textures;
+
+    const uint8_t *data() const { return cooked.empty() ? file.data() : cooked.data(); }
+    size_t size() const { return cooked.empty() ? file.size() : cooked.size(); }
+  };
+
+  // a requested mesh that isn't on the gpu yet
+  struct StreamingMesh {
+    std::string filepath;
+    // requests made together share a group, 0 for one made alone
+    uint64_t group{0};
+    // ready once a worker has read the file
+    std::future<CookedMesh> reading;
+    bool read{false};
+    CookedMesh cooked;
+    // the upload context batch uploading it, 0 until it's recorded
+    uint64_t batch{0};
+    LoadedMesh loaded;
+    std::promise<Mesh> promise;
+    std::shared_future<Mesh> mesh;
+    bool done{false};
+  };
+
+  struct RetiredRange {
+    uint32_t page;
+    uint32_t ranges;
+    uint32_t offset;
+    uint64_t frame;
+  };
+
+  static VkDeviceSize elementSize(uint32_t ranges);
+  // creates the buffer for `ranges` in `page`, big enough for at least
+  // `count` elements. false if it doesn't fit in the budget
+  bool createBuffer(uint32_t page, uint32_t ranges, uint32_t count);
+  // allocates all of the mesh's ranges in `page`, or none of them
+  bool allocateInPage(uint32_t page, LoadedMesh &loaded);
+  // picks the first page the mesh fits in, adding a page if that's what it
+  // takes. false if it has to wait for retired ranges to be released in a
+  // later frame, throws if even that wouldn't make it fit in the budget
+  bool allocateMesh(LoadedMesh &loaded);
+  // gives all of the mesh's ranges back to its page's allocators right away
+  void freeMesh(const LoadedMesh &loaded);
+  // adds the mesh to, or removes it from, the meshes of its page
+  void trackMesh(LoadedMesh &loaded);
+  void untrackMesh(const LoadedMesh &loaded);
+  // frees every retired range, after waiting for the gpu to be done with
+  // them. only for loading synchronously, which stalls anyway
+  void releaseRetiredRanges();
+  // moves the highest up ranges of `ranges` in `page` down into holes, as
+  // long as `budget` lasts, and records the copies that go with it
+  void compact(uint32_t page, uint32_t ranges, VkDeviceSize &budget);
+
+  std::shared_future<Mesh> request(const std::string &filepath, std::function<CookedMesh()> read, uint64_t group = 0);
+  // keeps streaming until the mesh is ready
+  Mesh finish(const std::string &filepath, const std::shared_future<Mesh> &mesh);
+  // run on workers
+  CookedMesh readglTF(const std::string &filepath);
+  CookedMesh readVemesh(const std::string &filepath);
+  void readTextures(CookedMesh &cooked);
+  // a mesh of `group` that hasn't been read yet, if there's one left
+  StreamingMesh *unreadInGroup(uint64_t group);
+  void updateStreaming();
+  // allocates the mesh's ranges and records the copies of its vertices and
+  // indices, then adds its materials and primitives. false if the geometry
+  // buffers have no room for it until retired ranges are released, or if the
+  // staging ring has none until earlier uploads finish, unless `waitForRoom`
+  // is set, then it waits for those instead
+  bool beginUpload(StreamingMesh &streaming, bool waitForRoom);
+  void addPrimitives(const CookedMesh &cooked, const vemesh::Header &header, LoadedMesh &loaded);
 
   bool m_invalidBuffers{true};
 
   TextureLoader m_textureLoader;
+  MeshCooker m_cooker;
 
-  static constexpr VkDeviceSize INITIAL_BUFFER_SIZE = 1000;
+  static constexpr VkDeviceSize PAGE_SIZE = VkDeviceSize{32} << 20;
+  static constexpr VkDeviceSize DEFAULT_BUFFER_BUDGET = VkDeviceSize{256} << 20;
+  static constexpr VkDeviceSize COMPACTION_BYTES_PER_FRAME = VkDeviceSize{4} << 20;
+  static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
   Device &m_device;
+  ThreadPool &m_threadPool;
+  FileSystem &m_fileSystem;
+  UploadContext &m_uploadContext;
+
+  std::unordered_map<std::string, LoadedMesh> m_loadedMeshes;
 
-  std::unordered_map<std::string, Mesh> m_loadedMeshes;
+  std::vector<GeometryPage> m_pages;
+  // bytes taken up by the buffers of each kind of range, in all pages
+  std::array<VkDeviceSize, RANGE_COUNT> m_bufferBytes{};
 
-  std::unique_ptr<Buffer> m_bigVertexBuffer;
-  uint32_t m_currentVertexBufferSize{INITIAL_BUFFER_SIZE};
-  uint32_t m_currentVertexOffset{0};
+  VkDeviceSize m_bufferBudget{DEFAULT_BUFFER_BUDGET};
+  uint64_t m_frame{0};
+  std::vector<RetiredRange> m_retiredRanges;
+  std::vector<uint32_t> m_movedPrimitives;
 
-  std::unique_ptr<Buffer> m_bigIndexBuffer;
-  uint32_t m_currentIndexBufferSize{INITIAL_BUFFER_SIZE};
-  uint32_t m_currentIndexOffset{0};
+  std::vector<std::unique_ptr<StreamingMesh>> m_streamingMeshes;
+  uint64_t m_nextGroup{1};
 };
 
 } // namespace ve
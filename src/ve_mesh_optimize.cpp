@@ -0,0 +1,354 @@
+#include "ve_mesh_optimize.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+namespace ve {
+
+namespace {
+
+struct IndexRange {
+  uint32_t first{0};
+  uint32_t count{0};
+};
+
+IndexRange findRange(const uint32_t *indices, size_t indexCount) {
+  if (indexCount == 0) {
+    return {};
+  }
+  auto minmax = std::minmax_element(indices, indices + indexCount);
+  return {*minmax.first, *minmax.second - *minmax.first + 1};
+}
+
+// the triangles around every vertex of `range`, as offsets into one list
+struct Adjacency {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> triangles;
+
+  Adjacency(const uint32_t *indices, size_t indexCount, IndexRange range)
+      : offsets(range.count + 1, 0)
+      , triangles(indexCount) {
+    for (size_t i = 0; i < indexCount; i++) {
+      offsets[indices[i] - range.first + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; i++) {
+      triangles[cursor[indices[i] - range.first]++] = static_cast<uint32_t>(i / 3);
+    }
+  }
+};
+
+// a cell of the grid vertices are welded on. vertices within the position
+// tolerance of each other are at most one cell apart
+struct Cell {
+  int64_t x, y, z;
+
+  bool operator==(const Cell &other) const { return x == other.x && y == other.y && z == other.z; }
+};
+
+struct CellHash {
+  size_t operator()(const Cell &cell) const {
+    uint64_t h = static_cast<uint64_t>(cell.x) * 0x9e3779b97f4a7c15ull;
+    h ^= static_cast<uint64_t>(cell.y) * 0xc2b2ae3d27d4eb4full + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t>(cell.z) * 0x165667b19e3779f9ull + (h << 6) + (h >> 2);
+    return static_cast<size_t>(h);
+  }
+};
+
+// without a tolerance the cell is the position's exact bits, and only
+// vertices in the same one get compared
+Cell cellOf(glm::vec3 position, float cellSize) {
+  if (cellSize <= 0.0f) {
+    int32_t bits[3];
+    std::memcpy(bits, &position, sizeof(bits));
+    return {bits[0], bits[1], bits[2]};
+  }
+  return {
+      static_cast<int64_t>(std::floor(position.x / cellSize)),
+      static_cast<int64_t>(std::floor(position.y / cellSize)),
+      static_cast<int64_t>(std::floor(position.z / cellSize))};
+}
+
+bool canWeld(const Mesh::Vertex &a, const Mesh::Vertex &b, const WeldTolerance &tolerance) {
+  return glm::length(a.position - b.position) <= tolerance.position &&
+         glm::length(a.normal - b.normal) <= tolerance.normal && glm::length(a.uv0 - b.uv0) <= tolerance.uv &&
+         glm::length(a.uv1 - b.uv1) <= tolerance.uv;
+}
+
+} // namespace
+
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, uint32_t cacheSize) {
+  IndexRange range = findRange(indices, indexCount);
+  if (indexCount < 3) {
+    return {0.0f, 0.0f};
+  }
+
+  // a fifo only changes on misses, so a vertex is cached as long as fewer
+  // than `cacheSize` misses happened since it was last loaded
+  std::vector<uint32_t> loadedAt(range.count, 0);
+  std::vector<uint8_t> used(range.count, 0);
+  uint32_t misses = 0;
+  uint32_t usedCount = 0;
+  for (size_t i = 0; i < indexCount; i++) {
+    uint32_t v = indices[i] - range.first;
+    if (!used[v]) {
+      used[v] = 1;
+      usedCount++;
+    }
+    if (loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize) {
+      misses++;
+      loadedAt[v] = misses;
+    }
+  }
+
+  return {static_cast<float>(misses) / (indexCount / 3), static_cast<float>(misses) / usedCount};
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, uint32_t cacheSize, std::vector<uint32_t> *clusters) {
+  if (clusters) {
+    clusters->clear();
+  }
+  if (indexCount < 3) {
+    return;
+  }
+
+  IndexRange range = findRange(indices, indexCount);
+  Adjacency adjacency(indices, indexCount, range);
+  size_t triangleCount = indexCount / 3;
+
+  std::vector<uint32_t> liveTriangles(range.count);
+  for (uint32_t v = 0; v < range.count; v++) {
+    liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+  }
+  // when every vertex went into the cache, it's in there as long as fewer
+  // than `cacheSize` others were put in after it
+  std::vector<uint32_t> cacheTime(range.count, 0);
+  std::vector<uint8_t> emitted(triangleCount, 0);
+  std::vector<uint32_t> deadEnd;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> result;
+  result.reserve(indexCount);
+
+  uint32_t time = cacheSize + 1;
+  uint32_t cursor = 0;
+  int64_t fanning = 0;
+  bool clusterStart = true;
+
+  while (fanning >= 0) {
+    uint32_t f = static_cast<uint32_t>(fanning);
+    if (clusterStart && clusters) {
+      clusters->push_back(static_cast<uint32_t>(result.size()));
+    }
+
+    // emit every triangle left around the fanning vertex
+    candidates.clear();
+    for (uint32_t t = adjacency.offsets[f]; t < adjacency.offsets[f + 1]; t++) {
+      uint32_t triangle = adjacency.triangles[t];
+      if (emitted[triangle]) {
+        continue;
+      }
+      emitted[triangle] = 1;
+      for (int c = 0; c < 3; c++) {
+        uint32_t v = indices[triangle * 3 + c] - range.first;
+        result.push_back(indices[triangle * 3 + c]);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        liveTriangles[v]--;
+        if (time - cacheTime[v] > cacheSize) {
+          cacheTime[v] = time++;
+        }
+      }
+    }
+
+    // continue with the candidate that's still going to be in the cache
+    // after its remaining triangles were emitted, and has been there longest
+    fanning = -1;
+    int64_t bestPriority = -1;
+    for (uint32_t v : candidates) {
+      if (liveTriangles[v] == 0) {
+        continue;
+      }
+      int64_t priority = 0;
+      if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+        priority = time - cacheTime[v];
+      }
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        fanning = v;
+      }
+    }
+    clusterStart = fanning < 0;
+
+    if (fanning < 0) {
+      // nothing in the cache has triangles left, go back to the most recent
+      // vertex that does, or failing that the next one in order. either way
+      // the cache is mostly cold again
+      while (!deadEnd.empty() && fanning < 0) {
+        uint32_t v = deadEnd.back();
+        deadEnd.pop_back();
+        if (liveTriangles[v] > 0) {
+          fanning = v;
+        }
+      }
+      while (cursor < range.count && fanning < 0) {
+        if (liveTriangles[cursor] > 0) {
+          fanning = cursor;
+        }
+        cursor++;
+      }
+    }
+  }
+
+  std::copy(result.begin(), result.end(), indices);
+}
+
+void optimizeOverdraw(
+    uint32_t *indices,
+    size_t indexCount,
+    const std::vector<Mesh::Vertex> &vertices,
+    const std::vector<uint32_t> &clusters) {
+  if (clusters.size() < 2) {
+    return;
+  }
+
+  struct Cluster {
+    uint32_t begin;
+    uint32_t end;
+    glm::vec3 centroid{0.0f};
+    glm::vec3 normal{0.0f};
+    float area{0.0f};
+    float sortKey{0.0f};
+  };
+
+  std::vector<Cluster> sorted(clusters.size());
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  for (size_t c = 0; c < clusters.size(); c++) {
+    Cluster &cluster = sorted[c];
+    cluster.begin = clusters[c];
+    cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<uint32_t>(indexCount);
+
+    // area weighted, so a few slivers don't decide which way the cluster faces
+    for (uint32_t i = cluster.begin; i < cluster.end; i += 3) {
+      glm::vec3 p0 = vertices[indices[i]].position;
+      glm::vec3 p1 = vertices[indices[i + 1]].position;
+      glm::vec3 p2 = vertices[indices[i + 2]].position;
+      glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+      float area = glm::length(normal);
+      cluster.centroid += (p0 + p1 + p2) * (area / 3.0f);
+      cluster.normal += normal;
+      cluster.area += area;
+    }
+    meshCentroid += cluster.centroid;
+    meshArea += cluster.area;
+    if (cluster.area > 0.0f) {
+      cluster.centroid = cluster.centroid / cluster.area;
+    }
+  }
+  if (meshArea > 0.0f) {
+    meshCentroid = meshCentroid / meshArea;
+  }
+
+  for (Cluster &cluster : sorted) {
+    float length = glm::length(cluster.normal);
+    cluster.sortKey = length > 0.0f ? glm::dot(cluster.centroid - meshCentroid, cluster.normal / length) : 0.0f;
+  }
+  std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster &a, const Cluster &b) {
+    return a.sortKey > b.sortKey;
+  });
+
+  std::vector<uint32_t> result;
+  result.reserve(indexCount);
+  for (const Cluster &cluster : sorted) {
+    result.insert(result.end(), indices + cluster.begin, indices + cluster.end);
+  }
+  std::copy(result.begin(), result.end(), indices);
+}
+
+uint32_t weldVertices(
+    const std::vector<Mesh::Vertex> &vertices,
+    uint32_t *indices,
+    size_t indexCount,
+    const WeldTolerance &tolerance) {
+  constexpr uint32_t NONE = ~0u;
+  if (indexCount == 0) {
+    return 0;
+  }
+
+  IndexRange range = findRange(indices, indexCount);
+  std::vector<uint8_t> used(range.count, 0);
+  for (size_t i = 0; i < indexCount; i++) {
+    used[indices[i] - range.first] = 1;
+  }
+
+  // every cell holds a list of the vertices that were kept in it, linked through `next`
+  float cellSize = tolerance.position;
+  int64_t reach = cellSize > 0.0f ? 1 : 0;
+  std::unordered_map<Cell, uint32_t, CellHash> cells;
+  cells.reserve(range.count);
+  std::vector<uint32_t> next(range.count, NONE);
+  std::vector<uint32_t> remap(range.count, NONE);
+  uint32_t kept = 0;
+
+  for (uint32_t v = 0; v < range.count; v++) {
+    if (!used[v]) {
+      continue;
+    }
+
+    const Mesh::Vertex &vertex = vertices[range.first + v];
+    Cell cell = cellOf(vertex.position, cellSize);
+    for (int64_t dx = -reach; dx <= reach && remap[v] == NONE; dx++) {
+      for (int64_t dy = -reach; dy <= reach && remap[v] == NONE; dy++) {
+        for (int64_t dz = -reach; dz <= reach && remap[v] == NONE; dz++) {
+          auto it = cells.find({cell.x + dx, cell.y + dy, cell.z + dz});
+          for (uint32_t c = it == cells.end() ? NONE : it->second; c != NONE; c = next[c]) {
+            if (canWeld(vertices[range.first + c], vertex, tolerance)) {
+              remap[v] = c;
+              break;
+            }
+          }
+        }
+      }
+    }
+
+    if (remap[v] == NONE) {
+      remap[v] = v;
+      auto inserted = cells.emplace(cell, v);
+      if (!inserted.second) {
+        next[v] = inserted.first->second;
+        inserted.first->second = v;
+      }
+      kept++;
+    }
+  }
+
+  for (size_t i = 0; i < indexCount; i++) {
+    indices[i] = range.first + remap[indices[i] - range.first];
+  }
+  return kept;
+}
+
+void optimizeVertexFetch(std::vector<Mesh::Vertex> &vertices, uint32_t *indices, size_t indexCount) {
+  constexpr uint32_t UNUSED = ~0u;
+  std::vector<uint32_t> remap(vertices.size(), UNUSED);
+  std::vector<Mesh::Vertex> result;
+  result.reserve(vertices.size());
+
+  for (size_t i = 0; i < indexCount; i++) {
+    uint32_t &target = remap[indices[i]];
+    if (target == UNUSED) {
+      target = static_cast<uint32_t>(result.size());
+      result.push_back(vertices[indices[i]]);
+    }
+    indices[i] = target;
+  }
+
+  vertices = std::move(result);
+}
+
+} // namespace ve
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "ve_mesh.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ve {
+
+// triangle list optimizations for the gpu's caches, run once at import. all
+// of them work on the triangle list `indices` in place, indices are absolute
+// into the vertex buffer but only the range they actually use is looked at
+
+// how well a triangle list uses a fifo post transform cache of `cacheSize`
+// vertices. `acmr` is the number of vertices transformed per triangle (0.5 is
+// the best a large mesh gets, 3 the worst), `atvr` the number of vertices
+// transformed per vertex used (1 is perfect)
+struct VertexCacheStats {
+  float acmr;
+  float atvr;
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, uint32_t cacheSize = 16);
+
+// reorders the triangles so they reuse the vertices the ones before them
+// transformed, with tipsify (Sander, Nehab and Barczak). if `clusters` isn't
+// null it gets the first index of every run of triangles that starts with a
+// cold cache, the triangles in between can be moved around as a whole
+// without costing much
+void optimizeVertexCache(
+    uint32_t *indices,
+    size_t indexCount,
+    uint32_t cacheSize = 16,
+    std::vector<uint32_t> *clusters = nullptr);
+
+// moves the `clusters` from `optimizeVertexCache()` around so the ones
+// facing away from the center of the mesh are drawn first, they're the most
+// likely to cover the others
+void optimizeOverdraw(
+    uint32_t *indices,
+    size_t indexCount,
+    const std::vector<Mesh::Vertex> &vertices,
+    const std::vector<uint32_t> &clusters);
+
+// how far apart two vertices may be and still get welded into one. each
+// attribute is compared by the distance between the two values, a tolerance
+// of 0 only welds vertices that are exactly the same
+struct WeldTolerance {
+  float position{1e-5f};
+  float normal{1e-3f};
+  float uv{1e-5f};
+};
+
+// points the indices of vertices that are the same within `tolerance` at
+// the first of them, so seams and duplicates exporters left behind share
+// one vertex again. returns the number of distinct vertices still used,
+// the ones no index points at anymore are dropped by `optimizeVertexFetch()`
+uint32_t weldVertices(
+    const std::vector<Mesh::Vertex> &vertices,
+    uint32_t *indices,
+    size_t indexCount,
+    const WeldTolerance &tolerance);
+
+// reorders `vertices` in the order `indices` first uses them and remaps the
+// indices to match, so vertex fetches walk through memory mostly linearly.
+// vertices nothing uses are dropped
+void optimizeVertexFetch(std::vector<Mesh::Vertex> &vertices, uint32_t *indices, size_t indexCount);
+
+} // namespace ve
@@ -0,0 +1,255 @@
+#include "ve_mesh_simplify.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace ve {
+
+namespace {
+
+// symmetric 4x4 matrix summing the squared distances to a set of planes,
+// stored as its upper triangle. `weight` is the total area of the planes so
+// the error can be turned back into a distance
+struct Quadric {
+  double a00{0}, a01{0}, a02{0}, a03{0};
+  double a11{0}, a12{0}, a13{0};
+  double a22{0}, a23{0};
+  double a33{0};
+  double weight{0};
+
+  void addPlane(glm::vec3 normal, float distance, double area) {
+    double a = normal.x, b = normal.y, c = normal.z, d = distance;
+    a00 += area * a * a;
+    a01 += area * a * b;
+    a02 += area * a * c;
+    a03 += area * a * d;
+    a11 += area * b * b;
+    a12 += area * b * c;
+    a13 += area * b * d;
+    a22 += area * c * c;
+    a23 += area * c * d;
+    a33 += area * d * d;
+    weight += area;
+  }
+
+  Quadric &operator+=(const Quadric &other) {
+    a00 += other.a00;
+    a01 += other.a01;
+    a02 += other.a02;
+    a03 += other.a03;
+    a11 += other.a11;
+    a12 += other.a12;
+    a13 += other.a13;
+    a22 += other.a22;
+    a23 += other.a23;
+    a33 += other.a33;
+    weight += other.weight;
+    return *this;
+  }
+
+  // mean squared distance of `p` to the planes
+  double evaluate(glm::vec3 p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double error = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x + a11 * y * y + 2 * a12 * y * z +
+                   2 * a13 * y + a22 * z * z + 2 * a23 * z + a33;
+    return weight > 0 ? std::max(error, 0.0) / weight : 0.0;
+  }
+};
+
+struct Collapse {
+  uint32_t from;
+  uint32_t to;
+  double cost;
+};
+
+uint64_t edgeKey(uint32_t a, uint32_t b) { return (static_cast<uint64_t>(a) << 32) | b; }
+
+struct PositionHash {
+  size_t operator()(const glm::vec3 &p) const {
+    uint32_t bits[3];
+    std::memcpy(bits, &p, sizeof(bits));
+    return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+  }
+};
+
+struct PositionEqual {
+  bool operator()(const glm::vec3 &a, const glm::vec3 &b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+};
+
+} // namespace
+
+std::vector<uint32_t> simplifyMesh(
+    const std::vector<Mesh::Vertex> &vertices,
+    const uint32_t *indices,
+    size_t indexCount,
+    size_t targetIndexCount,
+    float maxError,
+    float &error) {
+  std::vector<uint32_t> result(indices, indices + indexCount);
+  error = 0.0f;
+
+  // vertices sharing a position with another vertex sit on a seam
+  std::vector<uint8_t> locked(vertices.size(), 0);
+  std::unordered_map<glm::vec3, uint32_t, PositionHash, PositionEqual> positions;
+  for (uint32_t index : result) {
+    auto inserted = positions.emplace(vertices[index].position, index);
+    if (!inserted.second && inserted.first->second != index) {
+      locked[index] = 1;
+      locked[inserted.first->second] = 1;
+    }
+  }
+
+  // and edges only one triangle uses are on a border
+  std::unordered_map<uint64_t, uint32_t> edges;
+  for (size_t i = 0; i < result.size(); i += 3) {
+    for (int e = 0; e < 3; e++) {
+      edges[edgeKey(result[i + e], result[i + (e + 1) % 3])]++;
+    }
+  }
+  for (const auto &edge : edges) {
+    uint32_t a = static_cast<uint32_t>(edge.first >> 32);
+    uint32_t b = static_cast<uint32_t>(edge.first & 0xffffffff);
+    if (edges.find(edgeKey(b, a)) == edges.end()) {
+      locked[a] = 1;
+      locked[b] = 1;
+    }
+  }
+
+  std::vector<Quadric> quadrics(vertices.size());
+  for (size_t i = 0; i < result.size(); i += 3) {
+    glm::vec3 p0 = vertices[result[i]].position;
+    glm::vec3 p1 = vertices[result[i + 1]].position;
+    glm::vec3 p2 = vertices[result[i + 2]].position;
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    float length = glm::length(normal);
+    if (length == 0.0f) {
+      continue;
+    }
+    normal = normal / length;
+    for (int v = 0; v < 3; v++) {
+      quadrics[result[i + v]].addPlane(normal, -glm::dot(normal, p0), 0.5 * length);
+    }
+  }
+
+  double maxCost = static_cast<double>(maxError) * maxError;
+  double worstCost = 0.0;
+
+  std::vector<uint32_t> remap(vertices.size());
+  std::vector<uint8_t> touched(vertices.size());
+  std::vector<uint32_t> triangleOffsets(vertices.size() + 1);
+  std::vector<uint32_t> vertexTriangles;
+  std::vector<Collapse> collapses;
+
+  // every pass collapses a batch of the cheapest edges, as many as can be done
+  // without two of them touching the same triangles
+  while (result.size() > targetIndexCount) {
+    size_t triangleCount = result.size() / 3;
+
+    // triangles around each vertex
+    std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+    for (uint32_t index : result) {
+      triangleOffsets[index + 1]++;
+    }
+    for (size_t v = 0; v < vertices.size(); v++) {
+      triangleOffsets[v + 1] += triangleOffsets[v];
+    }
+    vertexTriangles.resize(result.size());
+    std::vector<uint32_t> cursor(triangleOffsets.begin(), triangleOffsets.end() - 1);
+    for (size_t i = 0; i < result.size(); i++) {
+      vertexTriangles[cursor[result[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    collapses.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (int e = 0; e < 3; e++) {
+        uint32_t a = result[i + e];
+        uint32_t b = result[i + (e + 1) % 3];
+        if (locked[a]) {
+          continue;
+        }
+        Quadric q = quadrics[a];
+        q += quadrics[b];
+        collapses.push_back({a, b, q.evaluate(vertices[b].position)});
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse &l, const Collapse &r) { return l.cost < r.cost; });
+
+    for (size_t v = 0; v < vertices.size(); v++) {
+      remap[v] = static_cast<uint32_t>(v);
+    }
+    std::fill(touched.begin(), touched.end(), 0);
+
+    // each collapse removes about two triangles
+    size_t collapseLimit = (triangleCount - targetIndexCount / 3) / 2 + 1;
+    size_t collapsed = 0;
+    for (const Collapse &collapse : collapses) {
+      if (collapsed >= collapseLimit || collapse.cost > maxCost) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to]) {
+        continue;
+      }
+
+      // moving `from` onto `to` mustn't turn any of the remaining triangles around
+      glm::vec3 target = vertices[collapse.to].position;
+      bool flips = false;
+      for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1] && !flips; t++) {
+        const uint32_t *triangle = &result[vertexTriangles[t] * 3];
+        if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+          continue;
+        }
+        glm::vec3 p[3];
+        glm::vec3 q[3];
+        for (int v = 0; v < 3; v++) {
+          p[v] = vertices[triangle[v]].position;
+          q[v] = triangle[v] == collapse.from ? target : p[v];
+        }
+        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+        flips = glm::dot(before, after) <= 0.0f;
+      }
+      if (flips) {
+        continue;
+      }
+
+      // nothing around `from` can change again in this pass, the flip test
+      // above assumed its neighbours stay where they are
+      for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1]; t++) {
+        const uint32_t *triangle = &result[vertexTriangles[t] * 3];
+        touched[triangle[0]] = 1;
+        touched[triangle[1]] = 1;
+        touched[triangle[2]] = 1;
+      }
+
+      remap[collapse.from] = collapse.to;
+      quadrics[collapse.to] += quadrics[collapse.from];
+      worstCost = std::max(worstCost, collapse.cost);
+      collapsed++;
+    }
+
+    if (collapsed == 0) {
+      break;
+    }
+
+    // drop the triangles that collapsed into lines
+    size_t write = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      uint32_t a = remap[result[i]];
+      uint32_t b = remap[result[i + 1]];
+      uint32_t c = remap[result[i + 2]];
+      if (a != b && b != c && a != c) {
+        result[write++] = a;
+        result[write++] = b;
+        result[write++] = c;
+      }
+    }
+    result.resize(write);
+  }
+
+  error = static_cast<float>(std::sqrt(worstCost));
+  return result;
+}
+
+} // namespace ve
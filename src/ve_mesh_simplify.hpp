@@ -0,0 +1,31 @@
+#pragma once
+
+#include "ve_mesh.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ve {
+
+// reduces the triangle list `indices` to around `targetIndexCount` indices by
+// collapsing edges in order of their quadric error (Garland and Heckbert).
+// vertices only ever collapse onto other vertices, so the result indexes the
+// same `vertices` and can share their buffer with the original.
+//
+// vertices on an open border or on an attribute seam (several vertices at
+// the same position) never move, which keeps holes and uv seams intact but
+// can stop the reduction short of the target. collapses that would flip a
+// triangle or cost more than `maxError` are skipped as well.
+//
+// `error` is set to the largest distance, in object space, between the
+// result and the surface it replaces
+std::vector<uint32_t> simplifyMesh(
+    const std::vector<Mesh::Vertex> &vertices,
+    const uint32_t *indices,
+    size_t indexCount,
+    size_t targetIndexCount,
+    float maxError,
+    float &error);
+
+} // namespace ve
@@ -0,0 +1,151 @@
+#include "ve_object_store.hpp"
+
+#include "ve_game_object.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace ve {
+
+ObjectHandle ObjectStore::create(Mesh mesh, glm::vec3 translation, glm::vec3 rotation, glm::vec3 scale) {
+  uint32_t index = static_cast<uint32_t>(m_meshes.size());
+
+  uint32_t id;
+  if (m_freeIds.empty()) {
+    id = static_cast<uint32_t>(m_handleToIndex.size());
+    m_handleToIndex.push_back(index);
+    m_generations.push_back(0);
+  } else {
+    id = m_freeIds.back();
+    m_freeIds.pop_back();
+    m_handleToIndex[id] = index;
+  }
+  m_indexToHandle.push_back(id);
+
+  m_translations.push_back(translation);
+  m_rotations.push_back(rotation);
+  m_scales.push_back(scale);
+  m_colors.push_back(glm::vec3(1.0f));
+  m_meshes.push_back(mesh);
+
+  m_worldMatrices.emplace_back(1.0f);
+  m_normalMatrices.emplace_back(1.0f);
+  m_dirtyPositions.push_back(NOT_DIRTY);
+  markDirty(index);
+
+  return {id, m_generations[id]};
+}
+
+void ObjectStore::destroy(ObjectHandle handle) {
+  assert(contains(handle) && "Tried to destroy an object that doesn't exist");
+  uint32_t index = indexOf(handle);
+  uint32_t last = static_cast<uint32_t>(m_meshes.size()) - 1;
+
+  clearDirty(index);
+  if (index != last) {
+    clearDirty(last);
+    m_translations[index] = m_translations[last];
+    m_rotations[index] = m_rotations[last];
+    m_scales[index] = m_scales[last];
+    m_colors[index] = m_colors[last];
+    m_meshes[index] = m_meshes[last];
+    m_worldMatrices[index] = m_worldMatrices[last];
+    m_normalMatrices[index] = m_normalMatrices[last];
+
+    m_indexToHandle[index] = m_indexToHandle[last];
+    m_handleToIndex[m_indexToHandle[index]] = index;
+    markDirty(index);
+  }
+
+  m_translations.pop_back();
+  m_rotations.pop_back();
+  m_scales.pop_back();
+  m_colors.pop_back();
+  m_meshes.pop_back();
+  m_worldMatrices.pop_back();
+  m_normalMatrices.pop_back();
+  m_dirtyPositions.pop_back();
+  m_indexToHandle.pop_back();
+
+  // the next object to get this id gets a new generation, so `handle` stays dead
+  m_handleToIndex[handle.id] = ObjectHandle::INVALID;
+  m_generations[handle.id]++;
+  m_freeIds.push_back(handle.id);
+}
+
+void ObjectStore::reserve(size_t count) {
+  m_translations.reserve(count);
+  m_rotations.reserve(count);
+  m_scales.reserve(count);
+  m_colors.reserve(count);
+  m_meshes.reserve(count);
+  m_worldMatrices.reserve(count);
+  m_normalMatrices.reserve(count);
+  m_dirtyPositions.reserve(count);
+  m_handleToIndex.reserve(count);
+  m_indexToHandle.reserve(count);
+  m_generations.reserve(count);
+}
+
+void ObjectStore::setTranslation(ObjectHandle handle, glm::vec3 translation) {
+  uint32_t index = indexOf(handle);
+  m_translations[index] = translation;
+  markDirty(index);
+}
+
+void ObjectStore::setRotation(ObjectHandle handle, glm::vec3 rotation) {
+  uint32_t index = indexOf(handle);
+  m_rotations[index] = rotation;
+  markDirty(index);
+}
+
+void ObjectStore::setScale(ObjectHandle handle, glm::vec3 scale) {
+  uint32_t index = indexOf(handle);
+  m_scales[index] = scale;
+  markDirty(index);
+}
+
+void ObjectStore::markDirty(uint32_t index) {
+  if (m_dirtyPositions[index] == NOT_DIRTY) {
+    m_dirtyPositions[index] = static_cast<uint32_t>(m_dirtyIndices.size());
+    m_dirtyIndices.push_back(index);
+  }
+}
+
+void ObjectStore::clearDirty(uint32_t index) {
+  uint32_t position = m_dirtyPositions[index];
+  if (position == NOT_DIRTY) {
+    return;
+  }
+
+  uint32_t moved = m_dirtyIndices.back();
+  m_dirtyIndices[position] = moved;
+  m_dirtyPositions[moved] = position;
+  m_dirtyIndices.pop_back();
+  m_dirtyPositions[index] = NOT_DIRTY;
+}
+
+const std::vector<uint32_t> &ObjectStore::updateTransforms(ThreadPool &threadPool) {
+  m_updatedIndices.clear();
+  std::swap(m_updatedIndices, m_dirtyIndices);
+
+  // sorting keeps neighbouring objects in the same chunk, so chunks don't
+  // end up writing matrices that share a cache line
+  std::sort(m_updatedIndices.begin(), m_updatedIndices.end());
+
+  threadPool.parallelFor(m_updatedIndices.size(), TRANSFORM_GRAIN_SIZE, 1, [this](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      uint32_t index = m_updatedIndices[i];
+      m_worldMatrices[index] = composeTransform(m_translations[index], m_rotations[index], m_scales[index]);
+      // transpose(inverse(T * R * S)) has the same upper 3x3 as R * S^-1, which
+      // is all that's needed to transform normals
+      m_normalMatrices[index] = composeTransform(glm::vec3(0.0f), m_rotations[index], 1.0f / m_scales[index]);
+      m_dirtyPositions[index] = NOT_DIRTY;
+    }
+  });
+
+  return m_updatedIndices;
+}
+
+} // namespace ve
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "ve_mesh.hpp"
+#include "ve_thread_pool.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace ve {
+
+// a reference to an object living in an `ObjectStore`. the dense index of an
+// object may change when the store is reordered, but its handle never does.
+//
+// ids of destroyed objects are reused, the generation tells the objects that
+// shared an id apart, so a handle to a destroyed object never refers to a
+// newer one
+struct ObjectHandle {
+  static constexpr uint32_t INVALID = std::numeric_limits<uint32_t>::max();
+
+  uint32_t id{INVALID};
+  uint32_t generation{0};
+
+  bool valid() const { return id != INVALID; }
+  bool operator==(const ObjectHandle &other) const { return id == other.id && generation == other.generation; }
+  bool operator!=(const ObjectHandle &other) const { return !(*this == other); }
+};
+
+// structure-of-arrays storage for scene objects. every per-object attribute
+// lives in its own contiguous array, indexed by the object's dense index
+// (0..size()-1), so per-frame passes can stream over exactly the data they
+// need instead of copying whole objects around.
+class ObjectStore {
+public:
+  ObjectStore() = default;
+  ~ObjectStore() = default;
+
+  ObjectStore(const ObjectStore &) = delete;
+  ObjectStore &operator=(const ObjectStore &) = delete;
+
+  ObjectHandle create(Mesh mesh, glm::vec3 translation, glm::vec3 rotation, glm::vec3 scale);
+  // moves the last object into the destroyed one's dense index, so the
+  // arrays stay packed. that object counts as changed afterwards, since
+  // anything indexed by its old dense index is out of date
+  void destroy(ObjectHandle handle);
+  void reserve(size_t count);
+
+  size_t size() const { return m_meshes.size(); }
+  // ids handed out so far, those of live objects and the free ones waiting to be reused
+  size_t idCount() const { return m_generations.size(); }
+  bool empty() const { return m_meshes.empty(); }
+
+  // false once the object `handle` refers to has been destroyed
+  bool contains(ObjectHandle handle) const {
+    return handle.id < m_generations.size() && m_generations[handle.id] == handle.generation &&
+           m_handleToIndex[handle.id] != ObjectHandle::INVALID;
+  }
+  uint32_t indexOf(ObjectHandle handle) const { return m_handleToIndex[handle.id]; }
+  ObjectHandle handleAt(uint32_t index) const {
+    uint32_t id = m_indexToHandle[index];
+    return {id, m_generations[id]};
+  }
+
+  void setTranslation(ObjectHandle handle, glm::vec3 translation);
+  void setRotation(ObjectHandle handle, glm::vec3 rotation);
+  void setScale(ObjectHandle handle, glm::vec3 scale);
+  void setColor(ObjectHandle handle, glm::vec3 color) { m_colors[indexOf(handle)] = color; }
+  // the scene has to be told as well so the object moves to the right draw batches
+  void setMesh(ObjectHandle handle, Mesh mesh) { m_meshes[indexOf(handle)] = mesh; }
+
+  // contiguous per-object arrays, indexed by dense index
+  const std::vector<glm::vec3> &translations() const { return m_translations; }
+  const std::vector<glm::vec3> &rotations() const { return m_rotations; }
+  const std::vector<glm::vec3> &scales() const { return m_scales; }
+  const std::vector<glm::vec3> &colors() const { return m_colors; }
+  const std::vector<Mesh> &meshes() const { return m_meshes; }
+
+  // recomputes the cached matrices of every object whose transform changed
+  // since the last call, and returns the dense indices of those objects.
+  // the returned list is valid until the next call.
+  const std::vector<uint32_t> &updateTransforms(ThreadPool &threadPool);
+
+  // cached matrices, only up to date after `updateTransforms()`
+  const glm::mat4 &worldMatrix(uint32_t index) const { return m_worldMatrices[index]; }
+  const glm::mat4 &normalMatrix(uint32_t index) const { return m_normalMatrices[index]; }
+
+  bool isDirty(uint32_t index) const { return m_dirtyPositions[index] != NOT_DIRTY; }
+  size_t dirtyCount() const { return m_dirtyIndices.size(); }
+
+  static constexpr size_t TRANSFORM_GRAIN_SIZE = 256;
+
+private:
+  static constexpr uint32_t NOT_DIRTY = std::numeric_limits<uint32_t>::max();
+
+  void markDirty(uint32_t index);
+  void clearDirty(uint32_t index);
+
+  std::vector<glm::vec3> m_translations;
+  std::vector<glm::vec3> m_rotations;
+  std::vector<glm::vec3> m_scales;
+  std::vector<glm::vec3> m_colors;
+  std::vector<Mesh> m_meshes;
+
+  std::vector<glm::mat4> m_worldMatrices;
+  std::vector<glm::mat4> m_normalMatrices;
+  // where each object is in `m_dirtyIndices`, so it can be taken out again
+  std::vector<uint32_t> m_dirtyPositions;
+  std::vector<uint32_t> m_dirtyIndices;
+  std::vector<uint32_t> m_updatedIndices;
+
+  // handle id -> dense index, and back. ids of destroyed objects map to
+  // ObjectHandle::INVALID and wait in `m_freeIds` to be reused
+  std::vector<uint32_t> m_handleToIndex;
+  std::vector<uint32_t> m_indexToHandle;
+  std::vector<uint32_t> m_generations;
+  std::vector<uint32_t> m_freeIds;
+};
+
+} // namespace ve
@@ -0,0 +1,118 @@
+// ve-pack: packs assets into a .pak archive the engine mounts instead of
+// opening every file on its own.
+//
+//   ve-pack <archive> [--compress] <file or directory>...
+//
+// entries are named by their paths as given, relative to the directory the
+// engine runs from, so run it from there: ve-pack assets.pak models textures shaders.
+// sources that have a cooked file next to them are left out, ve-cook them first
+
+#include "ve_mapped_file.hpp"
+#include "ve_pak.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const std::vector<std::string> COOKED_EXTENSIONS = {".vemesh", ".vetex"};
+const std::vector<std::string> SKIPPED_NAMES = {"cook_manifest.txt"};
+
+bool packed(const fs::path &path) {
+  if (path.extension() == ".tmp" ||
+      std::find(SKIPPED_NAMES.begin(), SKIPPED_NAMES.end(), path.filename().string()) != SKIPPED_NAMES.end()) {
+    return false;
+  }
+  for (const std::string &extension : COOKED_EXTENSIONS) {
+    fs::path cooked = path;
+    cooked += extension;
+    if (fs::exists(cooked)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string archivePath;
+  bool compress = false;
+  std::vector<fs::path> inputs;
+  for (int i = 1; i < argc; i++) {
+    std::string argument = argv[i];
+    if (argument == "--compress") {
+      compress = true;
+    } else if (archivePath.empty()) {
+      archivePath = argument;
+    } else {
+      inputs.push_back(argument);
+    }
+  }
+  if (archivePath.empty() || inputs.empty()) {
+    std::cout << "usage: ve-pack <archive> [--compress] <file or directory>..." << std::endl;
+    return 1;
+  }
+
+  std::vector<fs::path> files;
+  try {
+    for (const fs::path &input : inputs) {
+      if (fs::is_directory(input)) {
+        for (const fs::directory_entry &entry : fs::recursive_directory_iterator(input)) {
+          if (entry.is_regular_file() && packed(entry.path())) {
+            files.push_back(entry.path());
+          }
+        }
+      } else if (fs::is_regular_file(input)) {
+        files.push_back(input);
+      } else {
+        std::cerr << "ve-pack: no such file or directory " << input.string() << std::endl;
+        return 1;
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "ve-pack: " << e.what() << std::endl;
+    return 1;
+  }
+
+  // sorted, so the same assets always make the same archive
+  for (fs::path &file : files) {
+    file = file.lexically_normal();
+  }
+  std::sort(files.begin(), files.end());
+  files.erase(std::unique(files.begin(), files.end()), files.end());
+  // an older archive never ends up inside the new one
+  fs::path archive = fs::absolute(archivePath).lexically_normal();
+  files.erase(
+      std::remove_if(
+          files.begin(),
+          files.end(),
+          [&archive](const fs::path &file) { return fs::absolute(file).lexically_normal() == archive; }),
+      files.end());
+
+  ve::pak::Writer writer{archivePath};
+  uint64_t totalSize = 0;
+  for (const fs::path &file : files) {
+    try {
+      ve::MappedFile mapped(file.string());
+      writer.add(file.generic_string(), mapped.data(), mapped.size(), compress);
+      totalSize += mapped.size();
+    } catch (const std::exception &e) {
+      std::cerr << "ve-pack: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+  if (!writer.finish()) {
+    std::cerr << "ve-pack: couldn't write " << archivePath << std::endl;
+    return 1;
+  }
+
+  std::cout << "ve-pack: " << files.size() << " files, " << totalSize << " bytes packed into " << writer.storedSize()
+            << " bytes of " << archivePath << std::endl;
+  return 0;
+}
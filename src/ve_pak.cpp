@@ -0,0 +1,119 @@
+#include "ve_pak.hpp"
+
+#include "ve_lz4.hpp"
+
+#include <cstdio>
+#include <iostream>
+
+namespace ve {
+
+namespace pak {
+
+const Header *parse(const uint8_t *data, size_t size) {
+  if (size < sizeof(Header)) {
+    std::cout << "pak::parse(): file is too small" << std::endl;
+    return nullptr;
+  }
+
+  const Header *header = reinterpret_cast<const Header *>(data);
+  if (header->magic != MAGIC) {
+    std::cout << "pak::parse(): not a .pak file" << std::endl;
+    return nullptr;
+  }
+  if (header->version != VERSION) {
+    std::cout << "pak::parse(): archive was written by a different version" << std::endl;
+    return nullptr;
+  }
+
+  auto fits = [size](uint64_t offset, uint64_t bytes) { return offset <= size && bytes <= size - offset; };
+  bool complete = header->entriesOffset % alignof(Entry) == 0 &&
+                  fits(header->entriesOffset, uint64_t{header->entryCount} * sizeof(Entry)) &&
+                  fits(header->namesOffset, header->namesSize);
+  for (uint32_t i = 0; complete && i < header->entryCount; i++) {
+    const Entry &entry = entries(data, *header)[i];
+    complete = fits(entry.offset, entry.storedSize) && fits(entry.nameOffset, entry.nameSize) &&
+               uint64_t{entry.nameOffset} + entry.nameSize <= header->namesSize &&
+               (entry.compression == Compression::LZ4 ||
+                (entry.compression == Compression::None && entry.storedSize == entry.size));
+  }
+  if (!complete) {
+    std::cout << "pak::parse(): archive is truncated or corrupt" << std::endl;
+    return nullptr;
+  }
+
+  return header;
+}
+
+Writer::Writer(const std::string &path)
+    : m_path{path}
+    , m_temporaryPath{path + ".tmp"}
+    , m_file{m_temporaryPath, std::ios::binary | std::ios::trunc} {
+  // the header goes in last, once the index is known
+  Header header{};
+  write(&header, sizeof(header));
+  pad();
+}
+
+void Writer::write(const void *data, size_t size) {
+  m_file.write(reinterpret_cast<const char *>(data), size);
+  m_offset += size;
+}
+
+void Writer::pad() {
+  static const uint8_t zeros[ALIGNMENT] = {};
+  write(zeros, (ALIGNMENT - m_offset % ALIGNMENT) % ALIGNMENT);
+}
+
+void Writer::add(const std::string &name, const uint8_t *data, size_t size, bool compress) {
+  Entry entry{};
+  entry.offset = m_offset;
+  entry.size = size;
+  entry.storedSize = size;
+  entry.nameOffset = static_cast<uint32_t>(m_names.size());
+  entry.nameSize = static_cast<uint32_t>(name.size());
+  entry.compression = Compression::None;
+  m_names += name;
+
+  std::vector<uint8_t> compressed;
+  if (compress && size > 0) {
+    compressed.resize(lz4::compressBound(size));
+    size_t compressedSize = lz4::compress(data, size, compressed.data(), compressed.size());
+    // small savings aren't worth giving up reading the entry in place
+    if (compressedSize > 0 && compressedSize <= size - size / 8) {
+      entry.compression = Compression::LZ4;
+      entry.storedSize = compressedSize;
+      data = compressed.data();
+    }
+  }
+
+  write(data, entry.storedSize);
+  pad();
+  m_entries.push_back(entry);
+}
+
+bool Writer::finish() {
+  Header header{};
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.entryCount = static_cast<uint32_t>(m_entries.size());
+  header.entriesOffset = m_offset;
+  write(m_entries.data(), m_entries.size() * sizeof(Entry));
+  header.namesOffset = m_offset;
+  header.namesSize = m_names.size();
+  write(m_names.data(), m_names.size());
+
+  m_file.seekp(0);
+  m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  m_file.close();
+  if (!m_file) {
+    std::remove(m_temporaryPath.c_str());
+    return false;
+  }
+
+  std::remove(m_path.c_str());
+  return std::rename(m_temporaryPath.c_str(), m_path.c_str()) == 0;
+}
+
+} // namespace pak
+
+} // namespace ve
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace ve {
+
+// the asset archive format. a .pak file is a header, the data of every file
+// it holds, each aligned so it can be used straight out of a mapped archive,
+// and at the end an index of entries and their names. entries are stored
+// as they are unless compressing them with LZ4 was worth it
+namespace pak {
+
+constexpr uint32_t MAGIC = 0x4b415056; // "VPAK"
+constexpr uint32_t VERSION = 1;
+constexpr uint64_t ALIGNMENT = 16;
+
+enum class Compression : uint32_t {
+  None = 0,
+  LZ4 = 1,
+};
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entryCount;
+  uint32_t pad;
+  // counted from the start of the file
+  uint64_t entriesOffset;
+  uint64_t namesOffset;
+  uint64_t namesSize;
+};
+
+struct Entry {
+  uint64_t offset;
+  // bytes in the archive, and bytes once decompressed
+  uint64_t storedSize;
+  uint64_t size;
+  // into the names, which aren't null terminated
+  uint32_t nameOffset;
+  uint32_t nameSize;
+  Compression compression;
+  uint32_t pad;
+};
+
+// the header of `data` if it's a complete archive this build can read,
+// every entry of it included. nullptr otherwise, says why on stdout
+const Header *parse(const uint8_t *data, size_t size);
+
+inline const Entry *entries(const uint8_t *data, const Header &header) {
+  return reinterpret_cast<const Entry *>(data + header.entriesOffset);
+}
+
+inline std::string name(const uint8_t *data, const Header &header, const Entry &entry) {
+  return std::string(reinterpret_cast<const char *>(data + header.namesOffset + entry.nameOffset), entry.nameSize);
+}
+
+// writes an archive entry by entry, straight to disk. the archive only
+// replaces the file at `path` once `finish()` succeeds
+class Writer {
+public:
+  explicit Writer(const std::string &path);
+
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  // adds a file called `name`. with `compress` it's stored compressed if
+  // that makes it at least an eighth smaller
+  void add(const std::string &name, const uint8_t *data, size_t size, bool compress);
+
+  // writes the index, false if anything couldn't be written
+  bool finish();
+
+  uint64_t storedSize() const { return m_offset; }
+
+private:
+  void write(const void *data, size_t size);
+  void pad();
+
+  std::string m_path;
+  std::string m_temporaryPath;
+  std::ofstream m_file;
+  std::vector<Entry> m_entries;
+  std::string m_names;
+  uint64_t m_offset{0};
+};
+
+} // namespace pak
+
+} // namespace ve
@@ -7,10 +7,11 @@
 
 namespace ve {
 
-Pipeline::Pipeline(Device &device, VkPipeline pipeline, VkPipelineLayout layout)
+Pipeline::Pipeline(Device &device, VkPipeline pipeline, VkPipelineLayout layout, VkPipelineBindPoint bindPoint)
     : m_device{device}
     , m_graphicsPipeline{pipeline}
-    , m_layout{layout} {}
+    , m_layout{layout}
+    , m_bindPoint{bindPoint} {}
 
 Pipeline::~Pipeline() {
   vkDestroyPipeline(m_device.device(), m_graphicsPipeline, nullptr);
@@ -18,7 +19,7 @@ Pipeline::~Pipeline() {
 }
 
 void Pipeline::bind(VkCommandBuffer cmd) {
-  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+  vkCmdBindPipeline(cmd, m_bindPoint, m_graphicsPipeline);
 }
 
 } // namespace ve
\ No newline at end of file
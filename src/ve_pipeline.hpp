@@ -10,19 +10,25 @@ namespace ve {
 
 class Pipeline {
 public:
-  Pipeline(Device &device, VkPipeline pipeline, VkPipelineLayout layout);
+  Pipeline(
+      Device &device,
+      VkPipeline pipeline,
+      VkPipelineLayout layout,
+      VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS);
   ~Pipeline();
 
   Pipeline(const Pipeline &) = delete;
   Pipeline &operator=(const Pipeline &) = delete;
 
   VkPipelineLayout &layout() { return m_layout; }
+  VkPipelineBindPoint bindPoint() { return m_bindPoint; }
 
   void bind(VkCommandBuffer cmd);
 
 private:
   VkPipeline m_graphicsPipeline;
   VkPipelineLayout m_layout;
+  VkPipelineBindPoint m_bindPoint;
   Device &m_device;
 };
 
@@ -41,6 +41,18 @@ PipelineBuilder &PipelineBuilder::setVertexInput(
   return *this;
 }
 
+PipelineBuilder &PipelineBuilder::setSpecializationConstant(uint32_t id, uint32_t value) {
+  VkSpecializationMapEntry entry{};
+  entry.constantID = id;
+  entry.offset = static_cast<uint32_t>(m_specializationData.size() * sizeof(uint32_t));
+  entry.size = sizeof(uint32_t);
+
+  m_specializationEntries.push_back(entry);
+  m_specializationData.push_back(value);
+
+  return *this;
+}
+
 PipelineBuilder &PipelineBuilder::setPrimitiveTopology(VkPrimitiveTopology topology) {
   m_configInfo.inputAssemblyInfo.topology = topology;
 
@@ -71,7 +83,25 @@ PipelineBuilder &PipelineBuilder::reflectLayout() {
   return *this;
 }
 
+void PipelineBuilder::applySpecialization() {
+  if (m_specializationEntries.empty()) {
+    return;
+  }
+
+  m_specializationInfo.mapEntryCount = static_cast<uint32_t>(m_specializationEntries.size());
+  m_specializationInfo.pMapEntries = m_specializationEntries.data();
+  m_specializationInfo.dataSize = m_specializationData.size() * sizeof(uint32_t);
+  m_specializationInfo.pData = m_specializationData.data();
+
+  // stages without a constant of the given id just ignore it
+  for (VkPipelineShaderStageCreateInfo &stage : m_shaderStages) {
+    stage.pSpecializationInfo = &m_specializationInfo;
+  }
+}
+
 std::unique_ptr<Pipeline> PipelineBuilder::build() {
+  applySpecialization();
+
   VkGraphicsPipelineCreateInfo pipelineInfo{};
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineInfo.stageCount = static_cast<uint32_t>(m_shaderStages.size());
@@ -102,6 +132,30 @@ std::unique_ptr<Pipeline> PipelineBuilder::build() {
   return std::move(std::make_unique<Pipeline>(m_device, pipeline, m_pipelineLayout));
 }
 
+std::unique_ptr<Pipeline> PipelineBuilder::buildCompute() {
+  if (m_shaderStages.size() != 1 || m_shaderStages[0].stage != VK_SHADER_STAGE_COMPUTE_BIT) {
+    throw std::runtime_error("A compute pipeline needs exactly one compute shader stage");
+  }
+
+  applySpecialization();
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage = m_shaderStages[0];
+  pipelineInfo.layout = m_pipelineLayout;
+  pipelineInfo.basePipelineIndex = -1;
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+  VkPipeline pipeline{};
+
+  if (vkCreateComputePipelines(m_device.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("Failed to create compute pipeline");
+  }
+
+  return std::make_unique<Pipeline>(m_device, pipeline, m_pipelineLayout, VK_PIPELINE_BIND_POINT_COMPUTE);
+}
+
 void PipelineBuilder::defaultPipelineConfigInfo(PipelineConfigInfo &configInfo) {
   configInfo.inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
   configInfo.inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
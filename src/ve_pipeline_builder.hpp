@@ -37,6 +37,8 @@ public:
   PipelineBuilder &setVertexInput(
       const std::vector<VkVertexInputBindingDescription> &bindingDescriptions,
       const std::vector<VkVertexInputAttributeDescription> &attributeDescriptions);
+  // sets the specialization constant `id` in every stage that declares it
+  PipelineBuilder &setSpecializationConstant(uint32_t id, uint32_t value);
   PipelineBuilder &setPrimitiveTopology(VkPrimitiveTopology topology);
   PipelineBuilder &setRenderPass(VkRenderPass renderPass);
   PipelineBuilder &setSampleCount(VkSampleCountFlagBits sampleCount);
@@ -44,11 +46,18 @@ public:
   PipelineBuilder &reflectLayout();
 
   std::unique_ptr<Pipeline> build();
+  // builds a compute pipeline out of the single compute stage that was added,
+  // everything but the layout is ignored
+  std::unique_ptr<Pipeline> buildCompute();
 
 private:
   static void defaultPipelineConfigInfo(PipelineConfigInfo &configInfo);
+  void applySpecialization();
 
   std::vector<VkPipelineShaderStageCreateInfo> m_shaderStages{};
+  std::vector<VkSpecializationMapEntry> m_specializationEntries{};
+  std::vector<uint32_t> m_specializationData{};
+  VkSpecializationInfo m_specializationInfo{};
   PipelineConfigInfo m_configInfo{};
   VkPipelineLayout m_pipelineLayout;
   Device &m_device;
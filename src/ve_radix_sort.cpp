@@ -0,0 +1,65 @@
+#include "ve_radix_sort.hpp"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <utility>
+
+namespace ve {
+
+void radixSort(
+    std::vector<uint64_t> &keys,
+    std::vector<uint32_t> &values,
+    std::vector<uint64_t> &scratchKeys,
+    std::vector<uint32_t> &scratchValues) {
+  assert(keys.size() == values.size() && "Every key needs exactly one value");
+
+  constexpr uint32_t DIGIT_BITS = 8;
+  constexpr uint32_t DIGIT_COUNT = 64 / DIGIT_BITS;
+  constexpr uint32_t BUCKET_COUNT = 1 << DIGIT_BITS;
+
+  const size_t count = keys.size();
+  if (count < 2) {
+    return;
+  }
+
+  // one histogram per digit, all built in a single pass over the keys
+  std::array<std::array<size_t, BUCKET_COUNT>, DIGIT_COUNT> histograms{};
+  for (uint64_t key : keys) {
+    for (uint32_t digit = 0; digit < DIGIT_COUNT; digit++) {
+      histograms[digit][(key >> (digit * DIGIT_BITS)) & (BUCKET_COUNT - 1)]++;
+    }
+  }
+
+  scratchKeys.resize(count);
+  scratchValues.resize(count);
+
+  for (uint32_t digit = 0; digit < DIGIT_COUNT; digit++) {
+    std::array<size_t, BUCKET_COUNT> &histogram = histograms[digit];
+
+    // every key has the same value for this digit, so this pass wouldn't move anything
+    uint32_t firstBucket = (keys[0] >> (digit * DIGIT_BITS)) & (BUCKET_COUNT - 1);
+    if (histogram[firstBucket] == count) {
+      continue;
+    }
+
+    size_t offset = 0;
+    for (size_t &bucket : histogram) {
+      size_t bucketCount = bucket;
+      bucket = offset;
+      offset += bucketCount;
+    }
+
+    const uint32_t shift = digit * DIGIT_BITS;
+    for (size_t i = 0; i < count; i++) {
+      size_t destination = histogram[(keys[i] >> shift) & (BUCKET_COUNT - 1)]++;
+      scratchKeys[destination] = keys[i];
+      scratchValues[destination] = values[i];
+    }
+
+    std::swap(keys, scratchKeys);
+    std::swap(values, scratchValues);
+  }
+}
+
+} // namespace ve
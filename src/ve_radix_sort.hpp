@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace ve {
+
+// sorts `keys` in ascending order and applies the same permutation to
+// `values`, with an LSD radix sort over 8-bit digits. the sort is stable,
+// and passes over digits that are identical for every key are skipped.
+// the scratch vectors are resized as needed and can be reused between calls
+// to avoid reallocating.
+void radixSort(
+    std::vector<uint64_t> &keys,
+    std::vector<uint32_t> &values,
+    std::vector<uint64_t> &scratchKeys,
+    std::vector<uint32_t> &scratchValues);
+
+} // namespace ve
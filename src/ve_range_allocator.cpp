@@ -0,0 +1,269 @@
+#include "ve_range_allocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace ve {
+
+namespace {
+
+uint32_t floorLog2(uint32_t value) {
+  uint32_t log = 0;
+  while (value >>= 1) {
+    log++;
+  }
+  return log;
+}
+
+uint32_t lowestBit(uint32_t value) {
+  uint32_t bit = 0;
+  while ((value & 1) == 0) {
+    value >>= 1;
+    bit++;
+  }
+  return bit;
+}
+
+} // namespace
+
+RangeAllocator::RangeAllocator(uint32_t capacity) {
+  m_freeLists.fill(NO_BLOCK);
+  grow(capacity);
+}
+
+void RangeAllocator::sizeClass(uint32_t size, uint32_t &firstLevel, uint32_t &secondLevel) {
+  // sizes below SECOND_LEVEL_COUNT get a list each, above that every power
+  // of two is split into SECOND_LEVEL_COUNT lists of equal width
+  if (size < SECOND_LEVEL_COUNT) {
+    firstLevel = 0;
+    secondLevel = size;
+    return;
+  }
+  uint32_t log = floorLog2(size);
+  firstLevel = log - SECOND_LEVEL_BITS + 1;
+  secondLevel = (size >> (log - SECOND_LEVEL_BITS)) - SECOND_LEVEL_COUNT;
+}
+
+uint32_t RangeAllocator::findFree(uint32_t size) const {
+  // rounding up to the next size class means any block of the class found fits
+  uint64_t rounded = size;
+  if (size >= SECOND_LEVEL_COUNT) {
+    rounded += (uint64_t{1} << (floorLog2(size) - SECOND_LEVEL_BITS)) - 1;
+  }
+  if (rounded <= std::numeric_limits<uint32_t>::max()) {
+    uint32_t firstLevel, secondLevel;
+    sizeClass(static_cast<uint32_t>(rounded), firstLevel, secondLevel);
+
+    uint32_t secondLevelMap = m_secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+    if (secondLevelMap == 0) {
+      uint32_t firstLevelMap = firstLevel + 1 < 32 ? m_firstLevelBitmap & (~0u << (firstLevel + 1)) : 0;
+      if (firstLevelMap != 0) {
+        firstLevel = lowestBit(firstLevelMap);
+        secondLevelMap = m_secondLevelBitmaps[firstLevel];
+      }
+    }
+    if (secondLevelMap != 0) {
+      return m_freeLists[firstLevel * SECOND_LEVEL_COUNT + lowestBit(secondLevelMap)];
+    }
+  }
+
+  // nothing in the classes above, but a block of the size's own class can still fit
+  uint32_t firstLevel, secondLevel;
+  sizeClass(size, firstLevel, secondLevel);
+  for (uint32_t block = m_freeLists[firstLevel * SECOND_LEVEL_COUNT + secondLevel]; block != NO_BLOCK;
+       block = m_blocks[block].nextFree) {
+    if (m_blocks[block].size >= size) {
+      return block;
+    }
+  }
+  return NO_BLOCK;
+}
+
+void RangeAllocator::insertFree(uint32_t block) {
+  uint32_t firstLevel, secondLevel;
+  sizeClass(m_blocks[block].size, firstLevel, secondLevel);
+  uint32_t &head = m_freeLists[firstLevel * SECOND_LEVEL_COUNT + secondLevel];
+
+  m_blocks[block].free = true;
+  m_blocks[block].previousFree = NO_BLOCK;
+  m_blocks[block].nextFree = head;
+  if (head != NO_BLOCK) {
+    m_blocks[head].previousFree = block;
+  }
+  head = block;
+
+  m_firstLevelBitmap |= 1u << firstLevel;
+  m_secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+}
+
+void RangeAllocator::removeFree(uint32_t block) {
+  uint32_t firstLevel, secondLevel;
+  sizeClass(m_blocks[block].size, firstLevel, secondLevel);
+  uint32_t &head = m_freeLists[firstLevel * SECOND_LEVEL_COUNT + secondLevel];
+
+  Block &removed = m_blocks[block];
+  if (removed.previousFree != NO_BLOCK) {
+    m_blocks[removed.previousFree].nextFree = removed.nextFree;
+  } else {
+    head = removed.nextFree;
+  }
+  if (removed.nextFree != NO_BLOCK) {
+    m_blocks[removed.nextFree].previousFree = removed.previousFree;
+  }
+  removed.free = false;
+
+  if (head == NO_BLOCK) {
+    m_secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+    if (m_secondLevelBitmaps[firstLevel] == 0) {
+      m_firstLevelBitmap &= ~(1u << firstLevel);
+    }
+  }
+}
+
+uint32_t RangeAllocator::newBlock(uint32_t offset, uint32_t size) {
+  Block block{offset, size, NO_BLOCK, NO_BLOCK, NO_BLOCK, NO_BLOCK, false};
+  if (!m_unusedBlocks.empty()) {
+    uint32_t index = m_unusedBlocks.back();
+    m_unusedBlocks.pop_back();
+    m_blocks[index] = block;
+    return index;
+  }
+  m_blocks.push_back(block);
+  return static_cast<uint32_t>(m_blocks.size() - 1);
+}
+
+void RangeAllocator::mergeIntoPrevious(uint32_t block) {
+  uint32_t previous = m_blocks[block].previous;
+  uint32_t next = m_blocks[block].next;
+  m_blocks[previous].size += m_blocks[block].size;
+  m_blocks[previous].next = next;
+  if (next != NO_BLOCK) {
+    m_blocks[next].previous = previous;
+  } else {
+    m_lastBlock = previous;
+  }
+  m_unusedBlocks.push_back(block);
+}
+
+uint32_t RangeAllocator::allocate(uint32_t size) {
+  if (size == 0) {
+    return INVALID_OFFSET;
+  }
+  uint32_t block = findFree(size);
+  if (block == NO_BLOCK) {
+    return INVALID_OFFSET;
+  }
+  return allocateFrom(block, size);
+}
+
+uint32_t RangeAllocator::allocateBelow(uint32_t size, uint32_t limit) {
+  if (size == 0 || size > limit) {
+    return INVALID_OFFSET;
+  }
+  // only the lists of the size's own class and the ones above can have a
+  // block that fits, the lowest one of them wins
+  uint32_t firstLevel, secondLevel;
+  sizeClass(size, firstLevel, secondLevel);
+  uint32_t lowest = NO_BLOCK;
+  for (uint32_t list = firstLevel * SECOND_LEVEL_COUNT + secondLevel; list < m_freeLists.size(); list++) {
+    for (uint32_t block = m_freeLists[list]; block != NO_BLOCK; block = m_blocks[block].nextFree) {
+      const Block &candidate = m_blocks[block];
+      if (candidate.size >= size && candidate.offset <= limit - size &&
+          (lowest == NO_BLOCK || candidate.offset < m_blocks[lowest].offset)) {
+        lowest = block;
+      }
+    }
+  }
+  if (lowest == NO_BLOCK) {
+    return INVALID_OFFSET;
+  }
+  return allocateFrom(lowest, size);
+}
+
+uint32_t RangeAllocator::allocateFrom(uint32_t block, uint32_t size) {
+  removeFree(block);
+
+  // whatever is left over stays free, right after the new range
+  if (m_blocks[block].size > size) {
+    uint32_t rest = newBlock(m_blocks[block].offset + size, m_blocks[block].size - size);
+    uint32_t next = m_blocks[block].next;
+    m_blocks[rest].previous = block;
+    m_blocks[rest].next = next;
+    if (next != NO_BLOCK) {
+      m_blocks[next].previous = rest;
+    } else {
+      m_lastBlock = rest;
+    }
+    m_blocks[block].next = rest;
+    m_blocks[block].size = size;
+    insertFree(rest);
+  }
+
+  m_allocations[m_blocks[block].offset] = block;
+  m_used += size;
+  return m_blocks[block].offset;
+}
+
+void RangeAllocator::free(uint32_t offset) {
+  auto found = m_allocations.find(offset);
+  assert(found != m_allocations.end() && "Freed a range that wasn't allocated");
+  uint32_t block = found->second;
+  m_allocations.erase(found);
+  m_used -= m_blocks[block].size;
+
+  uint32_t next = m_blocks[block].next;
+  if (next != NO_BLOCK && m_blocks[next].free) {
+    removeFree(next);
+    mergeIntoPrevious(next);
+  }
+  uint32_t previous = m_blocks[block].previous;
+  if (previous != NO_BLOCK && m_blocks[previous].free) {
+    removeFree(previous);
+    mergeIntoPrevious(block);
+    block = previous;
+  }
+  insertFree(block);
+}
+
+void RangeAllocator::grow(uint32_t capacity) {
+  if (capacity <= m_capacity) {
+    return;
+  }
+  uint32_t extra = capacity - m_capacity;
+
+  if (m_lastBlock != NO_BLOCK && m_blocks[m_lastBlock].free) {
+    removeFree(m_lastBlock);
+    m_blocks[m_lastBlock].size += extra;
+    insertFree(m_lastBlock);
+  } else {
+    uint32_t block = newBlock(m_capacity, extra);
+    m_blocks[block].previous = m_lastBlock;
+    if (m_lastBlock != NO_BLOCK) {
+      m_blocks[m_lastBlock].next = block;
+    }
+    m_lastBlock = block;
+    insertFree(block);
+  }
+  m_capacity = capacity;
+}
+
+RangeAllocator::Stats RangeAllocator::stats() const {
+  Stats stats{};
+  stats.capacity = m_capacity;
+  stats.used = m_used;
+  stats.allocations = static_cast<uint32_t>(m_allocations.size());
+
+  uint32_t freeSize = 0;
+  for (uint32_t block = m_lastBlock; block != NO_BLOCK; block = m_blocks[block].previous) {
+    if (m_blocks[block].free) {
+      stats.freeRanges++;
+      stats.largestFreeRange = std::max(stats.largestFreeRange, m_blocks[block].size);
+      freeSize += m_blocks[block].size;
+    }
+  }
+  uint32_t tail = m_lastBlock != NO_BLOCK && m_blocks[m_lastBlock].free ? m_blocks[m_lastBlock].size : 0;
+  stats.holes = freeSize - tail;
+  return stats;
+}
+
+} // namespace ve
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace ve {
+
+// hands out ranges of [0, capacity), in whatever unit the caller counts in.
+// a two level segregated fit (TLSF) allocator: free ranges are kept in lists
+// by size class, with bitmaps of the lists that aren't empty, so allocating
+// and freeing take constant time however fragmented it gets. freed ranges
+// merge with free neighbours right away
+class RangeAllocator {
+public:
+  static constexpr uint32_t INVALID_OFFSET = std::numeric_limits<uint32_t>::max();
+
+  explicit RangeAllocator(uint32_t capacity = 0);
+
+  // the offset of a new range of `size`, or INVALID_OFFSET if no free range is big enough
+  uint32_t allocate(uint32_t size);
+  // the lowest offset a range of `size` that ends at or before `limit` fits
+  // at, or INVALID_OFFSET. goes through every free range, for compaction
+  // rather than every allocation
+  uint32_t allocateBelow(uint32_t size, uint32_t limit);
+  // `offset` has to be one `allocate()` returned
+  void free(uint32_t offset);
+  // adds [capacity(), `capacity`) as free space
+  void grow(uint32_t capacity);
+
+  uint32_t sizeOf(uint32_t offset) const { return m_blocks[m_allocations.at(offset)].size; }
+  uint32_t capacity() const { return m_capacity; }
+  uint32_t used() const { return m_used; }
+
+  struct Stats {
+    uint32_t capacity{0};
+    uint32_t used{0};
+    uint32_t allocations{0};
+    uint32_t freeRanges{0};
+    uint32_t largestFreeRange{0};
+    // free space that isn't at the end, only moving ranges gets it back in one piece
+    uint32_t holes{0};
+  };
+  Stats stats() const;
+
+private:
+  static constexpr uint32_t NO_BLOCK = std::numeric_limits<uint32_t>::max();
+  // every power of two size range is split into this many lists
+  static constexpr uint32_t SECOND_LEVEL_BITS = 4;
+  static constexpr uint32_t SECOND_LEVEL_COUNT = 1 << SECOND_LEVEL_BITS;
+  static constexpr uint32_t FIRST_LEVEL_COUNT = 32 - SECOND_LEVEL_BITS + 1;
+
+  struct Block {
+    uint32_t offset;
+    uint32_t size;
+    // neighbours in address order
+    uint32_t previous;
+    uint32_t next;
+    // neighbours in the free list, if it's free
+    uint32_t previousFree;
+    uint32_t nextFree;
+    bool free;
+  };
+
+  static void sizeClass(uint32_t size, uint32_t &firstLevel, uint32_t &secondLevel);
+  uint32_t findFree(uint32_t size) const;
+  void insertFree(uint32_t block);
+  void removeFree(uint32_t block);
+  uint32_t newBlock(uint32_t offset, uint32_t size);
+  // allocates the first `size` of the free `block`, the rest stays free
+  uint32_t allocateFrom(uint32_t block, uint32_t size);
+  // merges `block` into the block before it, which has to be free too
+  void mergeIntoPrevious(uint32_t block);
+
+  std::vector<Block> m_blocks;
+  std::vector<uint32_t> m_unusedBlocks;
+  uint32_t m_lastBlock{NO_BLOCK};
+  uint32_t m_capacity{0};
+
+  uint32_t m_firstLevelBitmap{0};
+  std::array<uint32_t, FIRST_LEVEL_COUNT> m_secondLevelBitmaps{};
+  std::array<uint32_t, FIRST_LEVEL_COUNT * SECOND_LEVEL_COUNT> m_freeLists{};
+
+  // offset of every allocated range to its block
+  std::unordered_map<uint32_t, uint32_t> m_allocations;
+  uint32_t m_used{0};
+};
+
+} // namespace ve
@@ -24,6 +24,7 @@ void Renderer::recreateSwapchain()
   }
 
   vkDeviceWaitIdle(m_device.device());
+  m_hasPreviousFrame = false;
 
   if (m_swapchain == nullptr) {
     m_swapchain = std::make_unique<Swapchain>(m_device, extent);
@@ -90,6 +91,8 @@ void Renderer::endFrame()
     throw std::runtime_error("failed to record command buffer");
   }
   auto result = m_swapchain->submitCommandBuffers(&cmd, &m_currentImageIndex);
+  m_previousImageIndex = m_currentImageIndex;
+  m_hasPreviousFrame = true;
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_window.wasWindowResized()) {
     m_window.resetWindowResizedFlag();
     recreateSwapchain();
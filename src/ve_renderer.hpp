@@ -34,6 +34,15 @@ class Renderer {
     return m_currentFrameIndex;
   }
 
+  VkExtent2D getSwapchainExtent() const { return m_swapchain->getSwapchainExtent(); }
+
+  // the depth buffer the last frame rendered into, or VK_NULL_HANDLE if
+  // nothing has been rendered since the swapchain was (re)created
+  VkImageView getPreviousDepthImageView() const
+  {
+    return m_hasPreviousFrame ? m_swapchain->getDepthImageView(m_previousImageIndex) : VK_NULL_HANDLE;
+  }
+
   VkCommandBuffer beginFrame();
   void endFrame();
 
@@ -51,6 +60,8 @@ class Renderer {
   std::vector<VkCommandBuffer> m_commandBuffers;
 
   uint32_t m_currentImageIndex;
+  uint32_t m_previousImageIndex { 0 };
+  bool m_hasPreviousFrame = false;
   int m_currentFrameIndex { 0 };
   bool m_isFrameStarted = false;
 };
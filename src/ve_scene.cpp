@@ -1,6 +1,12 @@
 #include "ve_scene.hpp"
 
+#include "ve_radix_sort.hpp"
+
 #include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 
 namespace ve {
@@ -8,81 +14,748 @@ namespace ve {
 Scene::Scene(MeshLoader &modelLoader)
     : m_modelLoader{modelLoader} {}
 
-void Scene::addGameObject(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, std::string modelPath) {
-  GameObject object = GameObject::createGameObject();
+ObjectHandle Scene::addGameObject(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, std::string modelPath) {
+  ObjectHandle handle = m_objects.create(Mesh{}, position, rotation, scale);
+  m_pendingObjects.push_back(m_objects.indexOf(handle));
+  m_streamingObjects.push_back({handle, m_modelLoader.requestglTF(modelPath)});
+  return handle;
+}
+
+std::vector<ObjectHandle> Scene::addGameObjects(const std::vector<ModelInstance> &instances) {
+  std::vector<std::string> modelPaths;
+  modelPaths.reserve(instances.size());
+  for (const ModelInstance &instance : instances) {
+    modelPaths.push_back(instance.modelPath);
+  }
+  std::vector<std::shared_future<Mesh>> meshes = m_modelLoader.requestglTFs(modelPaths);
 
-  Mesh model = m_modelLoader.loadFromglTF(modelPath);
-  object.mesh = model;
+  std::vector<ObjectHandle> handles;
+  handles.reserve(instances.size());
+  for (size_t i = 0; i < instances.size(); i++) {
+    const ModelInstance &instance = instances[i];
+    ObjectHandle handle = m_objects.create(Mesh{}, instance.position, instance.rotation, instance.scale);
+    m_pendingObjects.push_back(m_objects.indexOf(handle));
+    m_streamingObjects.push_back({handle, meshes[i]});
+    handles.push_back(handle);
+  }
+  return handles;
+}
 
-  object.transform.translation = position;
-  object.transform.rotation = rotation;
-  object.transform.scale = scale;
+ObjectHandle Scene::addGameObject(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale) {
+  ObjectHandle handle = m_objects.create(Mesh{}, position, rotation, scale);
+  m_pendingObjects.push_back(m_objects.indexOf(handle));
+  return handle;
+}
 
-  m_gameObjects.push_back(object);
+void Scene::setMesh(ObjectHandle object, Mesh mesh) {
+  m_objects.setMesh(object, mesh);
+  m_pendingObjects.push_back(m_objects.indexOf(object));
 }
 
-void Scene::addGameObject(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale) {
-  GameObject object = GameObject::createGameObject();
+void Scene::removeGameObject(ObjectHandle handle) {
+  uint32_t object = m_objects.indexOf(handle);
+  uint32_t last = static_cast<uint32_t>(m_objects.size()) - 1;
 
-  object.transform.translation = position;
-  object.transform.rotation = rotation;
-  object.transform.scale = scale;
+  if (object < m_objectGroups.size() && m_objectGroups[object] != NO_GROUP) {
+    removeFromGroup(object);
+  }
+  if (m_bvh.contains(object)) {
+    m_bvh.remove(object);
+  }
 
-  m_gameObjects.push_back(object);
+  m_objects.destroy(handle);
+  if (object != last) {
+    renameObject(last, object);
+  }
+  if (m_objectGroups.size() > last) {
+    m_objectGroups.resize(last);
+    m_objectGroupSlots.resize(last);
+  }
+}
+
+void Scene::renameObject(uint32_t from, uint32_t to) {
+  uint32_t group = from < m_objectGroups.size() ? m_objectGroups[from] : NO_GROUP;
+  if (to >= m_objectGroups.size()) {
+    m_objectGroups.resize(to + 1, NO_GROUP);
+    m_objectGroupSlots.resize(to + 1, 0);
+  }
+  m_objectGroups[to] = group;
+
+  // the object keeps its slot, only what the slot points at changes
+  if (group != NO_GROUP) {
+    uint32_t slot = m_objectGroupSlots[from];
+    m_objectGroupSlots[to] = slot;
+    m_objectGroups[from] = NO_GROUP;
+    m_meshGroups[group].objects[slot] = to;
+    for (uint32_t dc : m_meshGroups[group].drawCalls) {
+      uint32_t instance = m_drawCalls[dc].firstInstance + slot;
+      m_instances[instance] = to;
+      touchInstance(dc, instance);
+    }
+  }
+
+  if (m_bvh.contains(from)) {
+    m_bvh.rename(from, to);
+  }
+
+  // if it was still waiting for `prepare()`, it now does so under its new index
+  m_pendingObjects.push_back(to);
 }
 
 void Scene::addLight(PointLight light) { m_lights.push_back(light); }
 
-void Scene::prepare() {
+namespace {
+
+// layout of a draw key, from the most to the least significant bits:
+//   pipeline (8) | material (16) | primitive (24) | depth bucket (16)
+// everything above the depth bucket identifies a batch, so sorting the keys
+// puts every instance of a batch next to each other
+constexpr uint32_t DEPTH_BITS = 16;
+constexpr uint32_t PRIMITIVE_BITS = 24;
+constexpr uint32_t MATERIAL_BITS = 16;
+constexpr uint32_t PIPELINE_BITS = 8;
+
+constexpr uint32_t PRIMITIVE_SHIFT = DEPTH_BITS;
+constexpr uint32_t MATERIAL_SHIFT = PRIMITIVE_SHIFT + PRIMITIVE_BITS;
+constexpr uint32_t PIPELINE_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+static_assert(PIPELINE_SHIFT + PIPELINE_BITS == 64, "Draw key fields have to add up to 64 bits");
+
+uint64_t makeDrawKey(uint32_t pipeline, uint32_t material, uint32_t primitive, uint16_t depth) {
+  assert(pipeline < (1u << PIPELINE_BITS) && material < (1u << MATERIAL_BITS) && primitive < (1u << PRIMITIVE_BITS));
+  return (static_cast<uint64_t>(pipeline) << PIPELINE_SHIFT) | (static_cast<uint64_t>(material) << MATERIAL_SHIFT) |
+         (static_cast<uint64_t>(primitive) << PRIMITIVE_SHIFT) | depth;
+}
+
+uint32_t drawKeyPrimitive(uint64_t key) {
+  return static_cast<uint32_t>(key >> PRIMITIVE_SHIFT) & ((1u << PRIMITIVE_BITS) - 1);
+}
+
+// the bit pattern of a positive float grows with its value, so the top
+// half of the squared distance makes a logarithmically spaced bucket
+uint16_t depthBucket(float squaredDistance) {
+  uint32_t bits;
+  std::memcpy(&bits, &squaredDistance, sizeof(bits));
+  return static_cast<uint16_t>(bits >> 16);
+}
+
+} // namespace
+
+void Scene::prepare(glm::vec3 viewPosition) {
   // std::cout << "Scene::prepare()" << std::endl;
-  if (m_gameObjects.size() == 0) {
-    return;
+  m_lastPrepareStats = {};
+
+  // objects removed while their mesh was loading just drop it
+  for (size_t i = 0; i < m_streamingObjects.size();) {
+    StreamingObject &streaming = m_streamingObjects[i];
+    if (streaming.mesh.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      i++;
+      continue;
+    }
+    try {
+      Mesh mesh = streaming.mesh.get();
+      if (m_objects.contains(streaming.object)) {
+        setMesh(streaming.object, mesh);
+      }
+    } catch (const std::exception &e) {
+      std::cout << "Scene: couldn't load a mesh: " << e.what() << std::endl;
+    }
+    streaming = m_streamingObjects.back();
+    m_streamingObjects.pop_back();
+  }
+
+  // once more than half of the instance array is holes left behind by
+  // batches that had to move, repacking everything is cheaper than carrying them
+  bool fragmented = m_instances.size() > 2 * static_cast<size_t>(m_liveInstanceCount) + 64;
+
+  if (m_fullRebuildRequested || fragmented) {
+    rebuild(viewPosition);
+  } else {
+    uint32_t touchedBefore = static_cast<uint32_t>(m_touchedDrawCalls.size());
+    for (uint32_t object : m_pendingObjects) {
+      // objects removed after being added or changed leave their old index behind
+      if (object < m_objects.size()) {
+        updateObject(object);
+      }
+    }
+    m_lastPrepareStats.batchesTouched = static_cast<uint32_t>(m_touchedDrawCalls.size()) - touchedBefore;
+  }
+
+  // the mesh loader moves geometry around to fill the holes unloaded meshes
+  // leave, draw calls of the primitives it moved still point at the old place
+  const std::vector<uint32_t> &movedPrimitives = m_modelLoader.movedPrimitives();
+  if (!movedPrimitives.empty()) {
+    std::vector<uint8_t> moved(m_modelLoader.primitives.size(), 0);
+    for (uint32_t primitive : movedPrimitives) {
+      moved[primitive] = 1;
+    }
+    for (uint32_t dc = 0; dc < static_cast<uint32_t>(m_drawCalls.size()); dc++) {
+      if (!moved[m_drawPrimitives[dc]]) {
+        continue;
+      }
+      const Mesh::Primitive &primitive = m_modelLoader.getPrimitive(m_drawPrimitives[dc]);
+      m_drawCalls[dc].indexCount = primitive.indexCount;
+      m_drawCalls[dc].firstIndex = primitive.firstIndex;
+      m_drawCalls[dc].vertexOffset = primitive.vertexOffset;
+      touchDrawCall(dc);
+    }
+    m_modelLoader.clearMovedPrimitives();
+  }
+
+  groupDrawCalls();
+
+  m_remeshedObjects.insert(m_remeshedObjects.end(), m_pendingObjects.begin(), m_pendingObjects.end());
+  m_pendingObjects.clear();
+  m_lastPrepareStats.batchesTotal = static_cast<uint32_t>(m_drawCalls.size());
+}
+
+void Scene::groupDrawCalls() {
+  // counting sort by index buffer, unloading a mesh moves its primitives to
+  // another one so this can't just be kept up as draw calls are added
+  m_indexBufferDrawCallCounts.assign(Mesh::INDEX_BUFFER_COUNT, 0);
+  for (uint32_t primitive : m_drawPrimitives) {
+    m_indexBufferDrawCallCounts[m_modelLoader.getPrimitive(primitive).indexBuffer()]++;
+  }
+
+  std::array<uint32_t, Mesh::INDEX_BUFFER_COUNT> offsets;
+  uint32_t offset = 0;
+  for (uint32_t indexBuffer = 0; indexBuffer < Mesh::INDEX_BUFFER_COUNT; indexBuffer++) {
+    offsets[indexBuffer] = offset;
+    offset += m_indexBufferDrawCallCounts[indexBuffer];
+  }
+  m_indexBufferDrawCalls.resize(m_drawCalls.size());
+  for (uint32_t dc = 0; dc < static_cast<uint32_t>(m_drawCalls.size()); dc++) {
+    m_indexBufferDrawCalls[offsets[m_modelLoader.getPrimitive(m_drawPrimitives[dc]).indexBuffer()]++] = dc;
   }
+}
 
+void Scene::rebuild(glm::vec3 viewPosition) {
   m_drawCalls.clear();
+  m_drawPrimitives.clear();
+  m_drawCallCapacities.clear();
+  m_instances.clear();
+  m_liveInstanceCount = 0;
+  m_meshGroups.clear();
+  m_meshGroupLookup.clear();
+  m_sortKeys.clear();
+  m_sortValues.clear();
+
+  const std::vector<Mesh> &meshes = m_objects.meshes();
+  const std::vector<glm::vec3> &translations = m_objects.translations();
+
+  m_objectGroups.assign(meshes.size(), NO_GROUP);
+  m_objectGroupSlots.assign(meshes.size(), 0);
+
+  for (uint32_t i = 0; i < static_cast<uint32_t>(meshes.size()); i++) {
+    glm::vec3 toObject = translations[i] - viewPosition;
+    uint16_t depth = depthBucket(glm::dot(toObject, toObject));
+
+    for (uint32_t j = 0; j < meshes[i].primitiveCount; j++) {
+      uint32_t primitive = meshes[i].firstPrimitive + j;
+      uint32_t material = static_cast<uint32_t>(std::max(m_modelLoader.getPrimitive(primitive).material, 0));
+
+      // there's only one pipeline for now
+      m_sortKeys.push_back(makeDrawKey(0, material, primitive, depth));
+      m_sortValues.push_back(i);
+    }
+  }
+
+  radixSort(m_sortKeys, m_sortValues, m_sortKeysScratch, m_sortValuesScratch);
+
+  // every run of keys that only differ in depth becomes one draw call
+  std::unordered_map<uint32_t, uint32_t> primitiveDrawCalls;
+  size_t i = 0;
+  while (i < m_sortKeys.size()) {
+    uint64_t batch = m_sortKeys[i] >> DEPTH_BITS;
+
+    size_t end = i + 1;
+    while (end < m_sortKeys.size() && (m_sortKeys[end] >> DEPTH_BITS) == batch) {
+      end++;
+    }
+
+    uint32_t instanceCount = static_cast<uint32_t>(end - i);
+    uint32_t capacity = (instanceCount + INSTANCE_ALIGNMENT - 1) / INSTANCE_ALIGNMENT * INSTANCE_ALIGNMENT;
+    uint32_t firstInstance = static_cast<uint32_t>(m_instances.size());
+    m_instances.insert(m_instances.end(), m_sortValues.begin() + i, m_sortValues.begin() + end);
+    m_instances.resize(firstInstance + capacity);
+    m_liveInstanceCount += instanceCount;
+
+    uint32_t primitive = drawKeyPrimitive(m_sortKeys[i]);
+    const Mesh::Primitive &currentPrimitive = m_modelLoader.getPrimitive(primitive);
+    DrawCall dc = {
+        currentPrimitive.indexCount,
+        instanceCount,
+        currentPrimitive.firstIndex,
+        currentPrimitive.vertexOffset,
+        firstInstance};
+    primitiveDrawCalls[primitive] = static_cast<uint32_t>(m_drawCalls.size());
+    m_drawCalls.push_back(dc);
+    m_drawPrimitives.push_back(primitive);
+    m_drawCallCapacities.push_back(capacity);
+
+    i = end;
+  }
+
+  // objects of one mesh share their depth, so they come out of the sort in
+  // the same order for each of the mesh's primitives and can share a group
+  for (uint32_t object = 0; object < static_cast<uint32_t>(meshes.size()); object++) {
+    const Mesh &mesh = meshes[object];
+    if (mesh.primitiveCount == 0 || m_meshGroupLookup.count(mesh.firstPrimitive) != 0) {
+      continue;
+    }
+
+    MeshGroup group{mesh};
+    for (uint32_t j = 0; j < mesh.primitiveCount; j++) {
+      group.drawCalls.push_back(primitiveDrawCalls[mesh.firstPrimitive + j]);
+    }
+
+    const DrawCall &first = m_drawCalls[group.drawCalls[0]];
+    group.objects.assign(
+        m_instances.begin() + first.firstInstance,
+        m_instances.begin() + first.firstInstance + first.instanceCount);
+
+    uint32_t groupIndex = static_cast<uint32_t>(m_meshGroups.size());
+    for (uint32_t slot = 0; slot < static_cast<uint32_t>(group.objects.size()); slot++) {
+      m_objectGroups[group.objects[slot]] = groupIndex;
+      m_objectGroupSlots[group.objects[slot]] = slot;
+    }
+
+    m_meshGroupLookup[mesh.firstPrimitive] = groupIndex;
+    m_meshGroups.push_back(std::move(group));
+  }
+
+  m_drawCallTouched.assign(m_drawCalls.size(), 0);
+  m_touchedDrawCalls.clear();
+  m_instanceEntries.assign(m_instances.size(), NOT_TOUCHED);
+  m_touchedInstances.clear();
+  for (uint32_t dc = 0; dc < static_cast<uint32_t>(m_drawCalls.size()); dc++) {
+    touchDrawCall(dc);
+    for (uint32_t slot = 0; slot < m_drawCalls[dc].instanceCount; slot++) {
+      touchInstance(dc, m_drawCalls[dc].firstInstance + slot);
+    }
+  }
+
+  m_fullRebuildRequested = false;
+  m_lastPrepareStats.fullRebuild = true;
+  m_lastPrepareStats.batchesTouched = static_cast<uint32_t>(m_drawCalls.size());
+  m_lastPrepareStats.instancesWritten = m_liveInstanceCount;
+}
+
+void Scene::updateObject(uint32_t object) {
+  if (object >= m_objectGroups.size()) {
+    m_objectGroups.resize(object + 1, NO_GROUP);
+    m_objectGroupSlots.resize(object + 1, 0);
+  }
+
+  const Mesh &mesh = m_objects.meshes()[object];
+  uint32_t group = m_objectGroups[object];
+
+  if (group != NO_GROUP && m_meshGroups[group].mesh == mesh) {
+    return;
+  }
+  if (group != NO_GROUP) {
+    removeFromGroup(object);
+  }
+  if (mesh.primitiveCount > 0) {
+    addToGroup(object, mesh);
+  }
+}
+
+uint32_t Scene::findOrCreateGroup(const Mesh &mesh) {
+  auto it = m_meshGroupLookup.find(mesh.firstPrimitive);
+  if (it != m_meshGroupLookup.end()) {
+    return it->second;
+  }
+
+  MeshGroup group{mesh};
+  for (uint32_t j = 0; j < mesh.primitiveCount; j++) {
+    uint32_t primitive = mesh.firstPrimitive + j;
+    const Mesh::Primitive &currentPrimitive = m_modelLoader.getPrimitive(primitive);
+    DrawCall dc = {
+        currentPrimitive.indexCount,
+        0,
+        currentPrimitive.firstIndex,
+        currentPrimitive.vertexOffset,
+        static_cast<uint32_t>(m_instances.size())};
+
+    group.drawCalls.push_back(static_cast<uint32_t>(m_drawCalls.size()));
+    m_drawCalls.push_back(dc);
+    m_drawPrimitives.push_back(primitive);
+    m_drawCallCapacities.push_back(0);
+    m_drawCallTouched.push_back(0);
+  }
+
+  uint32_t groupIndex = static_cast<uint32_t>(m_meshGroups.size());
+  m_meshGroupLookup[mesh.firstPrimitive] = groupIndex;
+  m_meshGroups.push_back(std::move(group));
+  return groupIndex;
+}
+
+void Scene::addToGroup(uint32_t object, const Mesh &mesh) {
+  uint32_t groupIndex = findOrCreateGroup(mesh);
+  MeshGroup &group = m_meshGroups[groupIndex];
+
+  uint32_t slot = static_cast<uint32_t>(group.objects.size());
+  group.objects.push_back(object);
+  m_objectGroups[object] = groupIndex;
+  m_objectGroupSlots[object] = slot;
+
+  for (uint32_t dc : group.drawCalls) {
+    reserveInstances(dc, slot + 1);
+    uint32_t instance = m_drawCalls[dc].firstInstance + slot;
+    m_instances[instance] = object;
+    m_drawCalls[dc].instanceCount = slot + 1;
+    m_liveInstanceCount++;
+    m_lastPrepareStats.instancesWritten++;
+    touchDrawCall(dc);
+    touchInstance(dc, instance);
+  }
+}
+
+void Scene::removeFromGroup(uint32_t object) {
+  MeshGroup &group = m_meshGroups[m_objectGroups[object]];
+
+  // swap the last object of the group into the freed slot
+  uint32_t slot = m_objectGroupSlots[object];
+  uint32_t last = static_cast<uint32_t>(group.objects.size()) - 1;
+  uint32_t moved = group.objects[last];
+  group.objects[slot] = moved;
+  group.objects.pop_back();
+  m_objectGroupSlots[moved] = slot;
+  m_objectGroups[object] = NO_GROUP;
+
+  for (uint32_t dc : group.drawCalls) {
+    uint32_t first = m_drawCalls[dc].firstInstance;
+    m_instances[first + slot] = m_instances[first + last];
+    m_drawCalls[dc].instanceCount = last;
+    m_liveInstanceCount--;
+    m_lastPrepareStats.instancesWritten++;
+    touchDrawCall(dc);
+    if (slot != last) {
+      touchInstance(dc, first + slot);
+    }
+  }
+}
+
+void Scene::reserveInstances(uint32_t drawCall, uint32_t count) {
+  uint32_t capacity = m_drawCallCapacities[drawCall];
+  if (count <= capacity) {
+    return;
+  }
+
+  // move the batch to the end of the instance array, leaving a hole behind
+  uint32_t newCapacity = std::max(count, std::max(capacity * 2, INSTANCE_ALIGNMENT));
+  newCapacity = (newCapacity + INSTANCE_ALIGNMENT - 1) / INSTANCE_ALIGNMENT * INSTANCE_ALIGNMENT;
+
+  DrawCall &dc = m_drawCalls[drawCall];
+  uint32_t newFirst = static_cast<uint32_t>(m_instances.size());
+  m_instances.resize(newFirst + newCapacity);
+  std::copy(
+      m_instances.begin() + dc.firstInstance,
+      m_instances.begin() + dc.firstInstance + dc.instanceCount,
+      m_instances.begin() + newFirst);
+
+  dc.firstInstance = newFirst;
+  m_drawCallCapacities[drawCall] = newCapacity;
+  for (uint32_t instance = newFirst; instance < newFirst + dc.instanceCount; instance++) {
+    touchInstance(drawCall, instance);
+  }
+}
+
+void Scene::touchDrawCall(uint32_t drawCall) {
+  if (!m_drawCallTouched[drawCall]) {
+    m_drawCallTouched[drawCall] = 1;
+    m_touchedDrawCalls.push_back(drawCall);
+  }
+}
+
+void Scene::touchInstance(uint32_t drawCall, uint32_t instance) {
+  if (m_instanceEntries.size() < m_instances.size()) {
+    m_instanceEntries.resize(m_instances.size(), NOT_TOUCHED);
+  }
+  // a draw call that moved may have left the slot to another one since it was touched
+  if (m_instanceEntries[instance] != NOT_TOUCHED) {
+    m_touchedInstances[m_instanceEntries[instance]].drawCall = drawCall;
+    return;
+  }
+  m_instanceEntries[instance] = static_cast<uint32_t>(m_touchedInstances.size());
+  m_touchedInstances.push_back({drawCall, instance});
+}
 
-  std::sort(m_gameObjects.begin(), m_gameObjects.end(), [](const GameObject &lhs, const GameObject &rhs) {
-    if (lhs.mesh.primitiveCount < rhs.mesh.primitiveCount) {
-      return true;
+void Scene::clearTouched() {
+  for (uint32_t dc : m_touchedDrawCalls) {
+    m_drawCallTouched[dc] = 0;
+  }
+  m_touchedDrawCalls.clear();
+  for (const InstanceRef &ref : m_touchedInstances) {
+    m_instanceEntries[ref.instance] = NOT_TOUCHED;
+  }
+  m_touchedInstances.clear();
+}
+
+void Scene::updateBounds(const std::vector<uint32_t> &movedObjects, ThreadPool &threadPool) {
+  auto start = std::chrono::high_resolution_clock::now();
+  m_lastCullStats = {};
+
+  size_t slotCount = m_instances.size();
+  if (m_instanceBounds.size() < slotCount) {
+    m_instanceBounds.resize(slotCount);
+  }
+
+  // touched instances may hold a different object than before, or be in a batch that moved
+  threadPool.parallelFor(m_touchedInstances.size(), BOUNDS_GRAIN_SIZE, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const InstanceRef &ref = m_touchedInstances[i];
+      const DrawCall &dc = m_drawCalls[ref.drawCall];
+      // slots a draw call let go of may still name objects that are gone
+      if (ref.instance >= dc.firstInstance && ref.instance - dc.firstInstance < dc.instanceCount) {
+        updateInstanceBounds(ref.drawCall, ref.instance);
+      }
     }
-    if (lhs.mesh.firstPrimitive < rhs.mesh.firstPrimitive) {
-      return true;
+  });
+
+  threadPool.parallelFor(movedObjects.size(), BOUNDS_GRAIN_SIZE, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      uint32_t object = movedObjects[i];
+      if (object >= m_objectGroups.size() || m_objectGroups[object] == NO_GROUP) {
+        continue;
+      }
+      for (uint32_t dc : m_meshGroups[m_objectGroups[object]].drawCalls) {
+        updateInstanceBounds(dc, m_drawCalls[dc].firstInstance + m_objectGroupSlots[object]);
+      }
     }
-    return false;
   });
 
-  uint32_t firstInstance = 0;
-  uint32_t instanceCount = 0;
-  size_t i = 0;
-  Mesh currentMesh = m_gameObjects[0].mesh;
+  updateBvh(movedObjects, threadPool);
 
-  while (i < m_gameObjects.size()) {
-    while (m_gameObjects[i].mesh == currentMesh) {
-      i++;
-      instanceCount++;
+  auto finish = std::chrono::high_resolution_clock::now();
+  m_lastCullStats.milliseconds =
+      std::chrono::duration<float, std::chrono::milliseconds::period>(finish - start).count();
+}
+
+void Scene::cull(const Frustum &frustum, glm::vec3 viewPosition, float lodScale) {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  m_visibleObjects.clear();
+  m_lastCullStats.nodesVisited = m_bvh.cull(frustum, m_visibleObjects);
+
+  // collect the instance slots of every visible object, primitives of
+  // meshes with more than one get tested against the frustum on their own
+  m_visibleSlots.clear();
+  m_visibleSlotDrawCalls.clear();
+  m_drawCallVisibleOffsets.assign(m_drawCalls.size() * Mesh::MAX_LOD_COUNT, 0);
+  for (uint32_t object : m_visibleObjects) {
+    if (object >= m_objectGroups.size() || m_objectGroups[object] == NO_GROUP) {
+      continue;
+    }
+
+    // lods are measured in object space, the largest axis scale is what
+    // their errors can grow to in world space
+    float objectScale = 0.0f;
+    if (lodScale > 0.0f) {
+      const glm::mat4 &world = m_objects.worldMatrix(object);
+      objectScale = glm::max(
+          glm::length(glm::vec3(world[0])),
+          glm::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+    }
+
+    const MeshGroup &group = m_meshGroups[m_objectGroups[object]];
+    bool testPrimitives = group.drawCalls.size() > 1;
+    for (uint32_t dc : group.drawCalls) {
+      uint32_t slot = m_drawCalls[dc].firstInstance + m_objectGroupSlots[object];
+      glm::vec3 min(m_instanceBounds.minX[slot], m_instanceBounds.minY[slot], m_instanceBounds.minZ[slot]);
+      glm::vec3 max(m_instanceBounds.maxX[slot], m_instanceBounds.maxY[slot], m_instanceBounds.maxZ[slot]);
+      if (testPrimitives && !frustum.intersects(min, max)) {
+        continue;
+      }
+
+      // the distance to the nearest point of the bounding sphere, anything
+      // the camera is inside of gets the full resolution
+      const Mesh::Primitive &primitive = m_modelLoader.getPrimitive(m_drawPrimitives[dc]);
+      uint32_t lod = 0;
+      if (lodScale > 0.0f) {
+        float distance = glm::length((min + max) * 0.5f - viewPosition) - glm::length(max - min) * 0.5f;
+        if (distance > 0.0f) {
+          lod = primitive.selectLod(objectScale * lodScale / distance);
+        }
+      }
+
+      uint32_t key = dc * Mesh::MAX_LOD_COUNT + lod;
+      m_visibleSlots.push_back(slot);
+      m_visibleSlotDrawCalls.push_back(key);
+      m_drawCallVisibleOffsets[key]++;
+    }
+  }
+
+  // counting sort the slots by draw call and lod, with the draw calls in
+  // index buffer order. after scattering each offset points at the end of its range
+  uint32_t offset = 0;
+  for (uint32_t dc : m_indexBufferDrawCalls) {
+    for (uint32_t lod = 0; lod < Mesh::MAX_LOD_COUNT; lod++) {
+      uint32_t &count = m_drawCallVisibleOffsets[dc * Mesh::MAX_LOD_COUNT + lod];
+      offset += count;
+      count = offset - count;
+    }
+  }
+  m_visibleInstances.resize(m_visibleSlots.size());
+  for (size_t i = 0; i < m_visibleSlots.size(); i++) {
+    m_visibleInstances[m_drawCallVisibleOffsets[m_visibleSlotDrawCalls[i]]++] = m_visibleSlots[i];
+  }
+
+  m_visibleDrawCalls.clear();
+  m_visibleIndexBufferDrawCounts.assign(Mesh::INDEX_BUFFER_COUNT, 0);
+  m_lastCullStats.triangles = 0;
+  uint32_t begin = 0;
+  uint32_t grouped = 0;
+  for (uint32_t indexBuffer = 0; indexBuffer < Mesh::INDEX_BUFFER_COUNT; indexBuffer++) {
+    for (uint32_t i = 0; i < m_indexBufferDrawCallCounts[indexBuffer]; i++) {
+      uint32_t dc = m_indexBufferDrawCalls[grouped++];
+      for (uint32_t lodIndex = 0; lodIndex < Mesh::MAX_LOD_COUNT; lodIndex++) {
+        uint32_t end = m_drawCallVisibleOffsets[dc * Mesh::MAX_LOD_COUNT + lodIndex];
+        if (end == begin) {
+          continue;
+        }
+
+        // the bvh hands objects out in no particular order, sorting the slots
+        // restores the draw call's front to back order
+        std::sort(m_visibleInstances.begin() + begin, m_visibleInstances.begin() + end);
+
+        DrawCall visible = m_drawCalls[dc];
+        if (lodIndex != 0) {
+          const Mesh::Lod &lod = m_modelLoader.getPrimitive(m_drawPrimitives[dc]).lods[lodIndex];
+          visible.firstIndex = lod.firstIndex;
+          visible.indexCount = lod.indexCount;
+        }
+        visible.firstInstance = begin;
+        visible.instanceCount = end - begin;
+        m_visibleDrawCalls.push_back(visible);
+        m_visibleIndexBufferDrawCounts[indexBuffer]++;
+        m_lastCullStats.triangles += visible.instanceCount * (visible.indexCount / 3);
+        begin = end;
+      }
+    }
+  }
+
+  auto finish = std::chrono::high_resolution_clock::now();
+  m_lastCullStats.tested = m_liveInstanceCount;
+  m_lastCullStats.visible = static_cast<uint32_t>(m_visibleInstances.size());
+  m_lastCullStats.culled = m_liveInstanceCount - m_lastCullStats.visible;
+  m_lastCullStats.milliseconds +=
+      std::chrono::duration<float, std::chrono::milliseconds::period>(finish - start).count();
+}
+
+void Scene::updateBvh(const std::vector<uint32_t> &movedObjects, ThreadPool &threadPool) {
+  size_t objectCount = m_objects.size();
+
+  // new objects are inserted into the tree one by one. it's only built again
+  // for a bulk load, once it's mostly positions removed objects left empty,
+  // or once refitting and inserting have made it much worse than a fresh one
+  size_t newObjects = 0;
+  for (uint32_t object : movedObjects) {
+    newObjects += !m_bvh.contains(object);
+  }
+  for (uint32_t object : m_remeshedObjects) {
+    newObjects += object < objectCount && !m_bvh.contains(object);
+  }
+  bool rebuild = m_bvh.capacity() > 2 * objectCount + 64 ||
+                 m_bvh.cost() > BVH_REBUILD_RATIO * std::max(m_bvh.buildCost(), 1.0f) ||
+                 newObjects > BVH_BULK_INSERT_RATIO * m_bvh.size() + 64;
+
+  if (!rebuild) {
+    if (m_objectBounds.size() < objectCount) {
+      m_objectBounds.resize(objectCount);
+    }
+    threadPool.parallelFor(movedObjects.size(), BOUNDS_GRAIN_SIZE, 1, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        updateObjectBounds(movedObjects[i]);
+      }
+    });
+    for (uint32_t object : m_remeshedObjects) {
+      if (object < objectCount) {
+        updateObjectBounds(object);
+      }
     }
 
-    for (uint32_t j = 0; j < currentMesh.primitiveCount; j++) {
-      Mesh::Primitive currentPrimitive = m_modelLoader.getPrimitive(currentMesh.firstPrimitive + j);
-      DrawCall dc = {
-          currentPrimitive.indexCount,
-          instanceCount,
-          currentPrimitive.firstIndex,
-          currentPrimitive.vertexOffset,
-          firstInstance};
-      m_drawCalls.push_back(dc);
+    auto place = [&](uint32_t object) {
+      glm::vec3 min(m_objectBounds.minX[object], m_objectBounds.minY[object], m_objectBounds.minZ[object]);
+      glm::vec3 max(m_objectBounds.maxX[object], m_objectBounds.maxY[object], m_objectBounds.maxZ[object]);
+      if (m_bvh.contains(object)) {
+        m_bvh.update(object, min, max);
+      } else {
+        m_bvh.insert(object, min, max);
+      }
+    };
+    for (uint32_t object : movedObjects) {
+      place(object);
+    }
+    for (uint32_t object : m_remeshedObjects) {
+      if (object < objectCount) {
+        place(object);
+      }
     }
+  }
 
-    firstInstance += instanceCount;
-    instanceCount = 0;
-    currentMesh = m_gameObjects[i].mesh;
+  m_remeshedObjects.clear();
+
+  if (rebuild) {
+    m_objectBounds.resize(objectCount);
+    threadPool.parallelFor(objectCount, BOUNDS_GRAIN_SIZE, 1, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        updateObjectBounds(static_cast<uint32_t>(i));
+      }
+    });
+
+    m_bvh.build(m_objectBounds, threadPool);
+    m_lastCullStats.bvhRebuilt = true;
+    return;
   }
+
+  m_bvh.refit();
+}
+
+void Scene::updateObjectBounds(uint32_t object) {
+  const Mesh &mesh = m_objects.meshes()[object];
+
+  glm::vec3 min, max;
+  transformBounds(m_objects.worldMatrix(object), mesh.boundsMin, mesh.boundsMax, min, max);
+  m_objectBounds.set(object, min, max);
+}
+
+void Scene::updateInstanceBounds(uint32_t drawCall, uint32_t instance) {
+  const Mesh::Primitive &primitive = m_modelLoader.getPrimitive(m_drawPrimitives[drawCall]);
+
+  glm::vec3 min, max;
+  transformBounds(m_objects.worldMatrix(m_instances[instance]), primitive.boundsMin, primitive.boundsMax, min, max);
+  m_instanceBounds.set(instance, min, max);
 }
 
 void Scene::draw(VkCommandBuffer cmd) {
-  for (DrawCall &dc : m_drawCalls) {
-    vkCmdDrawIndexed(cmd, dc.indexCount, dc.instanceCount, dc.firstIndex, dc.vertexOffset, dc.firstInstance);
+  // the visible draw calls are sorted by index buffer, each run needs its own buffers bound
+  uint32_t begin = 0;
+  for (uint32_t indexBuffer = 0; indexBuffer < m_visibleIndexBufferDrawCounts.size(); indexBuffer++) {
+    uint32_t end = begin + m_visibleIndexBufferDrawCounts[indexBuffer];
+    if (end > begin) {
+      m_modelLoader.bindBuffers(cmd, indexBuffer);
+    }
+    for (uint32_t i = begin; i < end; i++) {
+      const DrawCall &dc = m_visibleDrawCalls[i];
+      vkCmdDrawIndexed(cmd, dc.indexCount, dc.instanceCount, dc.firstIndex, dc.vertexOffset, dc.firstInstance);
+    }
+    begin = end;
+  }
+}
+
+ObjectHandle Scene::pick(glm::vec3 origin, glm::vec3 direction, float maxDistance) {
+  float distance;
+  uint32_t object = m_bvh.raycast(origin, direction, maxDistance, distance);
+  return object == Bvh::NONE ? ObjectHandle{} : m_objects.handleAt(object);
+}
+
+void Scene::queryRadius(glm::vec3 center, float radius, std::vector<ObjectHandle> &objects) {
+  std::vector<uint32_t> found;
+  m_bvh.queryRadius(center, radius, found);
+  for (uint32_t object : found) {
+    objects.push_back(m_objects.handleAt(object));
   }
 }
 
-} // namespace ve
\ No newline at end of file
+} // namespace ve
@@ -1,14 +1,22 @@
 #pragma once
 
+#include "ve_bvh.hpp"
+#include "ve_frustum.hpp"
 #include "ve_game_object.hpp"
 #include "ve_light.hpp"
 #include "ve_mesh.hpp"
 #include "ve_mesh_loader.hpp"
+#include "ve_object_store.hpp"
+#include "ve_thread_pool.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include <array>
+#include <future>
+#include <limits>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -27,26 +35,219 @@ public:
   Scene(MeshLoader &modelLoader);
   ~Scene(){};
 
-  void addGameObject(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, std::string modelPath);
-  void addGameObject(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale);
+  // the model is loaded in the background, the object gets its mesh, and is
+  // drawn, in the first `prepare()` after it's on the gpu
+  ObjectHandle addGameObject(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale, std::string modelPath);
+  ObjectHandle addGameObject(glm::vec3 position, glm::vec3 rotation, glm::vec3 scale);
+  struct ModelInstance {
+    glm::vec3 position;
+    glm::vec3 rotation;
+    glm::vec3 scale;
+    std::string modelPath;
+  };
+  // the same for many objects, with their models imported together, see
+  // MeshLoader::requestglTFs(). the handles are in the order given
+  std::vector<ObjectHandle> addGameObjects(const std::vector<ModelInstance> &instances);
+  void setMesh(ObjectHandle object, Mesh mesh);
+  // takes the object out of its draw calls and the bvh right away. the last
+  // object moves into its dense index, only the instance slots of that one
+  // object are touched, and the draw calls it was removed from
+  void removeGameObject(ObjectHandle object);
 
   void addLight(PointLight light);
 
-  const std::vector<GameObject> &gameObjects() { return m_gameObjects; }
+  ObjectStore &objects() { return m_objects; }
   const std::vector<PointLight> &lights() { return m_lights; }
 
-  // this sorts the list of `GameObject`s by mesh, then
-  // fills the `m_drawCalls` vector with the data to make
-  // draw calls in `draw()`
-  void prepare();
+  const std::vector<DrawCall> &drawCalls() { return m_drawCalls; }
+  // the primitive drawn by each entry of `drawCalls()`
+  const std::vector<uint32_t> &drawPrimitives() { return m_drawPrimitives; }
+  // the dense object index of every instance, addressed by
+  // `DrawCall::firstInstance` + the instance's index within the draw call.
+  // slots past a draw call's `instanceCount` are unused.
+  const std::vector<uint32_t> &instances() { return m_instances; }
+
+  // an entry of `instances()` and the draw call it belongs to
+  struct InstanceRef {
+    uint32_t drawCall;
+    uint32_t instance;
+  };
+
+  // indices of the draw calls whose instance range changed since the last
+  // call to `clearTouched()`
+  const std::vector<uint32_t> &touchedDrawCalls() { return m_touchedDrawCalls; }
+  // entries of `instances()` that were written since the last call to
+  // `clearTouched()`. entries past the end of their draw call's instance
+  // count can be left out, nothing reads them
+  const std::vector<InstanceRef> &touchedInstances() { return m_touchedInstances; }
+  void clearTouched();
+
+  // brings the draw calls up to date with every object that was added or
+  // changed its mesh since the last call.
+  //
+  // normally this only patches the draw calls of the affected meshes. the
+  // first call, and any call after `requestFullRebuild()` or once too much
+  // of the instance array is unused, instead gives every (object, primitive)
+  // pair a 64 bit sort key, radix sorts them and rebuilds all draw calls,
+  // with instances ordered front to back as seen from `viewPosition`.
+  void prepare(glm::vec3 viewPosition = glm::vec3(0.0f));
+  void requestFullRebuild() { m_fullRebuildRequested = true; }
+
+  // brings the bvh and the world space bounds of every instance up to date
+  // with the objects in `movedObjects` and the touched instances. has to run
+  // after `prepare()` and before `clearTouched()`
+  void updateBounds(const std::vector<uint32_t> &movedObjects, ThreadPool &threadPool);
+  // finds the visible objects through the bvh and builds `visibleDrawCalls()`
+  // out of their instances, has to run after `updateBounds()`.
+  //
+  // with a `lodScale` above 0 every visible instance also picks the lod of
+  // its primitive that fits its distance from `viewPosition`, and gets drawn
+  // with the instances that picked the same one. `lodScale` is the number of
+  // pixels one unit of world space covers at a distance of 1, divided by the
+  // error in pixels a lod is allowed to have
+  void cull(const Frustum &frustum, glm::vec3 viewPosition = glm::vec3(0.0f), float lodScale = 0.0f);
+  // the draw calls recorded by `draw()`, grouped by index buffer. their instances index `visibleInstances()`
+  const std::vector<DrawCall> &visibleDrawCalls() { return m_visibleDrawCalls; }
+  // the instance slot (an index into `instances()`) of every visible instance
+  const std::vector<uint32_t> &visibleInstances() { return m_visibleInstances; }
+
   void draw(VkCommandBuffer cmd);
 
+  // spatial queries, answered with the bvh as of the last `updateBounds()`
+  //
+  // the object whose bounds the ray enters first, or an invalid handle
+  ObjectHandle pick(glm::vec3 origin, glm::vec3 direction, float maxDistance = std::numeric_limits<float>::max());
+  // every object whose bounds intersect the sphere
+  void queryRadius(glm::vec3 center, float radius, std::vector<ObjectHandle> &objects);
+  const Bvh &bvh() { return m_bvh; }
+
+  struct PrepareStats {
+    bool fullRebuild{false};
+    uint32_t batchesTouched{0};
+    uint32_t batchesTotal{0};
+    uint32_t instancesWritten{0};
+  };
+  // what the last call to `prepare()` had to do
+  const PrepareStats &lastPrepareStats() { return m_lastPrepareStats; }
+
+  struct CullStats {
+    uint32_t tested{0};
+    uint32_t visible{0};
+    uint32_t culled{0};
+    uint32_t nodesVisited{0};
+    // drawn by `visibleDrawCalls()`, after picking lods
+    uint32_t triangles{0};
+    bool bvhRebuilt{false};
+    float milliseconds{0.0f};
+  };
+  // what the last calls to `updateBounds()` and `cull()` found and how long
+  // they took, only `bvhRebuilt` and `milliseconds` are filled in when culling
+  // happens on the gpu
+  const CullStats &lastCullStats() { return m_lastCullStats; }
+
+  // batches start on a multiple of this many instance slots, so that per
+  // instance data (8 bytes each) written for different batches never shares
+  // a cache line
+  static constexpr uint32_t INSTANCE_ALIGNMENT = 8;
+
+  // minimum number of elements handed to one thread while culling
+  static constexpr size_t BOUNDS_GRAIN_SIZE = 256;
+
+  // refitting keeps the tree's topology, so once objects have moved around
+  // enough that it's this much worse than a fresh one it gets rebuilt
+  static constexpr float BVH_REBUILD_RATIO = 1.5f;
+  // adding more than this share of the tree's size at once builds it again,
+  // instead of inserting every new object on its own
+  static constexpr float BVH_BULK_INSERT_RATIO = 0.5f;
+
 private:
+  static constexpr uint32_t NO_GROUP = std::numeric_limits<uint32_t>::max();
+  static constexpr uint32_t NOT_TOUCHED = std::numeric_limits<uint32_t>::max();
+
+  // all objects using one mesh. each primitive of the mesh has its own draw
+  // call, and every one of those lists the group's objects in the same order,
+  // so an object sits in the same slot of all of them.
+  struct MeshGroup {
+    Mesh mesh;
+    std::vector<uint32_t> objects;
+    std::vector<uint32_t> drawCalls;
+  };
+
+  void rebuild(glm::vec3 viewPosition);
+  void updateObject(uint32_t object);
+  void addToGroup(uint32_t object, const Mesh &mesh);
+  void removeFromGroup(uint32_t object);
+  uint32_t findOrCreateGroup(const Mesh &mesh);
+  void reserveInstances(uint32_t drawCall, uint32_t count);
+  void renameObject(uint32_t from, uint32_t to);
+  void touchDrawCall(uint32_t drawCall);
+  void touchInstance(uint32_t drawCall, uint32_t instance);
+  void updateInstanceBounds(uint32_t drawCall, uint32_t instance);
+  void updateBvh(const std::vector<uint32_t> &movedObjects, ThreadPool &threadPool);
+  void updateObjectBounds(uint32_t object);
+  void groupDrawCalls();
+
   MeshLoader &m_modelLoader;
 
   std::vector<DrawCall> m_drawCalls;
+  std::vector<uint32_t> m_drawPrimitives;
+  std::vector<uint32_t> m_drawCallCapacities;
+  // every draw call, grouped by the index buffer its primitive uses in index
+  // buffer order, and how many there are for each index buffer. redone by
+  // `prepare()` as draw calls come and go
+  std::vector<uint32_t> m_indexBufferDrawCalls;
+  std::vector<uint32_t> m_indexBufferDrawCallCounts;
+  std::vector<uint32_t> m_instances;
+  uint32_t m_liveInstanceCount{0};
+
+  std::vector<uint32_t> m_touchedDrawCalls;
+  std::vector<uint8_t> m_drawCallTouched;
+  std::vector<InstanceRef> m_touchedInstances;
+  // where each entry of `m_instances` is in `m_touchedInstances`
+  std::vector<uint32_t> m_instanceEntries;
+
+  std::vector<MeshGroup> m_meshGroups;
+  std::unordered_map<uint32_t, uint32_t> m_meshGroupLookup;
+  // per object: the group it's drawn with, and its slot in that group
+  std::vector<uint32_t> m_objectGroups;
+  std::vector<uint32_t> m_objectGroupSlots;
+
+  std::vector<uint32_t> m_pendingObjects;
+  // objects waiting for their mesh to be loaded
+  struct StreamingObject {
+    ObjectHandle object;
+    std::shared_future<Mesh> mesh;
+  };
+  std::vector<StreamingObject> m_streamingObjects;
+  bool m_fullRebuildRequested{true};
+  PrepareStats m_lastPrepareStats{};
+
+  // world space bounds of every instance slot, and of every object
+  BoundsArray m_instanceBounds;
+  BoundsArray m_objectBounds;
+  Bvh m_bvh;
+  // objects whose mesh changed, so their bounds did too
+  std::vector<uint32_t> m_remeshedObjects;
+
+  std::vector<uint32_t> m_visibleObjects;
+  std::vector<uint32_t> m_visibleSlots;
+  // the draw call and lod of every visible slot, as dc * Mesh::MAX_LOD_COUNT + lod
+  std::vector<uint32_t> m_visibleSlotDrawCalls;
+  std::vector<uint32_t> m_drawCallVisibleOffsets;
+  std::vector<DrawCall> m_visibleDrawCalls;
+  // how many of `m_visibleDrawCalls` use each index buffer, in index buffer order
+  std::vector<uint32_t> m_visibleIndexBufferDrawCounts;
+  std::vector<uint32_t> m_visibleInstances;
+  CullStats m_lastCullStats{};
+
+  // kept around between calls to `prepare()` to avoid reallocating
+  std::vector<uint64_t> m_sortKeys;
+  std::vector<uint32_t> m_sortValues;
+  std::vector<uint64_t> m_sortKeysScratch;
+  std::vector<uint32_t> m_sortValuesScratch;
+
   std::vector<PointLight> m_lights;
-  std::vector<GameObject> m_gameObjects;
+  ObjectStore m_objects;
 };
 
-} // namespace ve
\ No newline at end of file
+} // namespace ve
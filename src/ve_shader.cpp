@@ -3,15 +3,18 @@
 #include "spirv_reflect/spirv_reflect.h"
 
 #include <cassert>
-#include <fstream>
 #include <iostream>
 
 namespace ve {
 
-ShaderStage::ShaderStage(Device &device, const std::string &filepath, VkShaderStageFlagBits stage)
+ShaderStage::ShaderStage(
+    Device &device,
+    FileSystem &fileSystem,
+    const std::string &filepath,
+    VkShaderStageFlagBits stage)
     : m_device{device}
     , m_stage{stage} {
-  auto code = readFile(filepath);
+  auto code = readFile(fileSystem, filepath);
   std::cout << filepath << " file size: " << code.size() << std::endl;
   createShaderModule(code, &m_shaderModule);
   m_code = std::move(code);
@@ -19,21 +22,13 @@ ShaderStage::ShaderStage(Device &device, const std::string &filepath, VkShaderSt
 
 ShaderStage::~ShaderStage() { vkDestroyShaderModule(m_device.device(), m_shaderModule, nullptr); }
 
-std::vector<uint8_t> ShaderStage::readFile(const std::string &filepath) {
-  std::ifstream file(filepath, std::ios::ate | std::ios::binary);
-
-  if (!file.is_open()) {
+std::vector<uint8_t> ShaderStage::readFile(FileSystem &fileSystem, const std::string &filepath) {
+  if (!fileSystem.exists(filepath)) {
     throw std::runtime_error("Failed to open file: " + filepath);
   }
 
-  size_t fileSize = static_cast<size_t>(file.tellg());
-  std::vector<uint8_t> buffer(fileSize);
-
-  file.seekg(0);
-  file.read((char *)buffer.data(), fileSize);
-  file.close();
-
-  return buffer;
+  FileView file = fileSystem.open(filepath);
+  return std::vector<uint8_t>(file.data(), file.data() + file.size());
 }
 
 void ShaderStage::createShaderModule(const std::vector<uint8_t> &code, VkShaderModule *shaderModule) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ve_device.hpp"
+#include "ve_file_system.hpp"
 
 #include <vulkan/vulkan.h>
 
@@ -14,7 +15,7 @@ namespace ve {
 
 class ShaderStage {
 public:
-  ShaderStage(Device &device, const std::string &filepath, VkShaderStageFlagBits stage);
+  ShaderStage(Device &device, FileSystem &fileSystem, const std::string &filepath, VkShaderStageFlagBits stage);
   ~ShaderStage();
 
   const VkShaderModule module() { return m_shaderModule; }
@@ -22,7 +23,7 @@ public:
   const std::vector<uint8_t> &code() { return m_code; }
 
 private:
-  static std::vector<uint8_t> readFile(const std::string &filepath);
+  static std::vector<uint8_t> readFile(FileSystem &fileSystem, const std::string &filepath);
   void createShaderModule(const std::vector<uint8_t> &code, VkShaderModule *shaderModule);
 
   Device &m_device;
@@ -32,6 +32,7 @@ public:
   VkFramebuffer getFrameBuffer(int index) { return m_swapchainFramebuffers[index]; }
   VkRenderPass getRenderPass() { return m_renderPass; }
   VkImageView getImageView(int index) { return m_swapchainImageViews[index]; }
+  VkImageView getDepthImageView(int index) { return m_depthImageViews[index]; }
   size_t imageCount() { return m_swapchainImages.size(); }
   FrameData &getCurrentFrame() { return m_frameData[m_currentFrame % MAX_FRAMES_IN_FLIGHT]; }
   VkFormat getSwapchainImageFormat() { return m_swapchainImageFormat; }
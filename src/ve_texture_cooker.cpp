@@ -0,0 +1,128 @@
+#include "ve_texture_cooker.hpp"
+
+#include "ve_vetex.hpp"
+
+#include "stb_image/stb_image.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace ve {
+
+namespace {
+
+// textures are sampled as sRGB, so levels are averaged in linear space and
+// converted back, or every level would come out darker than the one before
+
+float srgbToLinear(float value) {
+  return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+uint8_t linearToSrgb(float value) {
+  value = std::clamp(value, 0.0f, 1.0f);
+  float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+  return static_cast<uint8_t>(srgb * 255.0f + 0.5f);
+}
+
+const std::array<float, 256> &srgbTable() {
+  static const std::array<float, 256> table = []() {
+    std::array<float, 256> values;
+    for (size_t i = 0; i < values.size(); i++) {
+      values[i] = srgbToLinear(i / 255.0f);
+    }
+    return values;
+  }();
+  return table;
+}
+
+} // namespace
+
+std::vector<uint8_t> TextureCooker::cookImage(const std::string &path, int64_t sourceTime) {
+  int width, height, channels;
+  stbi_uc *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+  if (!pixels) {
+    throw std::runtime_error("Failed to load texture " + path + "!");
+  }
+
+  std::vector<uint8_t> cooked;
+  try {
+    cooked = cookPixels(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), sourceTime);
+  } catch (...) {
+    stbi_image_free(pixels);
+    throw;
+  }
+  stbi_image_free(pixels);
+  return cooked;
+}
+
+std::vector<uint8_t> TextureCooker::cookPixels(
+    const uint8_t *pixels,
+    uint32_t width,
+    uint32_t height,
+    int64_t sourceTime) {
+  vetex::Header header{};
+  header.magic = vetex::MAGIC;
+  header.version = vetex::VERSION;
+  header.width = width;
+  header.height = height;
+  header.mipLevels = vetex::mipLevelCount(width, height);
+  header.sourceTime = sourceTime;
+  header.pixelOffset = (sizeof(vetex::Header) + vetex::ALIGNMENT - 1) & ~(vetex::ALIGNMENT - 1);
+  header.pixelSize = vetex::mipChainSize(width, height, header.mipLevels);
+
+  std::vector<uint8_t> cooked(header.pixelOffset + header.pixelSize);
+  std::memcpy(cooked.data(), &header, sizeof(header));
+  uint8_t *level = cooked.data() + header.pixelOffset;
+  std::memcpy(level, pixels, size_t{width} * height * 4);
+
+  // every level is a box filter of the one before, kept in linear space
+  // between levels so rounding doesn't add up down the chain
+  const std::array<float, 256> &toLinear = srgbTable();
+  std::vector<float> previous(size_t{width} * height * 4);
+  for (size_t i = 0; i < previous.size(); i++) {
+    previous[i] = (i % 4 == 3) ? pixels[i] / 255.0f : toLinear[pixels[i]];
+  }
+
+  std::vector<float> current;
+  uint32_t previousWidth = width;
+  uint32_t previousHeight = height;
+  for (uint32_t mip = 1; mip < header.mipLevels; mip++) {
+    level += size_t{previousWidth} * previousHeight * 4;
+    uint32_t levelWidth = vetex::mipSize(width, mip);
+    uint32_t levelHeight = vetex::mipSize(height, mip);
+    current.resize(size_t{levelWidth} * levelHeight * 4);
+
+    for (uint32_t y = 0; y < levelHeight; y++) {
+      // odd sizes lose their last row or column, dimensions already at 1 average it with itself
+      uint32_t y0 = std::min(y * 2, previousHeight - 1);
+      uint32_t y1 = std::min(y * 2 + 1, previousHeight - 1);
+      for (uint32_t x = 0; x < levelWidth; x++) {
+        uint32_t x0 = std::min(x * 2, previousWidth - 1);
+        uint32_t x1 = std::min(x * 2 + 1, previousWidth - 1);
+        const float *a = &previous[(size_t{y0} * previousWidth + x0) * 4];
+        const float *b = &previous[(size_t{y0} * previousWidth + x1) * 4];
+        const float *c = &previous[(size_t{y1} * previousWidth + x0) * 4];
+        const float *d = &previous[(size_t{y1} * previousWidth + x1) * 4];
+
+        size_t pixel = (size_t{y} * levelWidth + x) * 4;
+        for (uint32_t channel = 0; channel < 4; channel++) {
+          float value = (a[channel] + b[channel] + c[channel] + d[channel]) * 0.25f;
+          current[pixel + channel] = value;
+          level[pixel + channel] =
+              channel == 3 ? static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f) : linearToSrgb(value);
+        }
+      }
+    }
+
+    std::swap(previous, current);
+    previousWidth = levelWidth;
+    previousHeight = levelHeight;
+  }
+
+  return cooked;
+}
+
+} // namespace ve
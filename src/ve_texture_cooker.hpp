@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ve {
+
+// turns source images into .vetex files (see ve_vetex.hpp): decodes them
+// and builds their whole mip chain, so loading one is a single copy into the
+// image. needs no device
+class TextureCooker {
+public:
+  // the contents of a .vetex file for the image at `path`, recording
+  // `sourceTime` as the time the source was written. throws if it can't be loaded
+  static std::vector<uint8_t> cookImage(const std::string &path, int64_t sourceTime);
+
+  // same, for `width * height` RGBA pixels already in memory
+  static std::vector<uint8_t> cookPixels(const uint8_t *pixels, uint32_t width, uint32_t height, int64_t sourceTime);
+};
+
+} // namespace ve
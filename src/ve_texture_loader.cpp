@@ -1,18 +1,24 @@
 #include "ve_texture_loader.hpp"
 
-#include "stb_image/stb_image.h"
+#include "ve_mesh_cooker.hpp"
+#include "ve_texture_cooker.hpp"
+#include "ve_vetex.hpp"
 
 #include <cassert>
+#include <filesystem>
 #include <iostream>
 #include <stdexcept>
 
 namespace ve {
 
 const std::string TextureLoader::TEXTURE_PATH = "textures/";
+const std::string TextureLoader::COOKED_EXTENSION = ".vetex";
 const uint32_t TextureLoader::MAX_TEXTURES = 1000;
 
-TextureLoader::TextureLoader(Device &device)
-    : m_device{device} {
+TextureLoader::TextureLoader(Device &device, FileSystem &fileSystem, UploadContext &uploadContext)
+    : m_device{device}
+    , m_fileSystem{fileSystem}
+    , m_uploadContext{uploadContext} {
   VkSamplerCreateInfo globalSamplerCreateInfo = Texture::defaultSamplerInfo();
   vkCreateSampler(m_device.device(), &globalSamplerCreateInfo, nullptr, &m_globalSampler);
   m_globalSamplerInfo.sampler = m_globalSampler;
@@ -30,15 +36,11 @@ TextureLoader::~TextureLoader() {
   vkDestroySampler(m_device.device(), m_globalSampler, nullptr);
 }
 
-Texture TextureLoader::loadFromData(void *data, uint32_t width, uint32_t height) {
+Texture TextureLoader::loadFromData(void *data, uint32_t width, uint32_t height, uint32_t mipLevels) {
   assert(m_loadedTextures.size() < MAX_TEXTURES && "Maximum number of textures have been loaded");
-  VkDeviceSize stagingBufferSize = width * height * 4;
+  VkDeviceSize size = vetex::mipChainSize(width, height, mipLevels);
   VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
 
-  Buffer stagingBuffer{m_device.getAllocator()};
-  stagingBuffer.create(stagingBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 0, VMA_MEMORY_USAGE_CPU_ONLY);
-  stagingBuffer.write(data, stagingBufferSize);
-
   VkExtent3D imageExtent{};
   imageExtent.width = static_cast<uint32_t>(width);
   imageExtent.height = static_cast<uint32_t>(height);
@@ -52,7 +54,7 @@ Texture TextureLoader::loadFromData(void *data, uint32_t width, uint32_t height)
   imageInfo.format = format;
   imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   imageInfo.imageType = VK_IMAGE_TYPE_2D;
-  imageInfo.mipLevels = 1;
+  imageInfo.mipLevels = mipLevels;
   imageInfo.arrayLayers = 1;
   imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
   imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -62,7 +64,7 @@ Texture TextureLoader::loadFromData(void *data, uint32_t width, uint32_t height)
   auto newImage = std::make_unique<Image>(m_device.getAllocator());
   newImage->create(&imageInfo, VK_IMAGE_ASPECT_COLOR_BIT, 0, VMA_MEMORY_USAGE_GPU_ONLY);
 
-  m_device.imageLayoutTransition(
+  m_uploadContext.imageLayoutTransition(
       newImage->image,
       newImage->arrayLayers(),
       newImage->mipLevels(),
@@ -74,9 +76,21 @@ Texture TextureLoader::loadFromData(void *data, uint32_t width, uint32_t height)
       VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
       VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-  m_device.copyBufferToImage(stagingBuffer.buffer, newImage->image, width, height, 1);
+  std::vector<VkBufferImageCopy> regions(mipLevels);
+  VkDeviceSize levelOffset = 0;
+  for (uint32_t level = 0; level < mipLevels; level++) {
+    VkBufferImageCopy &region = regions[level];
+    region.bufferOffset = levelOffset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = level;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {vetex::mipSize(width, level), vetex::mipSize(height, level), 1};
+    levelOffset += VkDeviceSize{region.imageExtent.width} * region.imageExtent.height * 4;
+  }
+  m_uploadContext.uploadImage(data, size, newImage->image, regions);
 
-  m_device.imageLayoutTransition(
+  m_uploadContext.imageLayoutTransition(
       newImage->image,
       newImage->arrayLayers(),
       newImage->mipLevels(),
@@ -103,6 +117,7 @@ Texture TextureLoader::loadFromData(void *data, uint32_t width, uint32_t height)
   samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
   samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
   samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.maxLod = static_cast<float>(mipLevels);
 
   VkSampler textureSampler;
   vkCreateSampler(m_device.device(), &samplerInfo, nullptr, &textureSampler);
@@ -141,23 +156,60 @@ Texture TextureLoader::loadFromFile(const std::string &path) {
   }
 
   std::cout << "TextureLoader: Loading texture " << path << " from disk" << std::endl;
+  return loadFromCooked(path, readTexture(path));
+}
 
-  int width, height, channels;
-
-  std::string fullPath = TEXTURE_PATH + path;
-
-  stbi_uc *pixels = stbi_load(fullPath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
-
-  if (!pixels) {
-    throw std::runtime_error("Failed to load texture " + path + "!");
+TextureLoader::CookedTexture TextureLoader::readTexture(const std::string &path) {
+  std::shared_ptr<std::mutex> lock;
+  {
+    std::lock_guard<std::mutex> guard{m_cookingMutex};
+    std::shared_ptr<std::mutex> &pathLock = m_cookingLocks[path];
+    if (!pathLock) {
+      pathLock = std::make_shared<std::mutex>();
+    }
+    lock = pathLock;
+  }
+  // whoever comes second finds the file the first one cooked
+  std::lock_guard<std::mutex> guard{*lock};
+
+  // same as meshes, the cooked file is used as long as it's newer than the source
+  std::string sourcePath = TEXTURE_PATH + path;
+  std::string cookedPath = sourcePath + COOKED_EXTENSION;
+  int64_t sourceTime = MeshCooker::sourceTime(sourcePath);
+  CookedTexture cooked;
+  if (m_fileSystem.exists(cookedPath)) {
+    cooked.file = m_fileSystem.open(cookedPath);
+    const vetex::Header *header = vetex::parse(cooked.file.data(), cooked.file.size());
+    if (header && (header->sourceTime == sourceTime || !std::filesystem::exists(sourcePath))) {
+      return cooked;
+    }
   }
 
-  void *pixelPtr = pixels;
-
-  Texture texture = loadFromData(pixelPtr, width, height);
+  cooked.file = {};
+  cooked.cooked = TextureCooker::cookImage(sourcePath, sourceTime);
+  if (!saveFile(cookedPath, cooked.cooked)) {
+    std::cout << "TextureLoader: WARNING: couldn't save " << cookedPath << ", " << path
+              << " will be cooked again next time" << std::endl;
+  }
+  return cooked;
+}
 
-  stbi_image_free(pixels);
+Texture TextureLoader::loadFromCooked(const std::string &path, const CookedTexture &cooked) {
+  auto found = m_textureCache.find(path);
+  if (found != m_textureCache.end()) {
+    return found->second;
+  }
 
+  const vetex::Header *header = vetex::parse(cooked.data(), cooked.size());
+  if (header == nullptr) {
+    throw std::runtime_error("Failed to load cooked texture " + path);
+  }
+  Texture texture = loadFromData(
+      const_cast<uint8_t *>(cooked.data() + header->pixelOffset),
+      header->width,
+      header->height,
+      header->mipLevels);
+  m_textureCache[path] = texture;
   return texture;
 }
 
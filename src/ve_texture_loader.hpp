@@ -1,10 +1,13 @@
 #pragma once
 
 #include "ve_device.hpp"
+#include "ve_file_system.hpp"
 #include "ve_image.hpp"
 #include "ve_texture.hpp"
+#include "ve_upload_context.hpp"
 
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -21,10 +24,12 @@ struct LoadedTexture {
 
 class TextureLoader {
 public:
-  TextureLoader(Device &device);
+  TextureLoader(Device &device, FileSystem &fileSystem, UploadContext &uploadContext);
   ~TextureLoader();
 
   static const std::string TEXTURE_PATH;
+  // appended to a source image's path for the cooked texture next to it
+  static const std::string COOKED_EXTENSION;
 
   // currently, this can't be more than 4000 or so
   static const uint32_t MAX_TEXTURES;
@@ -33,14 +38,34 @@ public:
   const uint32_t descriptorCount() { return static_cast<uint32_t>(m_descriptorInfos.size()); }
   const VkDescriptorImageInfo &globalSamplerInfo() { return m_globalSamplerInfo; }
 
+  // the contents of a .vetex file, mapped or straight out of the cooker
+  struct CookedTexture {
+    FileView file;
+    std::vector<uint8_t> cooked;
+
+    const uint8_t *data() const { return cooked.empty() ? file.data() : cooked.data(); }
+    size_t size() const { return cooked.empty() ? file.size() : cooked.size(); }
+  };
+
+  // uses the cooked .vetex file next to the image if it's up to date,
+  // otherwise cooks the image and saves it there for the next time
   Texture loadFromFile(const std::string &path);
+  // the reading and cooking part of that, which can run on any thread.
+  // threads asking for the same image wait for the one cooking it
+  CookedTexture readTexture(const std::string &path);
+  // the rest, the texture read from `path` unless it's already loaded
+  Texture loadFromCooked(const std::string &path, const CookedTexture &cooked);
 
-  // `data` is expected to be a block of data of size width*height*4
-  // containing RGBA pixel data
-  Texture loadFromData(void *data, uint32_t width, uint32_t height);
+  // `data` is expected to be a block of RGBA pixel data holding `mipLevels`
+  // levels back to back, starting with the width*height one. the upload is
+  // only recorded, the texture can be used by whatever is submitted after
+  // the upload context's next `submit()`
+  Texture loadFromData(void *data, uint32_t width, uint32_t height, uint32_t mipLevels = 1);
 
 private:
   Device &m_device;
+  FileSystem &m_fileSystem;
+  UploadContext &m_uploadContext;
 
   VkSampler m_globalSampler;
   VkDescriptorImageInfo m_globalSamplerInfo{};
@@ -48,6 +73,10 @@ private:
   std::vector<VkDescriptorImageInfo> m_descriptorInfos;
 
   std::unordered_map<std::string, Texture> m_textureCache;
+
+  // one lock per image, held while it's checked and cooked
+  std::mutex m_cookingMutex;
+  std::unordered_map<std::string, std::shared_ptr<std::mutex>> m_cookingLocks;
   std::vector<LoadedTexture> m_loadedTextures;
 };
 
@@ -0,0 +1,134 @@
+#include "ve_thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace ve {
+
+namespace {
+
+// the chunks of one `parallelFor()` call. threads claim them one at a time
+// until none are left, so chunks nobody got to yet are just done by whoever
+// comes next. queued helpers can outlive the call, so it's shared with them
+struct ParallelFor {
+  const std::function<void(size_t, size_t)> *fn;
+  size_t count;
+  size_t chunkSize;
+  size_t chunkCount;
+  std::atomic<size_t> next{0};
+  std::atomic<size_t> done{0};
+
+  void run() {
+    while (true) {
+      size_t chunk = next.fetch_add(1, std::memory_order_relaxed);
+      if (chunk >= chunkCount) {
+        return;
+      }
+      size_t begin = chunk * chunkSize;
+      (*fn)(begin, std::min(count, begin + chunkSize));
+      done.fetch_add(1, std::memory_order_release);
+    }
+  }
+};
+
+} // namespace
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (uint32_t i = 1; i < threadCount; i++) {
+    m_workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_condition.notify_all();
+
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::enqueue(std::function<void()> job, bool urgent) {
+  if (m_workers.empty()) {
+    job();
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (urgent) {
+      m_jobs.push_front(std::move(job));
+    } else {
+      m_jobs.push_back(std::move(job));
+    }
+  }
+  m_condition.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+      if (m_stopping && m_jobs.empty()) {
+        return;
+      }
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+
+    job();
+  }
+}
+
+void ThreadPool::parallelFor(
+    size_t count,
+    size_t grainSize,
+    size_t alignment,
+    const std::function<void(size_t, size_t)> &fn) {
+  if (count == 0) {
+    return;
+  }
+
+  grainSize = std::max<size_t>(grainSize, 1);
+  alignment = std::max<size_t>(alignment, 1);
+
+  size_t chunkCount = std::min<size_t>(threadCount(), (count + grainSize - 1) / grainSize);
+  if (chunkCount <= 1) {
+    fn(0, count);
+    return;
+  }
+
+  size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+  chunkSize = (chunkSize + alignment - 1) / alignment * alignment;
+  chunkCount = (count + chunkSize - 1) / chunkSize;
+
+  auto state = std::make_shared<ParallelFor>();
+  state->fn = &fn;
+  state->count = count;
+  state->chunkSize = chunkSize;
+  state->chunkCount = chunkCount;
+  for (size_t chunk = 1; chunk < chunkCount; chunk++) {
+    enqueue([state]() { state->run(); }, true);
+  }
+
+  // the calling thread only ever helps with this call's own chunks. running
+  // other queued jobs while waiting would let a long `submit()`ted one, like
+  // cooking a mesh, hold it up. chunks are claimed rather than handed out, so
+  // nested calls from a worker can't deadlock either, at worst the calling
+  // thread does every chunk itself
+  state->run();
+  while (state->done.load(std::memory_order_acquire) < chunkCount) {
+    std::this_thread::yield();
+  }
+}
+
+} // namespace ve
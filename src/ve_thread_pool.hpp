@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace ve {
+
+class ThreadPool {
+public:
+  static constexpr size_t CACHE_LINE_SIZE = 64;
+
+  // `threadCount` includes the calling thread, which always takes part in
+  // `parallelFor()`. 0 means one thread per hardware thread.
+  explicit ThreadPool(uint32_t threadCount = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  uint32_t threadCount() const { return static_cast<uint32_t>(m_workers.size()) + 1; }
+
+  // the smallest number of consecutive `T`s that fills whole cache lines.
+  // chunks that start on a multiple of this never share a cache line
+  template <typename T>
+  static constexpr size_t cacheLineAlignment() {
+    return CACHE_LINE_SIZE / std::gcd(CACHE_LINE_SIZE, sizeof(T));
+  }
+
+  // runs `fn(begin, end)` over [0, count), split into at most one chunk per
+  // thread of at least `grainSize` elements each. every chunk boundary is a
+  // multiple of `alignment`. returns once all chunks are done. while it
+  // waits the calling thread works on these chunks only, never on anything
+  // else in the queue.
+  void parallelFor(size_t count, size_t grainSize, size_t alignment, const std::function<void(size_t, size_t)> &fn);
+
+  // same as above, with chunk boundaries aligned so that chunks writing to
+  // an array of `T` never touch the same cache line
+  template <typename T, typename F>
+  void parallelFor(size_t count, size_t grainSize, F &&fn) {
+    parallelFor(count, grainSize, cacheLineAlignment<T>(), std::forward<F>(fn));
+  }
+
+  // runs `fn` on a worker thread
+  template <typename F>
+  auto submit(F &&fn) -> std::future<std::invoke_result_t<F>> {
+    using R = std::invoke_result_t<F>;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+    std::future<R> future = task->get_future();
+    enqueue([task]() { (*task)(); });
+    return future;
+  }
+
+private:
+  // urgent jobs go ahead of everything already queued, `parallelFor()`
+  // chunks shouldn't have to wait for background work
+  void enqueue(std::function<void()> job, bool urgent = false);
+  void workerLoop();
+
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()>> m_jobs;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_stopping{false};
+};
+
+} // namespace ve
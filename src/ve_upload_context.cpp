@@ -0,0 +1,390 @@
+#include "ve_upload_context.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace ve {
+
+UploadContext::UploadContext(Device &device, VkDeviceSize size)
+    : m_device{device}
+    , m_buffer{device.getAllocator()}
+    , m_size{size}
+    , m_uploadQueue{device.hasTransferQueue() ? m_transferQueue : m_graphicsQueue} {
+  m_buffer.create(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 0, VMA_MEMORY_USAGE_CPU_ONLY);
+  m_buffer.mapMemory();
+  m_data = static_cast<uint8_t *>(m_buffer.data());
+
+  QueueFamilyIndices families = device.findPhysicalQueueFamilies();
+  m_graphicsQueue = {device.graphicsQueue(), device.getCommandPool(), families.graphicsFamily, {}};
+  if (device.hasTransferQueue()) {
+    m_transferQueue = {device.transferQueue(), device.getTransferCommandPool(), families.transferFamily, {}};
+    m_sharedQueueFamilies = {families.graphicsFamily, families.transferFamily};
+  }
+}
+
+UploadContext::~UploadContext() {
+  if (!m_inFlight.empty()) {
+    wait(m_inFlight.back().number);
+  }
+  for (Submission *recording : {&m_recording.uploads, &m_recording.graphics}) {
+    if (recording->commandBuffer != VK_NULL_HANDLE) {
+      vkEndCommandBuffer(recording->commandBuffer);
+    }
+  }
+  recycle(m_uploadQueue, m_recording.uploads);
+  recycle(m_graphicsQueue, m_recording.graphics);
+
+  for (Queue *queue : {&m_graphicsQueue, &m_transferQueue}) {
+    for (const Submission &submission : queue->spare) {
+      vkFreeCommandBuffers(m_device.device(), queue->commandPool, 1, &submission.commandBuffer);
+      vkDestroyFence(m_device.device(), submission.fence, nullptr);
+      if (submission.semaphore != VK_NULL_HANDLE) {
+        vkDestroySemaphore(m_device.device(), submission.semaphore, nullptr);
+      }
+    }
+  }
+  m_buffer.unmapMemory();
+}
+
+bool UploadContext::allocate(VkDeviceSize size, VkDeviceSize alignment, void *&data, VkDeviceSize &offset) {
+  if (m_used == 0) {
+    // empty, starting over at the beginning keeps big uploads from wrapping
+    m_head = 0;
+  }
+
+  VkDeviceSize start = (m_head + alignment - 1) / alignment * alignment;
+  if (start + size > m_size) {
+    // whatever is left at the end is skipped
+    start = 0;
+  }
+  VkDeviceSize taken = start >= m_head ? start + size - m_head : m_size - m_head + size;
+  if (size > m_size || m_used + taken > m_size) {
+    return false;
+  }
+
+  m_head = start + size;
+  m_used += taken;
+  m_recording.bytes += taken;
+  m_stats.bytes += size;
+  data = m_data + start;
+  offset = start;
+  return true;
+}
+
+void UploadContext::stage(const void *data, VkDeviceSize size, VkBuffer &buffer, VkDeviceSize &offset) {
+  if (size > m_size) {
+    m_stats.bytes += size;
+    auto dedicated = std::make_unique<Buffer>(m_device.getAllocator());
+    dedicated->create(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 0, VMA_MEMORY_USAGE_CPU_ONLY);
+    dedicated->write(const_cast<void *>(data), size);
+    buffer = dedicated->buffer;
+    offset = 0;
+    m_dedicatedBuffers.emplace_back(m_nextBatch, std::move(dedicated));
+    return;
+  }
+
+  void *staged = nullptr;
+  if (!allocate(size, STAGING_ALIGNMENT, staged, offset)) {
+    // what was recorded so far has to go out before the space it holds comes
+    // back, then the oldest batches are waited for until there's enough
+    m_stats.waits++;
+    submit();
+    while (!allocate(size, STAGING_ALIGNMENT, staged, offset)) {
+      wait(m_inFlight.front().number);
+    }
+  }
+  std::memcpy(staged, data, static_cast<size_t>(size));
+  buffer = m_buffer.buffer;
+}
+
+void UploadContext::uploadBuffer(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset) {
+  VkBuffer staging;
+  VkDeviceSize offset;
+  stage(data, size, staging, offset);
+
+  VkBufferCopy region{offset, dstOffset, size};
+  vkCmdCopyBuffer(commandBuffer(), staging, dstBuffer, 1, &region);
+}
+
+void UploadContext::uploadImage(
+    const void *data,
+    VkDeviceSize size,
+    VkImage image,
+    const std::vector<VkBufferImageCopy> &regions) {
+  VkBuffer staging;
+  VkDeviceSize offset;
+  stage(data, size, staging, offset);
+
+  std::vector<VkBufferImageCopy> stagedRegions = regions;
+  for (VkBufferImageCopy &region : stagedRegions) {
+    region.bufferOffset += offset;
+  }
+  vkCmdCopyBufferToImage(
+      commandBuffer(),
+      staging,
+      image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      static_cast<uint32_t>(stagedRegions.size()),
+      stagedRegions.data());
+}
+
+void UploadContext::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, const std::vector<VkBufferCopy> &regions) {
+  VkCommandBuffer cmd = graphicsCommandBuffer();
+  vkCmdCopyBuffer(cmd, srcBuffer, dstBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+}
+
+void UploadContext::imageLayoutTransition(
+    VkImage image,
+    uint32_t layerCount,
+    uint32_t levelCount,
+    VkImageAspectFlags aspectMask,
+    VkImageLayout oldLayout,
+    VkImageLayout newLayout,
+    VkAccessFlags srcAccessMask,
+    VkAccessFlags dstAccessMask,
+    VkPipelineStageFlags srcStageMask,
+    VkPipelineStageFlags dstStageMask) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = newLayout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = aspectMask;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = levelCount;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = layerCount;
+  barrier.srcAccessMask = srcAccessMask;
+  barrier.dstAccessMask = dstAccessMask;
+
+  if (!usesTransferQueue() || dstStageMask == VK_PIPELINE_STAGE_TRANSFER_BIT) {
+    vkCmdPipelineBarrier(commandBuffer(), srcStageMask, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    return;
+  }
+
+  // released at the end of the batch, and acquired with the transition by
+  // the graphics queue once the copies are done
+  barrier.srcQueueFamilyIndex = m_transferQueue.family;
+  barrier.dstQueueFamilyIndex = m_graphicsQueue.family;
+  barrier.dstAccessMask = 0;
+  m_releases.push_back(barrier);
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = dstAccessMask;
+  m_recording.acquires.push_back(barrier);
+  // the release needs a command buffer to go into
+  commandBuffer();
+}
+
+VkCommandBuffer UploadContext::commandBuffer() { return begin(m_uploadQueue, m_recording.uploads); }
+
+VkCommandBuffer UploadContext::graphicsCommandBuffer() {
+  if (!usesTransferQueue()) {
+    return commandBuffer();
+  }
+  return begin(m_graphicsQueue, m_recording.graphics);
+}
+
+VkCommandBuffer UploadContext::begin(Queue &queue, Submission &submission) {
+  if (submission.commandBuffer != VK_NULL_HANDLE) {
+    return submission.commandBuffer;
+  }
+
+  if (!queue.spare.empty()) {
+    submission = queue.spare.back();
+    queue.spare.pop_back();
+    vkResetCommandBuffer(submission.commandBuffer, 0);
+    vkResetFences(m_device.device(), 1, &submission.fence);
+  } else {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = queue.commandPool;
+    allocInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(m_device.device(), &allocInfo, &submission.commandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to allocate upload command buffer!");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateFence(m_device.device(), &fenceInfo, nullptr, &submission.fence) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create upload fence!");
+    }
+
+    if (&queue == &m_transferQueue) {
+      VkSemaphoreCreateInfo semaphoreInfo{};
+      semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+      if (vkCreateSemaphore(m_device.device(), &semaphoreInfo, nullptr, &submission.semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload semaphore!");
+      }
+    }
+  }
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(submission.commandBuffer, &beginInfo);
+  return submission.commandBuffer;
+}
+
+void UploadContext::submit(
+    Queue &queue,
+    Submission &submission,
+    const std::vector<VkImageMemoryBarrier> &imageBarriers,
+    VkSemaphore waitSemaphore) {
+  if (&queue == &m_transferQueue) {
+    // the images go over to the graphics queue, everything written reaches it through the semaphore
+    if (!imageBarriers.empty()) {
+      vkCmdPipelineBarrier(
+          submission.commandBuffer,
+          VK_PIPELINE_STAGE_TRANSFER_BIT,
+          VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+          0,
+          0,
+          nullptr,
+          0,
+          nullptr,
+          static_cast<uint32_t>(imageBarriers.size()),
+          imageBarriers.data());
+    }
+  } else {
+    // makes the copies visible to every later use of what they wrote. after
+    // a semaphore wait on the transfer stage this chains to the transfer queue
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(
+        submission.commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0,
+        1,
+        &barrier,
+        0,
+        nullptr,
+        static_cast<uint32_t>(imageBarriers.size()),
+        imageBarriers.data());
+  }
+  vkEndCommandBuffer(submission.commandBuffer);
+
+  VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  if (waitSemaphore != VK_NULL_HANDLE) {
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &waitSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+  }
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &submission.commandBuffer;
+  if (submission.semaphore != VK_NULL_HANDLE) {
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &submission.semaphore;
+  }
+  if (vkQueueSubmit(queue.queue, 1, &submitInfo, submission.fence) != VK_SUCCESS) {
+    throw std::runtime_error("failed to submit upload command buffer!");
+  }
+}
+
+void UploadContext::submitAcquire(Batch &batch) {
+  begin(m_graphicsQueue, batch.acquire);
+  submit(m_graphicsQueue, batch.acquire, batch.acquires, batch.uploads.semaphore);
+  batch.acquires.clear();
+}
+
+void UploadContext::recycle(Queue &queue, Submission &submission) {
+  if (submission.commandBuffer != VK_NULL_HANDLE) {
+    queue.spare.push_back(submission);
+  }
+  submission = {};
+}
+
+bool UploadContext::signalled(VkDevice device, const Submission &submission) {
+  return submission.fence == VK_NULL_HANDLE || vkGetFenceStatus(device, submission.fence) == VK_SUCCESS;
+}
+
+uint64_t UploadContext::submit() {
+  m_recording.number = m_nextBatch++;
+  if (m_recording.uploads.commandBuffer == VK_NULL_HANDLE) {
+    // nothing was copied out of the ring, so nothing reads the space it took
+    m_used -= m_recording.bytes;
+    m_recording.bytes = 0;
+    if (m_recording.graphics.commandBuffer == VK_NULL_HANDLE) {
+      return m_recording.number;
+    }
+  }
+
+  if (m_recording.uploads.commandBuffer != VK_NULL_HANDLE) {
+    submit(m_uploadQueue, m_recording.uploads, m_releases, VK_NULL_HANDLE);
+  }
+  if (m_recording.graphics.commandBuffer != VK_NULL_HANDLE) {
+    submit(m_graphicsQueue, m_recording.graphics, {}, VK_NULL_HANDLE);
+  }
+  m_releases.clear();
+
+  m_stats.batches++;
+  m_inFlight.push_back(std::move(m_recording));
+  m_recording = {};
+  return m_inFlight.back().number;
+}
+
+bool UploadContext::finished(uint64_t batch) {
+  VkDevice device = m_device.device();
+  // uploads finish in the order they were submitted in, and with them the ring space they used
+  for (Batch &inFlight : m_inFlight) {
+    if (inFlight.uploaded) {
+      continue;
+    }
+    if (!signalled(device, inFlight.uploads)) {
+      break;
+    }
+    inFlight.uploaded = true;
+    m_used -= inFlight.bytes;
+    if (inFlight.uploads.semaphore != VK_NULL_HANDLE) {
+      submitAcquire(inFlight);
+    }
+  }
+  while (!m_inFlight.empty()) {
+    Batch &oldest = m_inFlight.front();
+    if (!oldest.uploaded || !signalled(device, oldest.graphics) || !signalled(device, oldest.acquire)) {
+      break;
+    }
+    recycle(m_uploadQueue, oldest.uploads);
+    recycle(m_graphicsQueue, oldest.graphics);
+    recycle(m_graphicsQueue, oldest.acquire);
+    m_inFlight.pop_front();
+  }
+
+  // empty batches were never in flight, they finish with the ones before them
+  auto isFinished = [this](uint64_t number) {
+    return number < m_nextBatch && (m_inFlight.empty() || number < m_inFlight.front().number);
+  };
+  m_dedicatedBuffers.erase(
+      std::remove_if(
+          m_dedicatedBuffers.begin(),
+          m_dedicatedBuffers.end(),
+          [&isFinished](const std::pair<uint64_t, std::unique_ptr<Buffer>> &dedicated) {
+            return isFinished(dedicated.first);
+          }),
+      m_dedicatedBuffers.end());
+  return isFinished(batch);
+}
+
+void UploadContext::wait(uint64_t batch) {
+  while (!finished(batch) && !m_inFlight.empty()) {
+    // the oldest batch holds it up. once its uploads are done `finished()`
+    // submits its acquire, which the next time around waits for
+    const Batch &oldest = m_inFlight.front();
+    for (const Submission *submission : {&oldest.uploads, &oldest.graphics, &oldest.acquire}) {
+      if (submission->fence != VK_NULL_HANDLE) {
+        vkWaitForFences(m_device.device(), 1, &submission->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+      }
+    }
+  }
+}
+
+} // namespace ve
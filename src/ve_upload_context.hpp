@@ -0,0 +1,173 @@
+#pragma once
+
+#include "ve_buffer.hpp"
+#include "ve_device.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace ve {
+
+// records uploads to buffers and images, and the barriers around them, into
+// one command buffer instead of a queue round trip each. data goes through a
+// persistently mapped staging ring. everything recorded between two
+// `submit()`s goes to the gpu as one batch with a fence, and the space the
+// batch used is handed out again once the fence has signalled, so nothing
+// ever waits for the queue to go idle. only used from the main thread.
+//
+// when the device has a transfer queue the copies out of the ring run on
+// it, alongside rendering. images are released to the graphics queue at the
+// end of the batch and only acquired there, in a submission waiting on the
+// batch's semaphore, once its fence shows the copies are done. so the
+// graphics queue never waits on uploads, and frames submitted before that
+// just don't use them yet. without a transfer queue everything is recorded
+// for the graphics queue
+class UploadContext {
+public:
+  static constexpr VkDeviceSize DEFAULT_SIZE = VkDeviceSize{32} << 20;
+
+  UploadContext(Device &device, VkDeviceSize size = DEFAULT_SIZE);
+  ~UploadContext();
+
+  UploadContext(const UploadContext &) = delete;
+  UploadContext &operator=(const UploadContext &) = delete;
+
+  // room for `size` bytes in the batch being recorded, at `offset` of
+  // `buffer()` and written through `data`. false if the ring is full until
+  // earlier batches finish, or if `size` is more than it can ever hold
+  bool allocate(VkDeviceSize size, VkDeviceSize alignment, void *&data, VkDeviceSize &offset);
+  VkBuffer buffer() { return m_buffer.buffer; }
+  VkDeviceSize size() const { return m_size; }
+
+  // the command buffer copying out of the ring in the batch being recorded,
+  // begun when first asked for. it's for the transfer queue if there is one
+  VkCommandBuffer commandBuffer();
+  // buffers uploads write to while the graphics queue reads other parts of
+  // them have to be shared between these queue families, see Buffer::create
+  const std::vector<uint32_t> &sharedQueueFamilies() const { return m_sharedQueueFamilies; }
+
+  // these never fail for lack of space. if the ring is full the batch is
+  // submitted and they wait for earlier ones, anything bigger than the whole
+  // ring gets staging memory of its own until its batch finishes
+  void uploadBuffer(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+  // the regions' buffer offsets are relative to `data`, the image has to be
+  // in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+  void uploadImage(const void *data, VkDeviceSize size, VkImage image, const std::vector<VkBufferImageCopy> &regions);
+  // copies between buffers already on the gpu, always on the graphics queue.
+  // regions may not overlap
+  void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, const std::vector<VkBufferCopy> &regions);
+  // transitions into VK_PIPELINE_STAGE_TRANSFER_BIT prepare an image for
+  // uploads, any others hand it over to the graphics queue
+  void imageLayoutTransition(
+      VkImage image,
+      uint32_t layerCount,
+      uint32_t levelCount,
+      VkImageAspectFlags aspectMask,
+      VkImageLayout oldLayout,
+      VkImageLayout newLayout,
+      VkAccessFlags srcAccessMask,
+      VkAccessFlags dstAccessMask,
+      VkPipelineStageFlags srcStageMask,
+      VkPipelineStageFlags dstStageMask);
+
+  // submits the batch being recorded and returns its number, a batch with
+  // nothing in it is finished right away
+  uint64_t submit();
+  // whether batch `batch` has finished, recycling the space of every
+  // finished one. what a finished batch wrote is visible to whatever is
+  // submitted to the graphics queue after this returned true
+  bool finished(uint64_t batch);
+  void wait(uint64_t batch);
+  // the number the batch being recorded will get
+  uint64_t currentBatch() const { return m_nextBatch; }
+
+  // running totals, the difference between two of them shows the throughput
+  struct Stats {
+    uint64_t bytes{0};
+    uint64_t batches{0};
+    // times the ring was full and recording had to wait for the gpu
+    uint64_t waits{0};
+  };
+  const Stats &stats() const { return m_stats; }
+
+private:
+  // a command buffer and what it signals, all null until it's needed
+  struct Submission {
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    // only signalled by transfer queue submissions, for the acquire to wait on
+    VkSemaphore semaphore;
+  };
+
+  // a queue and the submissions for it that can be reused
+  struct Queue {
+    VkQueue queue;
+    VkCommandPool commandPool;
+    uint32_t family;
+    std::vector<Submission> spare;
+  };
+
+  struct Batch {
+    uint64_t number;
+    // bytes of the ring it used, padding included
+    VkDeviceSize bytes;
+    // the copies out of the ring, on the transfer queue if there is one
+    Submission uploads;
+    // work for the graphics queue, only used next to a transfer queue
+    Submission graphics;
+    // takes what `uploads` wrote over to the graphics queue once it finished
+    Submission acquire;
+    std::vector<VkImageMemoryBarrier> acquires;
+    bool uploaded;
+  };
+
+  // copies `size` bytes of `data` into the ring, or a buffer of its own, for the batch being recorded
+  void stage(const void *data, VkDeviceSize size, VkBuffer &buffer, VkDeviceSize &offset);
+  bool usesTransferQueue() const { return &m_uploadQueue == &m_transferQueue; }
+  // the command buffer for the graphics queue in the batch being recorded
+  VkCommandBuffer graphicsCommandBuffer();
+  // begins `submission` for `queue` if it isn't yet
+  VkCommandBuffer begin(Queue &queue, Submission &submission);
+  // records the barriers closing `submission` and submits it, after `waitSemaphore` if it isn't null
+  void submit(
+      Queue &queue,
+      Submission &submission,
+      const std::vector<VkImageMemoryBarrier> &imageBarriers,
+      VkSemaphore waitSemaphore);
+  void submitAcquire(Batch &batch);
+  // puts `submission` back for reuse, if it was used
+  void recycle(Queue &queue, Submission &submission);
+  static bool signalled(VkDevice device, const Submission &submission);
+
+  static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+  Device &m_device;
+  Buffer m_buffer;
+  VkDeviceSize m_size;
+  uint8_t *m_data;
+
+  Queue m_graphicsQueue{};
+  Queue m_transferQueue{};
+  // the transfer queue if there is one, otherwise the graphics queue
+  Queue &m_uploadQueue;
+  std::vector<uint32_t> m_sharedQueueFamilies;
+
+  // the ring runs from `m_head - m_used` (wrapping around) to `m_head`
+  VkDeviceSize m_head{0};
+  VkDeviceSize m_used{0};
+
+  Batch m_recording{};
+  // images the batch being recorded hands over to the graphics queue
+  std::vector<VkImageMemoryBarrier> m_releases;
+  std::deque<Batch> m_inFlight;
+  uint64_t m_nextBatch{1};
+  // staging buffers of uploads too big for the ring, with the batch using them
+  std::vector<std::pair<uint64_t, std::unique_ptr<Buffer>>> m_dedicatedBuffers;
+
+  Stats m_stats{};
+};
+
+} // namespace ve
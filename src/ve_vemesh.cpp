@@ -0,0 +1,110 @@
+#include "ve_vemesh.hpp"
+
+#include <cstring>
+#include <iostream>
+
+namespace ve {
+
+namespace vemesh {
+
+namespace {
+
+bool fits(const Section &section, size_t size) {
+  return section.offset <= size && section.size <= size - section.offset && section.offset % ALIGNMENT == 0;
+}
+
+// whether the primitive's arena, lods and the index ranges it draws are within what the file has
+bool valid(const Mesh::Primitive &primitive, const Header &header) {
+  if (primitive.indexArena >= Mesh::INDEX_ARENA_COUNT || primitive.lodCount == 0 ||
+      primitive.lodCount > Mesh::MAX_LOD_COUNT) {
+    return false;
+  }
+  uint64_t indexCount = header.indexCounts[primitive.indexArena];
+  if (uint64_t{primitive.firstIndex} + primitive.indexCount > indexCount) {
+    return false;
+  }
+  for (uint32_t lod = 0; lod < primitive.lodCount; lod++) {
+    if (uint64_t{primitive.lods[lod].firstIndex} + primitive.lods[lod].indexCount > indexCount) {
+      return false;
+    }
+  }
+  // the offset is the lowest vertex the primitive's indices use, not where its vertices start
+  return primitive.vertexOffset >= 0 && static_cast<uint32_t>(primitive.vertexOffset) <= header.vertexCount;
+}
+
+} // namespace
+
+const Header *parse(const uint8_t *data, size_t size) {
+  if (size < sizeof(Header)) {
+    std::cout << "vemesh::parse(): file is too small" << std::endl;
+    return nullptr;
+  }
+
+  const Header *header = reinterpret_cast<const Header *>(data);
+  if (header->magic != MAGIC) {
+    std::cout << "vemesh::parse(): not a .vemesh file" << std::endl;
+    return nullptr;
+  }
+  if (header->version != VERSION || header->vertexStride != Mesh::Layout::stride ||
+      header->primitiveSize != sizeof(Mesh::Primitive)) {
+    std::cout << "vemesh::parse(): file was cooked by a different version" << std::endl;
+    return nullptr;
+  }
+
+  bool complete = fits(header->vertices, size) &&
+                  header->vertices.size == uint64_t{header->vertexCount} * Mesh::Layout::stride &&
+                  fits(header->primitives, size) &&
+                  header->primitives.size == uint64_t{header->primitiveCount} * sizeof(Mesh::Primitive) &&
+                  fits(header->materials, size) &&
+                  header->materials.size == uint64_t{header->materialCount} * sizeof(Material) &&
+                  fits(header->textures, size) &&
+                  header->textures.size == uint64_t{header->textureCount} * sizeof(Texture);
+  for (uint32_t arena = 0; arena < Mesh::INDEX_ARENA_COUNT; arena++) {
+    complete = complete && fits(header->indices[arena], size) &&
+               header->indices[arena].size == uint64_t{header->indexCounts[arena]} * Mesh::indexSize(arena);
+  }
+  if (complete) {
+    const Texture *textures = table<Texture>(data, header->textures);
+    for (uint32_t i = 0; i < header->textureCount && complete; i++) {
+      complete = textures[i].path.offset <= size && textures[i].path.size <= size - textures[i].path.offset &&
+                 fits(textures[i].pixels, size) &&
+                 textures[i].pixels.size >= uint64_t{textures[i].width} * textures[i].height * 4;
+    }
+  }
+  if (complete) {
+    // copied out, like the loader does, as nothing promises they're aligned
+    const uint8_t *primitives = data + header->primitives.offset;
+    for (uint32_t i = 0; i < header->primitiveCount && complete; i++) {
+      Mesh::Primitive primitive;
+      std::memcpy(&primitive, primitives + i * sizeof(Mesh::Primitive), sizeof(Mesh::Primitive));
+      complete = valid(primitive, *header);
+    }
+  }
+  if (!complete) {
+    std::cout << "vemesh::parse(): file is truncated or corrupt" << std::endl;
+    return nullptr;
+  }
+
+  return header;
+}
+
+Writer::Writer()
+    : m_data(sizeof(Header), 0) {}
+
+Section Writer::append(const void *data, size_t size) {
+  size_t offset = (m_data.size() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  m_data.resize(offset + size, 0);
+  if (size > 0) {
+    std::memcpy(m_data.data() + offset, data, size);
+  }
+  return {offset, size};
+}
+
+std::vector<uint8_t> Writer::finish(const Header &header) {
+  std::memcpy(m_data.data(), &header, sizeof(Header));
+  return std::move(m_data);
+}
+
+} // namespace vemesh
+
+} // namespace ve
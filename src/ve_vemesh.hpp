@@ -0,0 +1,115 @@
+#pragma once
+
+#include "ve_mesh.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace ve {
+
+// the cooked mesh format. a .vemesh file is a header followed by sections at
+// the offsets the header records, each aligned so it can be used straight
+// out of a mapped file. vertices are already packed into `Mesh::Layout` and
+// indices already split into the index arenas, loading one is copying them
+// into staging memory and fixing up a few offsets
+namespace vemesh {
+
+constexpr uint32_t MAGIC = 0x48534d56; // "VMSH"
+constexpr uint32_t VERSION = 2;
+constexpr uint64_t ALIGNMENT = 16;
+
+// a range of bytes, counted from the start of the file
+struct Section {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  // the file only loads into builds whose vertex layout and primitives match the ones it was cooked with
+  uint32_t vertexStride;
+  uint32_t primitiveSize;
+  // last write time of the file it was cooked from, to tell when it's out of date
+  int64_t sourceTime;
+
+  uint32_t vertexCount;
+  uint32_t primitiveCount;
+  uint32_t materialCount;
+  uint32_t textureCount;
+  uint32_t indexCounts[Mesh::INDEX_ARENA_COUNT];
+
+  Section vertices;
+  Section indices[Mesh::INDEX_ARENA_COUNT];
+  // `Mesh::Primitive`s. their first indices, and those of their lods, count
+  // from the file's first index in their arena, their vertex offsets from
+  // its first vertex and their materials index the material table, with -1
+  // for the default material
+  Section primitives;
+  Section materials;
+  Section textures;
+};
+
+constexpr uint32_t NO_TEXTURE = ~0u;
+
+struct Material {
+  glm::vec4 metallicRoughnessFactor;
+  glm::vec4 baseColorFactor;
+  glm::vec4 emissiveFactor;
+  // indices into the texture table, or NO_TEXTURE
+  uint32_t baseColorTexture;
+  uint32_t metallicRoughnessTexture;
+  uint32_t normalTexture;
+  uint32_t occlusionTexture;
+  uint32_t emissiveTexture;
+  uint32_t pad[3];
+};
+
+// external textures are a path relative to `TextureLoader::TEXTURE_PATH`,
+// embedded ones `width * height` RGBA pixels
+struct Texture {
+  Section path;
+  Section pixels;
+  uint32_t width;
+  uint32_t height;
+};
+
+static_assert(std::is_trivially_copyable<Mesh::Primitive>::value, "primitives are stored as they are");
+
+// the header of `data` if it's a complete file this build can load, with
+// every primitive drawing only indices the file has, nullptr otherwise.
+// says why on stdout
+const Header *parse(const uint8_t *data, size_t size);
+
+template <typename T>
+const T *table(const uint8_t *data, const Section &section) {
+  return reinterpret_cast<const T *>(data + section.offset);
+}
+
+// puts a file together section by section, the header goes in last
+class Writer {
+public:
+  Writer();
+
+  Section append(const void *data, size_t size);
+  template <typename T>
+  Section append(const std::vector<T> &items) {
+    return append(items.data(), items.size() * sizeof(T));
+  }
+
+  std::vector<uint8_t> finish(const Header &header);
+
+private:
+  std::vector<uint8_t> m_data;
+};
+
+} // namespace vemesh
+
+} // namespace ve
@@ -0,0 +1,255 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ve {
+
+// how vertices are laid out in the vertex buffer. a layout is a list of
+// attributes, each one a semantic (what it is and which shader location it
+// feeds) around an encoding (how it's stored). their offsets, the stride and
+// the vulkan descriptions all follow from the list at compile time, e.g.
+//
+//   using Layout = VertexLayout<Position<Float3>, Normal<Octahedral16>, Uv0<Half2>>;
+//
+// vertices are loaded into any vertex struct with `position`, `normal`, `uv0`
+// and `uv1` members and packed into the layout on their way to the gpu
+namespace vertex {
+
+// encodings. `write()` takes the value as a vec4 and stores `size` bytes of it
+
+struct Float2 {
+  static constexpr VkFormat format = VK_FORMAT_R32G32_SFLOAT;
+  static constexpr uint32_t size = 8;
+  static void write(glm::vec4 value, uint8_t *out) { std::memcpy(out, &value, size); }
+};
+
+struct Float3 {
+  static constexpr VkFormat format = VK_FORMAT_R32G32B32_SFLOAT;
+  static constexpr uint32_t size = 12;
+  static void write(glm::vec4 value, uint8_t *out) { std::memcpy(out, &value, size); }
+};
+
+struct Half2 {
+  static constexpr VkFormat format = VK_FORMAT_R16G16_SFLOAT;
+  static constexpr uint32_t size = 4;
+  static void write(glm::vec4 value, uint8_t *out) {
+    uint32_t packed = glm::packHalf2x16(glm::vec2(value));
+    std::memcpy(out, &packed, size);
+  }
+};
+
+// values in [-1, 1], read back as floats in the shader
+struct Snorm16x4 {
+  static constexpr VkFormat format = VK_FORMAT_R16G16B16A16_SNORM;
+  static constexpr uint32_t size = 8;
+  static void write(glm::vec4 value, uint8_t *out) {
+    uint64_t packed = glm::packSnorm4x16(value);
+    std::memcpy(out, &packed, size);
+  }
+};
+
+// a unit vector folded onto an octahedron and stored as two snorms, the
+// shader unfolds it again when the layout has `octahedralNormals` set
+struct Octahedral16 {
+  static constexpr VkFormat format = VK_FORMAT_R16G16_SNORM;
+  static constexpr uint32_t size = 4;
+  static void write(glm::vec4 value, uint8_t *out) {
+    float length = std::abs(value.x) + std::abs(value.y) + std::abs(value.z);
+    glm::vec3 n = length > 0.0f ? glm::vec3(value) / length : glm::vec3(0.0f, 0.0f, 1.0f);
+    glm::vec2 folded(n.x, n.y);
+    if (n.z < 0.0f) {
+      glm::vec2 sign(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+      folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * sign;
+    }
+    uint32_t packed = glm::packSnorm2x16(folded);
+    std::memcpy(out, &packed, size);
+  }
+};
+
+// maps positions into the [-1, 1] range normalized encodings can hold,
+// `position = stored * scale + offset` undoes it
+struct Quantization {
+  glm::vec3 offset{0.0f};
+  glm::vec3 scale{1.0f};
+};
+
+// semantics. the locations have to match simple.vert
+
+template <typename E>
+struct Position {
+  using Encoding = E;
+  static constexpr uint32_t location = 0;
+  // anything but full floats is quantized to the bounds of the vertices
+  static constexpr bool quantized = !std::is_same<E, Float3>::value;
+
+  template <typename V>
+  static glm::vec4 read(const V &vertex, const Quantization &quantization) {
+    return glm::vec4((vertex.position - quantization.offset) / quantization.scale, 0.0f);
+  }
+};
+
+template <typename E>
+struct Normal {
+  using Encoding = E;
+  static constexpr uint32_t location = 1;
+  static constexpr bool octahedral = std::is_same<E, Octahedral16>::value;
+
+  template <typename V>
+  static glm::vec4 read(const V &vertex, const Quantization &) {
+    return glm::vec4(vertex.normal, 0.0f);
+  }
+};
+
+template <typename E>
+struct Uv0 {
+  using Encoding = E;
+  static constexpr uint32_t location = 2;
+
+  template <typename V>
+  static glm::vec4 read(const V &vertex, const Quantization &) {
+    return glm::vec4(vertex.uv0, 0.0f, 0.0f);
+  }
+};
+
+template <typename E>
+struct Uv1 {
+  using Encoding = E;
+  static constexpr uint32_t location = 3;
+
+  template <typename V>
+  static glm::vec4 read(const V &vertex, const Quantization &) {
+    return glm::vec4(vertex.uv1, 0.0f, 0.0f);
+  }
+};
+
+template <typename A>
+constexpr bool isQuantizedPosition() {
+  if constexpr (A::location == 0) {
+    return A::quantized;
+  }
+  return false;
+}
+
+template <typename A>
+constexpr bool isOctahedralNormal() {
+  if constexpr (A::location == 1) {
+    return A::octahedral;
+  }
+  return false;
+}
+
+} // namespace vertex
+
+template <typename... Attributes>
+class VertexLayout {
+public:
+  static constexpr uint32_t attributeCount = sizeof...(Attributes);
+  static constexpr uint32_t stride = (Attributes::Encoding::size + ...);
+
+  // whether positions have to be dequantized, and normals unfolded, in the shader
+  static constexpr bool quantizedPositions = (vertex::isQuantizedPosition<Attributes>() || ...);
+  static constexpr bool octahedralNormals = (vertex::isOctahedralNormal<Attributes>() || ...);
+
+  static constexpr std::array<uint32_t, attributeCount> offsets() {
+    std::array<uint32_t, attributeCount> result{};
+    constexpr uint32_t sizes[] = {Attributes::Encoding::size...};
+    uint32_t offset = 0;
+    for (size_t i = 0; i < attributeCount; i++) {
+      result[i] = offset;
+      offset += sizes[i];
+    }
+    return result;
+  }
+
+  static constexpr VkVertexInputBindingDescription bindingDescription(uint32_t binding = 0) {
+    return {binding, stride, VK_VERTEX_INPUT_RATE_VERTEX};
+  }
+
+  static constexpr std::array<VkVertexInputAttributeDescription, attributeCount> attributeDescriptions(
+      uint32_t binding = 0) {
+    constexpr std::array<uint32_t, attributeCount> attributeOffsets = offsets();
+    constexpr uint32_t locations[] = {Attributes::location...};
+    constexpr VkFormat formats[] = {Attributes::Encoding::format...};
+    std::array<VkVertexInputAttributeDescription, attributeCount> result{};
+    for (size_t i = 0; i < attributeCount; i++) {
+      result[i] = {locations[i], binding, formats[i], attributeOffsets[i]};
+    }
+    return result;
+  }
+
+  static std::vector<VkVertexInputBindingDescription> getBindingDescriptions() { return {bindingDescription()}; }
+
+  static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions() {
+    constexpr auto descriptions = attributeDescriptions();
+    return {descriptions.begin(), descriptions.end()};
+  }
+
+  // the quantization that fits `count` vertices into the layout's position encoding
+  template <typename V>
+  static vertex::Quantization quantization(const V *vertices, size_t count) {
+    vertex::Quantization result{};
+    if (!quantizedPositions || count == 0) {
+      return result;
+    }
+
+    glm::vec3 min = vertices[0].position;
+    glm::vec3 max = vertices[0].position;
+    for (size_t i = 1; i < count; i++) {
+      min = glm::min(min, vertices[i].position);
+      max = glm::max(max, vertices[i].position);
+    }
+    result.offset = (min + max) * 0.5f;
+    // flat vertices still need a scale that can be divided by
+    result.scale = glm::max((max - min) * 0.5f, glm::vec3(1e-6f));
+    return result;
+  }
+
+  // writes `count` vertices into `out`, which has room for `count * stride` bytes
+  template <typename V>
+  static void pack(const V *vertices, size_t count, const vertex::Quantization &quantization, uint8_t *out) {
+    for (size_t i = 0; i < count; i++) {
+      packVertex(vertices[i], quantization, out + i * stride, std::index_sequence_for<Attributes...>{});
+    }
+  }
+
+private:
+  template <typename V, size_t... I>
+  static void packVertex(
+      const V &vertex,
+      const vertex::Quantization &quantization,
+      uint8_t *out,
+      std::index_sequence<I...>) {
+    constexpr std::array<uint32_t, attributeCount> attributeOffsets = offsets();
+    (Attributes::Encoding::write(Attributes::read(vertex, quantization), out + attributeOffsets[I]), ...);
+  }
+};
+
+// 40 bytes, everything at full precision
+using FullVertexLayout = VertexLayout<
+    vertex::Position<vertex::Float3>,
+    vertex::Normal<vertex::Float3>,
+    vertex::Uv0<vertex::Float2>,
+    vertex::Uv1<vertex::Float2>>;
+
+// 20 bytes, positions quantized to 16 bits per axis over their mesh's bounds
+using PackedVertexLayout = VertexLayout<
+    vertex::Position<vertex::Snorm16x4>,
+    vertex::Normal<vertex::Octahedral16>,
+    vertex::Uv0<vertex::Half2>,
+    vertex::Uv1<vertex::Half2>>;
+
+} // namespace ve
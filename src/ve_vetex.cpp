@@ -0,0 +1,39 @@
+#include "ve_vetex.hpp"
+
+#include <iostream>
+
+namespace ve {
+
+namespace vetex {
+
+const Header *parse(const uint8_t *data, size_t size) {
+  if (size < sizeof(Header)) {
+    std::cout << "vetex::parse(): file is too small" << std::endl;
+    return nullptr;
+  }
+
+  const Header *header = reinterpret_cast<const Header *>(data);
+  if (header->magic != MAGIC) {
+    std::cout << "vetex::parse(): not a .vetex file" << std::endl;
+    return nullptr;
+  }
+  if (header->version != VERSION) {
+    std::cout << "vetex::parse(): file was cooked by a different version" << std::endl;
+    return nullptr;
+  }
+
+  bool complete = header->width > 0 && header->height > 0 && header->mipLevels > 0 &&
+                  header->mipLevels <= mipLevelCount(header->width, header->height) &&
+                  header->pixelOffset <= size && header->pixelSize <= size - header->pixelOffset &&
+                  header->pixelSize == mipChainSize(header->width, header->height, header->mipLevels);
+  if (!complete) {
+    std::cout << "vetex::parse(): file is truncated or corrupt" << std::endl;
+    return nullptr;
+  }
+
+  return header;
+}
+
+} // namespace vetex
+
+} // namespace ve
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace ve {
+
+// the cooked texture format. a .vetex file is a header followed by the
+// texture's full mip chain of RGBA pixels, largest level first, so it can be
+// copied into staging memory straight out of a mapped file
+namespace vetex {
+
+constexpr uint32_t MAGIC = 0x58455456; // "VTEX"
+constexpr uint32_t VERSION = 1;
+constexpr uint64_t ALIGNMENT = 16;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t mipLevels;
+  uint32_t pad;
+  // last write time of the file it was cooked from, to tell when it's out of date
+  int64_t sourceTime;
+  // counted from the start of the file
+  uint64_t pixelOffset;
+  uint64_t pixelSize;
+};
+
+// every level is half the size of the one before it, down to 1x1
+inline uint32_t mipLevelCount(uint32_t width, uint32_t height) {
+  uint32_t levels = 1;
+  while ((width | height) >> levels) {
+    levels++;
+  }
+  return levels;
+}
+
+inline uint32_t mipSize(uint32_t size, uint32_t level) { return std::max(1u, size >> level); }
+
+// bytes of the first `mipLevels` levels together
+inline uint64_t mipChainSize(uint32_t width, uint32_t height, uint32_t mipLevels) {
+  uint64_t size = 0;
+  for (uint32_t level = 0; level < mipLevels; level++) {
+    size += uint64_t{mipSize(width, level)} * mipSize(height, level) * 4;
+  }
+  return size;
+}
+
+// the header of `data` if it's a complete file this build can load,
+// nullptr otherwise. says why on stdout
+const Header *parse(const uint8_t *data, size_t size);
+
+} // namespace vetex
+
+} // namespace ve